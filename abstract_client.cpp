@@ -753,6 +753,12 @@ QSize AbstractClient::minSize() const
 }
 
 void AbstractClient::updateMoveResize(const QPointF &currentGlobalCursor)
+{
+    m_moveResize.samplePending = false;
+    applyMoveResize(pos(), currentGlobalCursor.toPoint());
+}
+
+void AbstractClient::queueMoveResize(const QPointF &currentGlobalCursor)
 {
     handleMoveResize(pos(), currentGlobalCursor.toPoint());
 }
@@ -1370,6 +1376,11 @@ void AbstractClient::leaveMoveResize()
 {
     workspace()->setMoveResizeClient(nullptr);
     setMoveResize(false);
+    m_moveResize.samplePending = false;
+    disconnect(m_moveResize.frameConnection);
+    if (m_moveResize.sampleTimer) {
+        m_moveResize.sampleTimer->stop();
+    }
     if (ScreenEdges::self()->isDesktopSwitchingMovingClients())
         ScreenEdges::self()->reserveDesktopSwitching(false, Qt::Vertical|Qt::Horizontal);
     if (isElectricBorderMaximizing()) {
@@ -1600,7 +1611,7 @@ void AbstractClient::layoutDecorationRects(QRect &left, QRect &top, QRect &right
 void AbstractClient::processDecorationMove(const QPoint &localPos, const QPoint &globalPos)
 {
     if (isMoveResizePointerButtonDown()) {
-        handleMoveResize(localPos.x(), localPos.y(), globalPos.x(), globalPos.y());
+        handleMoveResize(localPos, globalPos);
         return;
     }
     // TODO: handle modifiers
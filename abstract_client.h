@@ -578,7 +578,15 @@ public:
     void shrinkHorizontal();
     void growVertical();
     void shrinkVertical();
+    /**
+     * Applies the move resize for @p currentGlobalCursor right away.
+     */
     void updateMoveResize(const QPointF &currentGlobalCursor);
+    /**
+     * Like updateMoveResize(), but the position is only applied with the next compositor
+     * frame. Subsequent calls before that frame replace the position.
+     */
+    void queueMoveResize(const QPointF &currentGlobalCursor);
     /**
      * Ends move resize when all pointer buttons are up again.
      */
@@ -1126,6 +1134,11 @@ protected:
      * Default implementation returns @c false.
      */
     virtual bool isWaitingForMoveResizeSync() const;
+    /**
+     * Called once the client caught up with a resize sync. Pointer motion which happened
+     * in the meantime gets applied with the next compositor frame.
+     */
+    void resumeMoveResizeSampling();
     /**
      * Called during handling a resize. Implementing subclasses can use this
      * method to perform windowing system specific syncing.
@@ -1133,7 +1146,11 @@ protected:
      * Default implementation does nothing.
      */
     virtual void doResizeSync();
-    void handleMoveResize(int x, int y, int x_root, int y_root);
+    /**
+     * Records the pointer position for an interactive move or resize. Once the move
+     * resize mode has been entered, the position is sampled once per compositor frame
+     * instead of being applied on every pointer event.
+     */
     void handleMoveResize(const QPoint &local, const QPoint &global);
     void dontMoveResize();
 
@@ -1185,6 +1202,10 @@ protected:
 
 private:
     void handlePaletteChange();
+    void applyMoveResize(const QPoint &local, const QPoint &global);
+    void applyMoveResizeGeometry(int x, int y, int x_root, int y_root);
+    void scheduleMoveResizeSample();
+    void sampleMoveResize();
     QSharedPointer<TabBox::TabBoxClientImpl> m_tabBoxClient;
     bool m_firstInTabBox = false;
     bool m_skipTaskbar = false;
@@ -1243,6 +1264,14 @@ private:
         CursorShape cursor = Qt::ArrowCursor;
         int startScreen = 0;
         QTimer *delayedTimer = nullptr;
+        // latest pointer position which has not been applied yet
+        bool samplePending = false;
+        QPoint sampleLocal;
+        QPoint sampleGlobal;
+        QMetaObject::Connection frameConnection;
+        QTimer *sampleTimer = nullptr;
+        // the release position is applied, a pending resize sync must not hold it back
+        bool finishing = false;
     } m_moveResize;
 
     struct {
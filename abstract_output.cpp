@@ -119,4 +119,26 @@ bool AbstractOutput::setGammaRamp(const GammaRamp &gamma)
     return false;
 }
 
+std::chrono::nanoseconds AbstractOutput::lastPresentationTimestamp() const
+{
+    return m_lastPresentationTimestamp;
+}
+
+quint64 AbstractOutput::presentationSequence() const
+{
+    return m_presentationSequence;
+}
+
+void AbstractOutput::notifyFramePresented(std::chrono::nanoseconds timestamp, quint32 sequence)
+{
+    quint64 extended = (m_presentationSequence & ~quint64(0xffffffff)) | sequence;
+    if (extended < m_presentationSequence) {
+        // the hardware counter wrapped around
+        extended += quint64(1) << 32;
+    }
+    m_presentationSequence = extended;
+    m_lastPresentationTimestamp = timestamp;
+    emit framePresented(timestamp, extended);
+}
+
 } // namespace KWin
@@ -27,6 +27,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <QSize>
 #include <QVector>
 
+#include <chrono>
+
 namespace KWayland
 {
 namespace Server
@@ -182,8 +184,36 @@ public:
      */
     virtual bool setGammaRamp(const GammaRamp &gamma);
 
+    /**
+     * Returns the time at which the last frame was presented on this output, in the
+     * CLOCK_MONOTONIC domain.
+     *
+     * Returns zero if the platform doesn't report when frames are presented.
+     */
+    std::chrono::nanoseconds lastPresentationTimestamp() const;
+
+    /**
+     * Returns the hardware vertical blank counter at the time the last frame was presented.
+     */
+    quint64 presentationSequence() const;
+
+Q_SIGNALS:
+    /**
+     * Emitted when a frame has been presented on this output.
+     */
+    void framePresented(std::chrono::nanoseconds timestamp, quint64 sequence);
+
+protected:
+    /**
+     * To be called by the platform when a frame has been presented, e.g. on page flip.
+     * The @p sequence may be a 32 bit hardware counter, it's extended to 64 bit.
+     */
+    void notifyFramePresented(std::chrono::nanoseconds timestamp, quint32 sequence);
+
 private:
     Q_DISABLE_COPY(AbstractOutput)
+    std::chrono::nanoseconds m_lastPresentationTimestamp = std::chrono::nanoseconds::zero();
+    quint64 m_presentationSequence = 0;
 };
 
 } // namespace KWin
@@ -23,6 +23,22 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <QRasterWindow>
 #include <QTimer>
 
+// The text to transfer, an optional argument gives its size in bytes.
+static QString clipboardText()
+{
+    const QStringList arguments = QCoreApplication::arguments();
+    const int size = arguments.count() > 1 ? arguments.at(1).toInt() : 0;
+    if (size <= 0) {
+        return QStringLiteral("test");
+    }
+    QString text;
+    text.reserve(size);
+    for (int i = 0; i < size; ++i) {
+        text.append(QLatin1Char('a' + i % 26));
+    }
+    return text;
+}
+
 class Window : public QRasterWindow
 {
     Q_OBJECT
@@ -54,7 +70,7 @@ void Window::focusInEvent(QFocusEvent *event)
     QRasterWindow::focusInEvent(event);
     // TODO: make it work without singleshot
     QTimer::singleShot(100,[] {
-        qApp->clipboard()->setText(QStringLiteral("test"));
+        qApp->clipboard()->setText(clipboardText());
     });
 }
 
@@ -23,6 +23,22 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <QRasterWindow>
 #include <QTimer>
 
+// The text to transfer, an optional argument gives its size in bytes.
+static QString clipboardText()
+{
+    const QStringList arguments = QCoreApplication::arguments();
+    const int size = arguments.count() > 1 ? arguments.at(1).toInt() : 0;
+    if (size <= 0) {
+        return QStringLiteral("test");
+    }
+    QString text;
+    text.reserve(size);
+    for (int i = 0; i < size; ++i) {
+        text.append(QLatin1Char('a' + i % 26));
+    }
+    return text;
+}
+
 class Window : public QRasterWindow
 {
     Q_OBJECT
@@ -51,9 +67,10 @@ void Window::paintEvent(QPaintEvent *event)
 int main(int argc, char *argv[])
 {
     QGuiApplication app(argc, argv);
+    const QString expected = clipboardText();
     QObject::connect(app.clipboard(), &QClipboard::changed, &app,
-        [] {
-            if (qApp->clipboard()->text() == QLatin1String("test")) {
+        [expected] {
+            if (qApp->clipboard()->text() == expected) {
                 QTimer::singleShot(100, qApp, &QCoreApplication::quit);
             }
         }
@@ -0,0 +1,192 @@
+/********************************************************************
+KWin - the KDE window manager
+This file is part of the KDE project.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*********************************************************************/
+#include "kwin_wayland_test.h"
+#include "composite.h"
+#include "cursor.h"
+#include "effectloader.h"
+#include "effect_builtins.h"
+#include "platform.h"
+#include "scene.h"
+#include "screens.h"
+#include "wayland_server.h"
+#include "workspace.h"
+#include "xdgshellclient.h"
+
+#include <KConfigGroup>
+
+#include <KWayland/Client/surface.h>
+#include <KWayland/Client/xdgshell.h>
+
+using namespace KWin;
+using namespace KWayland::Client;
+
+static const QString s_socketName = QStringLiteral("wayland_test_kwin_multi_output_damage-0");
+
+class MultiOutputDamageTest : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void initTestCase();
+    void init();
+    void cleanup();
+    void testDamageOnSecondOutput();
+    void testDamageOnFirstOutput();
+};
+
+// the software cursor gets painted on every frame, the area it covers on @p screen
+static QRect cursorRect(int screen)
+{
+    const QImage cursor = kwinApp()->platform()->softwareCursor();
+    if (!kwinApp()->platform()->usesSoftwareCursor() || cursor.isNull()) {
+        return QRect();
+    }
+    const QRect rect(KWin::Cursor::pos() - kwinApp()->platform()->softwareCursorHotspot(), cursor.size());
+    const QRect screenGeometry = screens()->geometry(screen);
+    return rect.intersected(screenGeometry).translated(-screenGeometry.topLeft());
+}
+
+static int area(const QRect &rect)
+{
+    return rect.width() * rect.height();
+}
+
+static int countPixels(const QImage &image, const QColor &color, const QRect &exclude = QRect())
+{
+    const QRgb rgb = color.rgb();
+    int count = 0;
+    for (int y = 0; y < image.height(); ++y) {
+        const QRgb *line = reinterpret_cast<const QRgb *>(image.constScanLine(y));
+        for (int x = 0; x < image.width(); ++x) {
+            if (line[x] == rgb && !exclude.contains(x, y)) {
+                count++;
+            }
+        }
+    }
+    return count;
+}
+
+void MultiOutputDamageTest::initTestCase()
+{
+    qRegisterMetaType<KWin::XdgShellClient *>();
+    qRegisterMetaType<KWin::AbstractClient*>();
+    QSignalSpy workspaceCreatedSpy(kwinApp(), &Application::workspaceCreated);
+    QVERIFY(workspaceCreatedSpy.isValid());
+    kwinApp()->platform()->setInitialWindowSize(QSize(1280, 1024));
+    QVERIFY(waylandServer()->init(s_socketName.toLocal8Bit()));
+    QMetaObject::invokeMethod(kwinApp()->platform(), "setVirtualOutputs", Qt::DirectConnection, Q_ARG(int, 2));
+
+    // disable all effects - we don't want to have it interact with the rendering
+    auto config = KSharedConfig::openConfig(QString(), KConfig::SimpleConfig);
+    KConfigGroup plugins(config, QStringLiteral("Plugins"));
+    ScriptedEffectLoader loader;
+    const auto builtinNames = BuiltInEffects::availableEffectNames() << loader.listOfKnownEffects();
+    for (QString name : builtinNames) {
+        plugins.writeEntry(name + QStringLiteral("Enabled"), false);
+    }
+    config->sync();
+    kwinApp()->setConfig(config);
+
+    qputenv("KWIN_COMPOSE", QByteArrayLiteral("Q"));
+
+    kwinApp()->start();
+    QVERIFY(workspaceCreatedSpy.wait());
+    QCOMPARE(screens()->count(), 2);
+    QCOMPARE(screens()->geometry(0), QRect(0, 0, 1280, 1024));
+    QCOMPARE(screens()->geometry(1), QRect(1280, 0, 1280, 1024));
+    QVERIFY(Compositor::self());
+    QCOMPARE(kwinApp()->platform()->selectedCompositor(), QPainterCompositing);
+}
+
+void MultiOutputDamageTest::init()
+{
+    QVERIFY(Test::setupWaylandConnection());
+    // keep the software cursor away from the windows, the area it covers is left out
+    // when counting the pixels
+    KWin::Cursor::setPos(QPoint(1000, 900));
+}
+
+void MultiOutputDamageTest::cleanup()
+{
+    Test::destroyWaylandConnection();
+}
+
+void MultiOutputDamageTest::testDamageOnSecondOutput()
+{
+    // this test verifies that a window which gets damaged on the second output is updated
+    // there, and that nothing but the damaged area is painted
+    QScopedPointer<Surface> surface(Test::createSurface());
+    QScopedPointer<XdgShellSurface> shellSurface(Test::createXdgShellStableSurface(surface.data()));
+    auto client = Test::renderAndWaitForShown(surface.data(), QSize(100, 100), Qt::blue);
+    QVERIFY(client);
+    client->move(QPoint(1380, 100));
+
+    auto scene = Compositor::self()->scene();
+    QVERIFY(scene);
+    QImage *firstBuffer = scene->qpainterRenderBufferForScreen(0);
+    QImage *secondBuffer = scene->qpainterRenderBufferForScreen(1);
+    QVERIFY(firstBuffer);
+    QVERIFY(secondBuffer);
+    QTRY_COMPARE(countPixels(*secondBuffer, Qt::blue), 100 * 100);
+    QTRY_COMPARE(countPixels(*firstBuffer, Qt::blue), 0);
+
+    // mark all pixels, so that every pixel which gets painted from now on can be told apart
+    firstBuffer->fill(Qt::magenta);
+    secondBuffer->fill(Qt::magenta);
+
+    QSignalSpy frameRenderedSpy(scene, &Scene::frameRendered);
+    QVERIFY(frameRenderedSpy.isValid());
+    Test::render(surface.data(), QSize(100, 100), Qt::red);
+    QVERIFY(frameRenderedSpy.wait());
+
+    QTRY_COMPARE(countPixels(*secondBuffer, Qt::red), 100 * 100);
+    QCOMPARE(countPixels(*secondBuffer, Qt::magenta, cursorRect(1)), 1280 * 1024 - 100 * 100 - area(cursorRect(1)));
+    QCOMPARE(countPixels(*firstBuffer, Qt::magenta, cursorRect(0)), 1280 * 1024 - area(cursorRect(0)));
+}
+
+void MultiOutputDamageTest::testDamageOnFirstOutput()
+{
+    // this test verifies that damage on the first output doesn't cause repaints on the second one
+    QScopedPointer<Surface> surface(Test::createSurface());
+    QScopedPointer<XdgShellSurface> shellSurface(Test::createXdgShellStableSurface(surface.data()));
+    auto client = Test::renderAndWaitForShown(surface.data(), QSize(100, 100), Qt::blue);
+    QVERIFY(client);
+    client->move(QPoint(100, 100));
+
+    auto scene = Compositor::self()->scene();
+    QVERIFY(scene);
+    QImage *firstBuffer = scene->qpainterRenderBufferForScreen(0);
+    QImage *secondBuffer = scene->qpainterRenderBufferForScreen(1);
+    QVERIFY(firstBuffer);
+    QVERIFY(secondBuffer);
+    QTRY_COMPARE(countPixels(*firstBuffer, Qt::blue), 100 * 100);
+
+    firstBuffer->fill(Qt::magenta);
+    secondBuffer->fill(Qt::magenta);
+
+    QSignalSpy frameRenderedSpy(scene, &Scene::frameRendered);
+    QVERIFY(frameRenderedSpy.isValid());
+    Test::render(surface.data(), QSize(100, 100), Qt::red);
+    QVERIFY(frameRenderedSpy.wait());
+
+    QTRY_COMPARE(countPixels(*firstBuffer, Qt::red), 100 * 100);
+    QCOMPARE(countPixels(*firstBuffer, Qt::magenta, cursorRect(0)), 1280 * 1024 - 100 * 100 - area(cursorRect(0)));
+    QCOMPARE(countPixels(*secondBuffer, Qt::magenta, cursorRect(1)), 1280 * 1024 - area(cursorRect(1)));
+}
+
+WAYLANDTEST_MAIN(MultiOutputDamageTest)
+#include "multi_output_damage_test.moc"
@@ -28,6 +28,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <KWayland/Server/datadevice_interface.h>
 
+#include <QElapsedTimer>
 #include <QProcess>
 #include <QProcessEnvironment>
 
@@ -43,10 +44,13 @@ private Q_SLOTS:
     void cleanup();
     void testSync_data();
     void testSync();
+    void testThroughput_data();
+    void testThroughput();
 
 private:
     QProcess *m_copyProcess = nullptr;
     QProcess *m_pasteProcess = nullptr;
+    qint64 m_pasteTime = 0;
 };
 
 void XwaylandSelectionsTest::initTestCase()
@@ -98,9 +102,10 @@ void XwaylandSelectionsTest::testSync_data()
 {
     QTest::addColumn<QString>("copyPlatform");
     QTest::addColumn<QString>("pastePlatform");
+    QTest::addColumn<int>("size");
 
-    QTest::newRow("x11->wayland") << QStringLiteral("xcb") << QStringLiteral("wayland");
-    QTest::newRow("wayland->x11") << QStringLiteral("wayland") << QStringLiteral("xcb");
+    QTest::newRow("x11->wayland") << QStringLiteral("xcb") << QStringLiteral("wayland") << 0;
+    QTest::newRow("wayland->x11") << QStringLiteral("wayland") << QStringLiteral("xcb") << 0;
 }
 
 void XwaylandSelectionsTest::testSync()
@@ -119,6 +124,8 @@ void XwaylandSelectionsTest::testSync()
     QVERIFY(clipboardChangedSpy.isValid());
 
     QProcessEnvironment environment = QProcessEnvironment::systemEnvironment();
+    QFETCH(int, size);
+    const QStringList arguments = size > 0 ? QStringList{QString::number(size)} : QStringList();
 
     // start the copy process
     QFETCH(QString, copyPlatform);
@@ -128,6 +135,7 @@ void XwaylandSelectionsTest::testSync()
     m_copyProcess->setProcessEnvironment(environment);
     m_copyProcess->setProcessChannelMode(QProcess::ForwardedChannels);
     m_copyProcess->setProgram(copy);
+    m_copyProcess->setArguments(arguments);
     m_copyProcess->start();
     QVERIFY(m_copyProcess->waitForStarted());
 
@@ -163,6 +171,7 @@ void XwaylandSelectionsTest::testSync()
     m_pasteProcess->setProcessEnvironment(environment);
     m_pasteProcess->setProcessChannelMode(QProcess::ForwardedChannels);
     m_pasteProcess->setProgram(paste);
+    m_pasteProcess->setArguments(arguments);
     m_pasteProcess->start();
     QVERIFY(m_pasteProcess->waitForStarted());
 
@@ -185,7 +194,10 @@ void XwaylandSelectionsTest::testSync()
         QVERIFY(clientActivatedSpy.wait());
     }
     QTRY_COMPARE(workspace()->activeClient(), pasteClient);
-    QVERIFY(finishedSpy.wait());
+    QElapsedTimer pasteTimer;
+    pasteTimer.start();
+    QVERIFY(finishedSpy.wait(30000));
+    m_pasteTime = pasteTimer.elapsed();
     QCOMPARE(finishedSpy.first().first().toInt(), 0);
     delete m_pasteProcess;
     m_pasteProcess = nullptr;
@@ -193,5 +205,30 @@ void XwaylandSelectionsTest::testSync()
     m_copyProcess = nullptr;
 }
 
+void XwaylandSelectionsTest::testThroughput_data()
+{
+    QTest::addColumn<QString>("copyPlatform");
+    QTest::addColumn<QString>("pastePlatform");
+    QTest::addColumn<int>("size");
+
+    // larger than a single property, goes through incremental transfers
+    QTest::newRow("x11->wayland 1 MiB") << QStringLiteral("xcb") << QStringLiteral("wayland") << 1024 * 1024;
+    QTest::newRow("wayland->x11 1 MiB") << QStringLiteral("wayland") << QStringLiteral("xcb") << 1024 * 1024;
+    QTest::newRow("x11->wayland 16 MiB") << QStringLiteral("xcb") << QStringLiteral("wayland") << 16 * 1024 * 1024;
+    QTest::newRow("wayland->x11 16 MiB") << QStringLiteral("wayland") << QStringLiteral("xcb") << 16 * 1024 * 1024;
+}
+
+void XwaylandSelectionsTest::testThroughput()
+{
+    // this test verifies that large clipboard contents get through completely and reports
+    // the throughput, the paste time includes the conversion in the helpers
+    testSync();
+    if (QTest::currentTestFailed()) {
+        return;
+    }
+    QFETCH(int, size);
+    QTest::setBenchmarkResult(size * 1000.0 / qMax<qint64>(m_pasteTime, 1), QTest::BytesPerSecond);
+}
+
 WAYLANDTEST_MAIN(XwaylandSelectionsTest)
 #include "xwayland_selections_test.moc"
@@ -281,6 +281,9 @@ public:
     void renderEffectQuickView(KWin::EffectQuickView *quickView) const override {
         Q_UNUSED(quickView);
     }
+    std::chrono::nanoseconds presentationTime() const override {
+        return std::chrono::nanoseconds::zero();
+    }
 
 private:
     bool m_animationsSuported = true;
@@ -0,0 +1,228 @@
+/********************************************************************
+ KWin - the KDE window manager
+ This file is part of the KDE project.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*********************************************************************/
+#include "../effects/presentwindows/presentwindows_layout.h"
+
+#include <QDebug>
+#include <QRandomGenerator>
+#include <QTest>
+
+using namespace KWin;
+
+static const QRect s_area(0, 0, 1920, 1080);
+
+class PresentWindowsLayoutTest : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void testGridQuery();
+    void testLayoutInArea_data();
+    void testLayoutInArea();
+    void testRemoveWindows();
+    void testAddWindow();
+    void benchmarkSolve_data();
+    void benchmarkSolve();
+    void benchmarkRelayout_data();
+    void benchmarkRelayout();
+};
+
+// a reproducible set of windows scattered over the screen, most of them overlapping
+static void createWindows(int count, QVector<quintptr> *keys, QVector<QRect> *geometries)
+{
+    QRandomGenerator generator(count);
+    keys->clear();
+    geometries->clear();
+    for (int i = 0; i < count; ++i) {
+        const int width = generator.bounded(200, 1400);
+        const int height = generator.bounded(150, 900);
+        const int x = generator.bounded(s_area.width() - width);
+        const int y = generator.bounded(s_area.height() - height);
+        keys->append(quintptr(i + 1));
+        geometries->append(QRect(x, y, width, height));
+    }
+}
+
+// the core guarantee of the solver, no two targets overlap
+static bool hasOverlaps(const QVector<QRect> &targets)
+{
+    for (int i = 0; i < targets.count(); ++i) {
+        for (int j = i + 1; j < targets.count(); ++j) {
+            if (targets[i].intersects(targets[j])) {
+                qWarning() << "Overlapping targets" << i << targets[i] << j << targets[j];
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+static NaturalLayoutSolver::Parameters parameters()
+{
+    NaturalLayoutSolver::Parameters parameters;
+    parameters.area = s_area;
+    parameters.accuracy = 20;
+    parameters.fillGaps = true;
+    return parameters;
+}
+
+void PresentWindowsLayoutTest::testGridQuery()
+{
+    LayoutGrid grid(100);
+    grid.insert(0, QRect(0, 0, 50, 50));
+    grid.insert(1, QRect(150, 150, 300, 50));
+    grid.insert(2, QRect(-250, -250, 100, 100));
+
+    QCOMPARE(grid.query(QRect(10, 10, 10, 10)), QVector<int>{0});
+    QCOMPARE(grid.query(QRect(0, 0, 200, 200)), (QVector<int>{0, 1}));
+    QCOMPARE(grid.query(QRect(420, 180, 10, 10)), QVector<int>{1});
+    QCOMPARE(grid.query(QRect(-200, -200, 10, 10)), QVector<int>{2});
+    QVERIFY(grid.query(QRect(1000, 1000, 10, 10)).isEmpty());
+
+    grid.move(1, QRect(150, 150, 300, 50), QRect(1000, 1000, 50, 50));
+    QCOMPARE(grid.query(QRect(0, 0, 200, 200)), QVector<int>{0});
+    QCOMPARE(grid.query(QRect(1000, 1000, 10, 10)), QVector<int>{1});
+
+    grid.remove(0, QRect(0, 0, 50, 50));
+    QVERIFY(grid.query(QRect(0, 0, 200, 200)).isEmpty());
+}
+
+void PresentWindowsLayoutTest::testLayoutInArea_data()
+{
+    QTest::addColumn<int>("count");
+
+    QTest::newRow("2") << 2;
+    QTest::newRow("10") << 10;
+    QTest::newRow("40") << 40;
+    QTest::newRow("100") << 100;
+}
+
+void PresentWindowsLayoutTest::testLayoutInArea()
+{
+    QFETCH(int, count);
+    QVector<quintptr> keys;
+    QVector<QRect> geometries;
+    createWindows(count, &keys, &geometries);
+
+    NaturalLayoutSolver solver;
+    const QVector<QRect> targets = solver.solve(keys, geometries, parameters());
+    QCOMPARE(targets.count(), count);
+    for (const QRect &target : targets) {
+        QVERIFY(!target.isEmpty());
+        QVERIFY(s_area.contains(target));
+    }
+    QVERIFY(!hasOverlaps(targets));
+}
+
+void PresentWindowsLayoutTest::testRemoveWindows()
+{
+    // filtering windows out continues from the previous solution, which has no overlaps
+    QVector<quintptr> keys;
+    QVector<QRect> geometries;
+    createWindows(60, &keys, &geometries);
+
+    NaturalLayoutSolver solver;
+    QVERIFY(!hasOverlaps(solver.solve(keys, geometries, parameters())));
+    QVERIFY(solver.lastPassCount() > 1);
+
+    for (int i = keys.count() - 1; i >= 0; i -= 3) {
+        keys.remove(i);
+        geometries.remove(i);
+    }
+    const QVector<QRect> targets = solver.solve(keys, geometries, parameters());
+    QCOMPARE(solver.lastPassCount(), 1);
+    QCOMPARE(targets.count(), keys.count());
+    for (const QRect &target : targets) {
+        QVERIFY(s_area.contains(target));
+    }
+    QVERIFY(!hasOverlaps(targets));
+}
+
+void PresentWindowsLayoutTest::testAddWindow()
+{
+    QVector<quintptr> keys;
+    QVector<QRect> geometries;
+    createWindows(30, &keys, &geometries);
+
+    NaturalLayoutSolver solver;
+    solver.solve(keys, geometries, parameters());
+
+    keys.append(quintptr(1000));
+    geometries.append(QRect(600, 300, 800, 600));
+    const QVector<QRect> targets = solver.solve(keys, geometries, parameters());
+    QCOMPARE(targets.count(), keys.count());
+    for (const QRect &target : targets) {
+        QVERIFY(s_area.contains(target));
+    }
+
+    // after a reset the layout is solved from scratch again
+    solver.reset();
+    solver.solve(keys, geometries, parameters());
+    QVERIFY(solver.lastPassCount() > 1);
+}
+
+void PresentWindowsLayoutTest::benchmarkSolve_data()
+{
+    QTest::addColumn<int>("count");
+
+    QTest::newRow("10") << 10;
+    QTest::newRow("40") << 40;
+    QTest::newRow("80") << 80;
+    QTest::newRow("160") << 160;
+}
+
+void PresentWindowsLayoutTest::benchmarkSolve()
+{
+    QFETCH(int, count);
+    QVector<quintptr> keys;
+    QVector<QRect> geometries;
+    createWindows(count, &keys, &geometries);
+
+    QBENCHMARK {
+        NaturalLayoutSolver solver;
+        solver.solve(keys, geometries, parameters());
+    }
+}
+
+void PresentWindowsLayoutTest::benchmarkRelayout_data()
+{
+    benchmarkSolve_data();
+}
+
+void PresentWindowsLayoutTest::benchmarkRelayout()
+{
+    // typing into the filter removes windows from an existing layout
+    QFETCH(int, count);
+    QVector<quintptr> keys;
+    QVector<QRect> geometries;
+    createWindows(count, &keys, &geometries);
+    NaturalLayoutSolver solver;
+    solver.solve(keys, geometries, parameters());
+
+    QVector<quintptr> filteredKeys;
+    QVector<QRect> filteredGeometries;
+    for (int i = 0; i < keys.count(); i += 2) {
+        filteredKeys.append(keys[i]);
+        filteredGeometries.append(geometries[i]);
+    }
+
+    QBENCHMARK {
+        solver.solve(filteredKeys, filteredGeometries, parameters());
+    }
+}
+
+QTEST_GUILESS_MAIN(PresentWindowsLayoutTest)
+#include "test_presentwindows_layout.moc"
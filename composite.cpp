@@ -19,6 +19,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 *********************************************************************/
 #include "composite.h"
 
+#include "abstract_output.h"
 #include "dbusinterface.h"
 #include "x11client.h"
 #include "decorations/decoratedclient.h"
@@ -38,8 +39,6 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "workspace.h"
 #include "xcbutils.h"
 
-#include <kwingltexture.h>
-
 #include <KWayland/Server/surface_interface.h>
 
 #include <KGlobalAccel>
@@ -74,6 +73,18 @@ extern int screen_number;
 extern bool is_multihead;
 extern int currentRefreshRate();
 
+// The clock the kernel uses for page flip timestamps, libstdc++ implements it with CLOCK_MONOTONIC.
+static std::chrono::nanoseconds monotonicTime()
+{
+    return std::chrono::steady_clock::now().time_since_epoch();
+}
+
+// Frame callbacks carry a timestamp in milliseconds, which wraps around.
+static quint32 frameCallbackTime(std::chrono::nanoseconds time)
+{
+    return static_cast<quint32>(std::chrono::duration_cast<std::chrono::milliseconds>(time).count());
+}
+
 Compositor *Compositor::s_compositor = nullptr;
 Compositor *Compositor::self()
 {
@@ -133,8 +144,6 @@ Compositor::Compositor(QObject* workspace)
     connect(options, &Options::configChanged, this, &Compositor::configChanged);
     connect(options, &Options::animationSpeedChanged, this, &Compositor::configChanged);
 
-    m_monotonicClock.start();
-
     // 2 sec which should be enough to restart the compositor.
     static const int compositorLostMessageDelay = 2000;
 
@@ -148,6 +157,14 @@ Compositor::Compositor(QObject* workspace)
     connect(&m_unusedSupportPropertyTimer, &QTimer::timeout,
             this, &Compositor::deleteUnusedSupportProperties);
 
+    // Wayland windows which are not visible get frame callbacks only once per second.
+    static const int throttledFrameCallbackInterval = 1000;
+
+    m_throttledFrameCallbackTimer.setInterval(throttledFrameCallbackInterval);
+    m_throttledFrameCallbackTimer.setSingleShot(true);
+    connect(&m_throttledFrameCallbackTimer, &QTimer::timeout,
+            this, &Compositor::sendThrottledFrameCallbacks);
+
     // Delay the call to start by one event cycle.
     // The ctor of this class is invoked from the Workspace ctor, that means before
     // Workspace is completely constructed, so calling Workspace::self() would result
@@ -590,6 +607,11 @@ void Compositor::bufferSwapComplete()
     Q_ASSERT(m_bufferSwapPending);
     m_bufferSwapPending = false;
 
+    const auto outputs = kwinApp()->platform()->enabledOutputs();
+    for (AbstractOutput *output : outputs) {
+        m_lastPresentationTimestamp = std::max(m_lastPresentationTimestamp, output->lastPresentationTimestamp());
+    }
+
     emit bufferSwapCompleted();
 
     if (m_composeAtSwapCompletion) {
@@ -615,16 +637,30 @@ void Compositor::performCompositing()
         return;
     }
 
+    emit aboutToPaintFrame();
+
+    const std::chrono::nanoseconds now = monotonicTime();
+    m_presentationTime = now;
+    if (m_lastPresentationTimestamp.count() != 0 && vBlankInterval > 0) {
+        const std::chrono::nanoseconds interval(vBlankInterval);
+        const auto elapsed = now - m_lastPresentationTimestamp;
+        if (elapsed.count() >= 0) {
+            m_presentationTime = m_lastPresentationTimestamp + (elapsed / interval + 1) * interval;
+        }
+    }
+
     // Create a list of all windows in the stacking order
     ToplevelList windows = Workspace::self()->xStackingOrder();
     ToplevelList damaged;
 
-    // Reset the damage state of each window and fetch the damage region
-    // without waiting for a reply
+    // Reset the damage state of each window and collect the damage regions which
+    // have arrived since the last pass, without waiting for the others
+    bool damageRepliesPending = false;
     for (Toplevel *win : windows) {
-        if (win->resetAndFetchDamage()) {
+        if (win->resetAndCollectDamage()) {
             damaged << win;
         }
+        damageRepliesPending |= win->hasPendingDamageReplies();
     }
 
     if (damaged.count() > 0) {
@@ -641,21 +677,13 @@ void Compositor::performCompositing()
         windows.append(t);
     }
 
-    // Get the replies
-    for (Toplevel *win : damaged) {
-        // Discard the cached lanczos texture
-        if (win->effectWindow()) {
-            const QVariant texture = win->effectWindow()->data(LanczosCacheRole);
-            if (texture.isValid()) {
-                delete static_cast<GLTexture *>(texture.value<void*>());
-                win->effectWindow()->setData(LanczosCacheRole, QVariant());
-            }
-        }
-
-        win->getDamageRegionReply();
-    }
-
     if (repaints_region.isEmpty() && !windowRepaintsPending()) {
+        if (damageRepliesPending) {
+            // Nothing to paint yet, look again for the damage on the next tick
+            compositeTimer.stop();
+            setCompositeTimer();
+            return;
+        }
         m_scene->idle();
         m_timeSinceLastVBlank = fpsInterval - (options->vBlankTime() + 1); // means "start now"
         // Note: It would seem here we should undo suspended unredirect, but when scenes need
@@ -690,6 +718,7 @@ void Compositor::performCompositing()
     if (m_framesToTestForSafety > 0 && (m_scene->compositingType() & OpenGLCompositing)) {
         kwinApp()->platform()->createOpenGLSafePoint(Platform::OpenGLSafePoint::PreFrame);
     }
+    m_scene->resetVisibleWindows();
     m_timeSinceLastVBlank = m_scene->paint(repaints, windows);
     if (m_framesToTestForSafety > 0) {
         if (m_scene->compositingType() & OpenGLCompositing) {
@@ -703,12 +732,20 @@ void Compositor::performCompositing()
     }
 
     if (waylandServer()) {
-        const auto currentTime = static_cast<quint32>(m_monotonicClock.elapsed());
+        const quint32 currentTime = frameCallbackTime(m_presentationTime);
+        bool throttled = false;
         for (Toplevel *win : qAsConst(windows)) {
             if (auto surface = win->surface()) {
+                if (isFrameThrottled(win)) {
+                    throttled = true;
+                    continue;
+                }
                 surface->frameRendered(currentTime);
             }
         }
+        if (throttled && !m_throttledFrameCallbackTimer.isActive()) {
+            m_throttledFrameCallbackTimer.start();
+        }
     }
 
     // Stop here to ensure *we* cause the next repaint schedule - not some effect
@@ -726,6 +763,45 @@ void Compositor::performCompositing()
     }
 }
 
+bool Compositor::isFrameThrottled(Toplevel *window) const
+{
+    if (m_scene->isWindowVisible(window)) {
+        return false;
+    }
+    if (AbstractClient *client = qobject_cast<AbstractClient *>(window)) {
+        return client->rules()->checkThrottleFrames(true);
+    }
+    return true;
+}
+
+void Compositor::sendThrottledFrameCallbacks()
+{
+    if (m_state != State::On || !waylandServer()) {
+        return;
+    }
+    const quint32 currentTime = frameCallbackTime(monotonicTime());
+    bool throttled = false;
+    const ToplevelList windows = Workspace::self()->xStackingOrder();
+    for (Toplevel *win : windows) {
+        if (!win->readyForPainting()) {
+            continue;
+        }
+        if (waylandServer()->isScreenLocked() && !win->isLockScreen() && !win->isInputMethod()) {
+            continue;
+        }
+        auto surface = win->surface();
+        if (!surface || !isFrameThrottled(win)) {
+            continue;
+        }
+        surface->frameRendered(currentTime);
+        throttled = true;
+    }
+    // keep going as long as there are hidden windows
+    if (throttled) {
+        m_throttledFrameCallbackTimer.start();
+    }
+}
+
 template <class T>
 static bool repaintsPending(const QList<T*> &windows)
 {
@@ -23,11 +23,12 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <kwinglobals.h>
 
 #include <QObject>
-#include <QElapsedTimer>
 #include <QTimer>
 #include <QBasicTimer>
 #include <QRegion>
 
+#include <chrono>
+
 namespace KWin
 {
 class CompositorSelectionOwner;
@@ -72,6 +73,17 @@ public:
      */
     void bufferSwapComplete();
 
+    /**
+     * Returns the time at which the frame that is currently being painted is expected to be
+     * presented, in the CLOCK_MONOTONIC domain.
+     *
+     * If the platform reports when frames are presented, it's the first vertical blank after
+     * the start of the painting pass. Otherwise it's the start of the painting pass.
+     */
+    std::chrono::nanoseconds presentationTime() const {
+        return m_presentationTime;
+    }
+
     /**
      * Toggles compositing, that is if the Compositor is suspended it will be resumed
      * and if the Compositor is active it will be suspended.
@@ -115,6 +127,11 @@ Q_SIGNALS:
     void aboutToToggleCompositing();
     void sceneCreated();
     void bufferSwapCompleted();
+    /**
+     * Emitted at the start of each compositing pass, before the windows to paint are
+     * collected. Geometry changes made in response end up in the same frame.
+     */
+    void aboutToPaintFrame();
 
 protected:
     explicit Compositor(QObject *parent = nullptr);
@@ -148,6 +165,13 @@ private:
     void setCompositeTimer();
     bool windowRepaintsPending() const;
 
+    /**
+     * Whether @p window should only get frame callbacks at a low rate, because it wasn't
+     * visible in the last compositing pass and no window rule keeps it at the full rate.
+     */
+    bool isFrameThrottled(Toplevel *window) const;
+    void sendThrottledFrameCallbacks();
+
     void releaseCompositorSelection();
     void deleteUnusedSupportProperties();
 
@@ -158,6 +182,7 @@ private:
     QTimer m_releaseSelectionTimer;
     QList<xcb_atom_t> m_unusedSupportProperties;
     QTimer m_unusedSupportPropertyTimer;
+    QTimer m_throttledFrameCallbackTimer;
     qint64 vBlankInterval, fpsInterval;
     QRegion repaints_region;
 
@@ -169,7 +194,8 @@ private:
     bool m_composeAtSwapCompletion;
 
     int m_framesToTestForSafety = 3;
-    QElapsedTimer m_monotonicClock;
+    std::chrono::nanoseconds m_presentationTime = std::chrono::nanoseconds::zero();
+    std::chrono::nanoseconds m_lastPresentationTimestamp = std::chrono::nanoseconds::zero();
 };
 
 class KWIN_EXPORT WaylandCompositor : public Compositor
@@ -26,14 +26,89 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <KDecoration2/Decoration>
 #include <KDecoration2/DecoratedClient>
 
+#include <QCoreApplication>
 #include <QDebug>
+#include <QElapsedTimer>
 #include <QPainter>
+#include <QPointer>
+#include <QTimer>
 
 namespace KWin
 {
 namespace Decoration
 {
 
+// time in milliseconds spent painting decorations before returning to the event loop
+static const int s_renderBudget = 4;
+
+/**
+ * Paints the scheduled decoration areas between frames. Multiple requests of a renderer
+ * are coalesced, and if many decorations change at once, e.g. on a desktop switch, the
+ * painting is spread over several event loop iterations instead of stalling a frame.
+ */
+class RenderQueue : public QObject
+{
+public:
+    static RenderQueue *self();
+
+    void enqueue(Renderer *renderer);
+    void dequeue(Renderer *renderer);
+
+private:
+    explicit RenderQueue(QObject *parent);
+    void process();
+
+    QList<Renderer*> m_renderers;
+    QTimer *m_timer;
+};
+
+static QPointer<RenderQueue> s_renderQueue;
+
+RenderQueue *RenderQueue::self()
+{
+    if (!s_renderQueue) {
+        s_renderQueue = new RenderQueue(QCoreApplication::instance());
+    }
+    return s_renderQueue;
+}
+
+RenderQueue::RenderQueue(QObject *parent)
+    : QObject(parent)
+    , m_timer(new QTimer(this))
+{
+    m_timer->setSingleShot(true);
+    m_timer->setInterval(0);
+    connect(m_timer, &QTimer::timeout, this, &RenderQueue::process);
+}
+
+void RenderQueue::enqueue(Renderer *renderer)
+{
+    if (!m_renderers.contains(renderer)) {
+        m_renderers << renderer;
+    }
+    m_timer->start();
+}
+
+void RenderQueue::dequeue(Renderer *renderer)
+{
+    m_renderers.removeOne(renderer);
+}
+
+void RenderQueue::process()
+{
+    QElapsedTimer timer;
+    timer.start();
+    while (!m_renderers.isEmpty()) {
+        m_renderers.takeFirst()->prerender();
+        if (timer.elapsed() >= s_renderBudget) {
+            break;
+        }
+    }
+    if (!m_renderers.isEmpty()) {
+        m_timer->start();
+    }
+}
+
 Renderer::Renderer(DecoratedClientImpl *client)
     : QObject(client)
     , m_client(client)
@@ -41,6 +116,8 @@ Renderer::Renderer(DecoratedClientImpl *client)
 {
     auto markImageSizesDirty = [this]{
         m_imageSizesDirty = true;
+        // painted with the old layout, the areas get painted again when picked up
+        m_backImages.clear();
     };
     connect(client->client(), &AbstractClient::screenScaleChanged, this, markImageSizesDirty);
     connect(client->decoration(), &KDecoration2::Decoration::bordersChanged, this, markImageSizesDirty);
@@ -48,24 +125,71 @@ Renderer::Renderer(DecoratedClientImpl *client)
     connect(client->decoratedClient(), &KDecoration2::DecoratedClient::heightChanged, this, markImageSizesDirty);
 }
 
-Renderer::~Renderer() = default;
+Renderer::~Renderer()
+{
+    if (s_renderQueue) {
+        s_renderQueue->dequeue(this);
+    }
+}
 
 void Renderer::schedule(const QRect &rect)
 {
     m_scheduled = m_scheduled.united(rect);
-    emit renderScheduled(rect);
+    RenderQueue::self()->enqueue(this);
 }
 
 QRegion Renderer::getScheduled()
 {
-    QRegion region = m_scheduled;
-    m_scheduled = QRegion();
+    QRegion region = m_rendered;
+    m_rendered = QRegion();
+    m_frontImages = m_backImages;
+    m_backImages.clear();
     return region;
 }
 
+void Renderer::prerender()
+{
+    if (!m_client || m_scheduled.isEmpty()) {
+        return;
+    }
+    const QRect scheduled = m_scheduled.boundingRect();
+    m_rendered |= m_scheduled;
+    m_scheduled = QRegion();
+    // An earlier result might not have been picked up yet. The parts are painted on their
+    // own, the bounding rect of the borders would cover the whole window.
+    QRect left, top, right, bottom;
+    client()->client()->layoutDecorationRects(left, top, right, bottom);
+    m_backImages.clear();
+    for (const QRect &part : {left, top, right, bottom}) {
+        const QRect rect = (m_rendered & part).boundingRect();
+        if (!rect.isEmpty()) {
+            m_backImages.append({rect, paintImage(rect)});
+        }
+    }
+    emit renderScheduled(scheduled);
+}
+
 QImage Renderer::renderToImage(const QRect &geo)
 {
     Q_ASSERT(m_client);
+    const qreal dpr = client()->client()->screenScale();
+    // with fractional scales the parts wouldn't line up exactly with a direct paint
+    if (dpr == qRound(dpr)) {
+        for (const PartImage &part : qAsConst(m_frontImages)) {
+            if (part.image.devicePixelRatio() != dpr || !part.rect.contains(geo)) {
+                continue;
+            }
+            const QRect source((geo.topLeft() - part.rect.topLeft()) * dpr, geo.size() * dpr);
+            QImage image = part.image.copy(source);
+            image.setDevicePixelRatio(dpr);
+            return image;
+        }
+    }
+    return paintImage(geo);
+}
+
+QImage Renderer::paintImage(const QRect &geo)
+{
     auto dpr = client()->client()->screenScale();
     QImage image(geo.width() * dpr, geo.height() * dpr, QImage::Format_ARGB32_Premultiplied);
     image.setDevicePixelRatio(dpr);
@@ -80,8 +204,14 @@ QImage Renderer::renderToImage(const QRect &geo)
 
 void Renderer::reparent(Deleted *deleted)
 {
+    if (s_renderQueue) {
+        s_renderQueue->dequeue(this);
+    }
     setParent(deleted);
     m_client = nullptr;
+    m_scheduled = QRegion();
+    m_backImages.clear();
+    m_frontImages.clear();
 }
 
 }
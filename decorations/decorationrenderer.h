@@ -20,8 +20,10 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #ifndef KWIN_DECORATION_RENDERER_H
 #define KWIN_DECORATION_RENDERER_H
 
+#include <QImage>
 #include <QObject>
 #include <QRegion>
+#include <QVector>
 
 #include <kwin_export.h>
 
@@ -34,6 +36,7 @@ namespace Decoration
 {
 
 class DecoratedClientImpl;
+class RenderQueue;
 
 class KWIN_EXPORT Renderer : public QObject
 {
@@ -57,6 +60,9 @@ protected:
     explicit Renderer(DecoratedClientImpl *client);
     /**
      * @returns the scheduled paint region and resets
+     *
+     * Scheduled areas are painted ahead of time between frames, they are only returned
+     * once renderToImage() can serve them without painting.
      */
     QRegion getScheduled();
 
@@ -75,8 +81,23 @@ protected:
     QImage renderToImage(const QRect &geo);
 
 private:
+    friend class RenderQueue;
+    void prerender();
+    QImage paintImage(const QRect &geo);
+
     DecoratedClientImpl *m_client;
+    // waiting to be painted by the render queue
     QRegion m_scheduled;
+    struct PartImage {
+        QRect rect;
+        QImage image;
+    };
+    // painted into m_backImages, one per decoration part, waiting to be picked up by
+    // getScheduled()
+    QRegion m_rendered;
+    QVector<PartImage> m_backImages;
+    // picked up by the last getScheduled(), served by renderToImage()
+    QVector<PartImage> m_frontImages;
     bool m_imageSizesDirty;
 };
 
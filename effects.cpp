@@ -61,6 +61,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "decorations/decorationbridge.h"
 #include <KDecoration2/DecorationSettings>
 
+#include <algorithm>
+
 namespace KWin
 {
 //---------------------
@@ -140,9 +142,6 @@ EffectsHandlerImpl::EffectsHandlerImpl(Compositor *compositor, Scene *scene)
     new EffectsAdaptor(this);
     QDBusConnection dbus = QDBusConnection::sessionBus();
     dbus.registerObject(QStringLiteral("/Effects"), this);
-    // init is important, otherwise causes crashes when quads are build before the first painting pass start
-    m_currentBuildQuadsIterator = m_activeEffects.constEnd();
-
     Workspace *ws = Workspace::self();
     VirtualDesktopManager *vds = VirtualDesktopManager::self();
     connect(ws, &Workspace::showingDesktopChanged,
@@ -488,19 +487,30 @@ void EffectsHandlerImpl::drawWindow(EffectWindow* w, int mask, QRegion region, W
 
 void EffectsHandlerImpl::buildQuads(EffectWindow* w, WindowQuadList& quadList)
 {
-    static bool initIterator = true;
+    // The scene may build quads of several windows at once, each thread walks the chain on its own
+    static thread_local bool initIterator = true;
+    static thread_local EffectsIterator currentBuildQuadsIterator;
     if (initIterator) {
-        m_currentBuildQuadsIterator = m_activeEffects.constBegin();
+        currentBuildQuadsIterator = m_activeEffects.constBegin();
         initIterator = false;
     }
-    if (m_currentBuildQuadsIterator != m_activeEffects.constEnd()) {
-        (*m_currentBuildQuadsIterator++)->buildQuads(w, quadList);
-        --m_currentBuildQuadsIterator;
+    if (currentBuildQuadsIterator != m_activeEffects.constEnd()) {
+        (*currentBuildQuadsIterator++)->buildQuads(w, quadList);
+        --currentBuildQuadsIterator;
     }
-    if (m_currentBuildQuadsIterator == m_activeEffects.constBegin())
+    if (currentBuildQuadsIterator == m_activeEffects.constBegin())
         initIterator = true;
 }
 
+bool EffectsHandlerImpl::isBuildQuadsThreadSafe() const
+{
+    return std::all_of(m_activeEffects.constBegin(), m_activeEffects.constEnd(),
+        [](const Effect *effect) {
+            return effect->isBuildQuadsThreadSafe();
+        }
+    );
+}
+
 bool EffectsHandlerImpl::hasDecorationShadows() const
 {
     return false;
@@ -1710,6 +1720,11 @@ void EffectsHandlerImpl::renderEffectQuickView(EffectQuickView *w) const
     scene()->paintEffectQuickView(w);
 }
 
+std::chrono::nanoseconds EffectsHandlerImpl::presentationTime() const
+{
+    return m_compositor->presentationTime();
+}
+
 //****************************************
 // EffectWindowImpl
 //****************************************
@@ -1734,11 +1749,6 @@ EffectWindowImpl::EffectWindowImpl(Toplevel *toplevel)
 
 EffectWindowImpl::~EffectWindowImpl()
 {
-    QVariant cachedTextureVariant = data(LanczosCacheRole);
-    if (cachedTextureVariant.isValid()) {
-        GLTexture *cachedTexture = static_cast< GLTexture*>(cachedTextureVariant.value<void*>());
-        delete cachedTexture;
-    }
 }
 
 bool EffectWindowImpl::isPaintingEnabled()
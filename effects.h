@@ -90,6 +90,11 @@ public:
     void drawWindow(EffectWindow* w, int mask, QRegion region, WindowPaintData& data) override;
 
     void buildQuads(EffectWindow* w, WindowQuadList& quadList) override;
+    /**
+     * Whether all effects of the current painting pass may have buildQuads() invoked
+     * from worker threads.
+     */
+    bool isBuildQuadsThreadSafe() const;
 
     void activateWindow(EffectWindow* c) override;
     EffectWindow* activeWindow() const override;
@@ -275,6 +280,8 @@ public:
 
     void renderEffectQuickView(EffectQuickView *effectQuickView) const override;
 
+    std::chrono::nanoseconds presentationTime() const override;
+
 public Q_SLOTS:
     void slotCurrentTabAboutToChange(EffectWindow* from, EffectWindow* to);
     void slotTabAdded(EffectWindow* from, EffectWindow* to);
@@ -353,7 +360,6 @@ private:
     EffectsIterator m_currentPaintWindowIterator;
     EffectsIterator m_currentPaintEffectFrameIterator;
     EffectsIterator m_currentPaintScreenIterator;
-    EffectsIterator m_currentBuildQuadsIterator;
     typedef QHash< QByteArray, QList< Effect*> > PropertyEffectMap;
     PropertyEffectMap m_propertiesForEffects;
     QHash<QByteArray, qulonglong> m_managedProperties;
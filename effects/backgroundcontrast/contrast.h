@@ -63,6 +63,9 @@ public:
     int requestedEffectChainPosition() const override {
         return 76;
     }
+    bool isBuildQuadsThreadSafe() const override {
+        return true;
+    }
 
     bool eventFilter(QObject *watched, QEvent *event) override;
 
@@ -66,6 +66,9 @@ public:
     int requestedEffectChainPosition() const override {
         return 75;
     }
+    bool isBuildQuadsThreadSafe() const override {
+        return true;
+    }
 
     bool eventFilter(QObject *watched, QEvent *event) override;
 
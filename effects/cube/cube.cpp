@@ -275,15 +275,19 @@ void CubeEffect::slotCubeCapLoaded()
     QImage img = watcher->result();
     if (!img.isNull()) {
         effects->makeOpenGLContextCurrent();
-        capTexture = new GLTexture(img);
-        capTexture->setFilter(GL_LINEAR);
-        if (!GLPlatform::instance()->isGLES()) {
-            capTexture->setWrapMode(GL_CLAMP_TO_BORDER);
-        }
-        // need to recreate the VBO for the cube cap
-        delete m_cubeCapBuffer;
-        m_cubeCapBuffer = nullptr;
-        effects->addRepaintFull();
+        GLTextureUploader::instance()->upload(img, this, [this](GLTexture *texture) {
+            effects->makeOpenGLContextCurrent();
+            delete capTexture;
+            capTexture = texture;
+            capTexture->setFilter(GL_LINEAR);
+            if (!GLPlatform::instance()->isGLES()) {
+                capTexture->setWrapMode(GL_CLAMP_TO_BORDER);
+            }
+            // need to recreate the VBO for the cube cap
+            delete m_cubeCapBuffer;
+            m_cubeCapBuffer = nullptr;
+            effects->addRepaintFull();
+        });
     }
     watcher->deleteLater();
 }
@@ -303,8 +307,12 @@ void CubeEffect::slotWallPaperLoaded()
     QImage img = watcher->result();
     if (!img.isNull()) {
         effects->makeOpenGLContextCurrent();
-        wallpaper = new GLTexture(img);
-        effects->addRepaintFull();
+        GLTextureUploader::instance()->upload(img, this, [this](GLTexture *texture) {
+            effects->makeOpenGLContextCurrent();
+            delete wallpaper;
+            wallpaper = texture;
+            effects->addRepaintFull();
+        });
     }
     watcher->deleteLater();
 }
@@ -39,6 +39,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <QGraphicsObject>
 #include <QTimer>
 #include <QElapsedTimer>
+#include <QFutureWatcher>
+#include <QtConcurrentRun>
 #include <QVector2D>
 #include <QVector4D>
 
@@ -118,6 +120,8 @@ PresentWindowsEffect::PresentWindowsEffect()
 
 PresentWindowsEffect::~PresentWindowsEffect()
 {
+    resetNaturalLayouts();
+    qDeleteAll(m_naturalLayouts);
     delete m_filterFrame;
     delete m_closeView;
 }
@@ -985,6 +989,11 @@ void PresentWindowsEffect::rearrangeWindows()
         calculateWindowTransformations(windows, screen, m_motionManager);
     }
 
+    updateTextFrames();
+}
+
+void PresentWindowsEffect::updateTextFrames()
+{
     // Resize text frames if required
     QFontMetrics* metrics = nullptr; // All fonts are the same
     foreach (EffectWindow * w, m_motionManager.managedWindows()) {
@@ -1016,6 +1025,9 @@ void PresentWindowsEffect::calculateWindowTransformations(EffectWindowList windo
         m_windowData.clear();
 }
 
+// Number of windows on a screen from which on the natural layout is solved on a worker thread
+static const int s_asyncNaturalLayoutThreshold = 32;
+
 static inline int distance(QPoint &pos1, QPoint &pos2)
 {
     const int xdiff = pos1.x() - pos2.x();
@@ -1282,241 +1294,95 @@ void PresentWindowsEffect::calculateWindowTransformationsNatural(EffectWindowLis
     QRect area = effects->clientArea(ScreenArea, screen, effects->currentDesktop());
     if (m_showPanel)   // reserve space for the panel
         area = effects->clientArea(MaximizeArea, screen, effects->currentDesktop());
-    QRect bounds = area;
-    int direction = 0;
-    QHash<EffectWindow*, QRect> targets;
-    QHash<EffectWindow*, int> directions;
-    foreach (EffectWindow * w, windowlist) {
-        bounds = bounds.united(w->geometry());
-        targets[w] = w->geometry();
-        // Reuse the unused "slot" as a preferred direction attribute. This is used when the window
-        // is on the edge of the screen to try to use as much screen real estate as possible.
-        directions[w] = direction;
-        direction++;
-        if (direction == 4)
-            direction = 0;
-    }
-
-    // Iterate over all windows, if two overlap push them apart _slightly_ as we try to
-    // brute-force the most optimal positions over many iterations.
-    bool overlap;
-    do {
-        overlap = false;
-        foreach (EffectWindow * w, windowlist) {
-            QRect *target_w = &targets[w];
-            foreach (EffectWindow * e, windowlist) {
-                if (w == e)
-                    continue;
-                QRect *target_e = &targets[e];
-                if (target_w->adjusted(-5, -5, 5, 5).intersects(target_e->adjusted(-5, -5, 5, 5))) {
-                    overlap = true;
-
-                    // Determine pushing direction
-                    QPoint diff(target_e->center() - target_w->center());
-                    // Prevent dividing by zero and non-movement
-                    if (diff.x() == 0 && diff.y() == 0)
-                        diff.setX(1);
-                    // Try to keep screen aspect ratio
-                    //if (bounds.height() / bounds.width() > area.height() / area.width())
-                    //    diff.setY(diff.y() / 2);
-                    //else
-                    //    diff.setX(diff.x() / 2);
-                    // Approximate a vector of between 10px and 20px in magnitude in the same direction
-                    diff *= m_accuracy / double(diff.manhattanLength());
-                    // Move both windows apart
-                    target_w->translate(-diff);
-                    target_e->translate(diff);
-
-                    // Try to keep the bounding rect the same aspect as the screen so that more
-                    // screen real estate is utilised. We do this by splitting the screen into nine
-                    // equal sections, if the window center is in any of the corner sections pull the
-                    // window towards the outer corner. If it is in any of the other edge sections
-                    // alternate between each corner on that edge. We don't want to determine it
-                    // randomly as it will not produce consistant locations when using the filter.
-                    // Only move one window so we don't cause large amounts of unnecessary zooming
-                    // in some situations. We need to do this even when expanding later just in case
-                    // all windows are the same size.
-                    // (We are using an old bounding rect for this, hopefully it doesn't matter)
-                    int xSection = (target_w->x() - bounds.x()) / (bounds.width() / 3);
-                    int ySection = (target_w->y() - bounds.y()) / (bounds.height() / 3);
-                    diff = QPoint(0, 0);
-                    if (xSection != 1 || ySection != 1) { // Remove this if you want the center to pull as well
-                        if (xSection == 1)
-                            xSection = (directions[w] / 2 ? 2 : 0);
-                        if (ySection == 1)
-                            ySection = (directions[w] % 2 ? 2 : 0);
-                    }
-                    if (xSection == 0 && ySection == 0)
-                        diff = QPoint(bounds.topLeft() - target_w->center());
-                    if (xSection == 2 && ySection == 0)
-                        diff = QPoint(bounds.topRight() - target_w->center());
-                    if (xSection == 2 && ySection == 2)
-                        diff = QPoint(bounds.bottomRight() - target_w->center());
-                    if (xSection == 0 && ySection == 2)
-                        diff = QPoint(bounds.bottomLeft() - target_w->center());
-                    if (diff.x() != 0 || diff.y() != 0) {
-                        diff *= m_accuracy / double(diff.manhattanLength());
-                        target_w->translate(diff);
-                    }
 
-                    // Update bounding rect
-                    bounds = bounds.united(*target_w);
-                    bounds = bounds.united(*target_e);
-                }
-            }
-        }
-    } while (overlap);
-
-    // Work out scaling by getting the most top-left and most bottom-right window coords.
-    // The 20's and 10's are so that the windows don't touch the edge of the screen.
-    double scale;
-    if (bounds == area)
-        scale = 1.0; // Don't add borders to the screen
-    else if (area.width() / double(bounds.width()) < area.height() / double(bounds.height()))
-        scale = (area.width() - 20) / double(bounds.width());
-    else
-        scale = (area.height() - 20) / double(bounds.height());
-    // Make bounding rect fill the screen size for later steps
-    bounds = QRect(
-                 bounds.x() - (area.width() - 20 - bounds.width() * scale) / 2 - 10 / scale,
-                 bounds.y() - (area.height() - 20 - bounds.height() * scale) / 2 - 10 / scale,
-                 area.width() / scale,
-                 area.height() / scale
-             );
-
-    // Move all windows back onto the screen and set their scale
-    QHash<EffectWindow*, QRect>::iterator target = targets.begin();
-    while (target != targets.end()) {
-        target->setRect((target->x() - bounds.x()) * scale + area.x(),
-                        (target->y() - bounds.y()) * scale + area.y(),
-                        target->width() * scale,
-                        target->height() * scale
-                        );
-        ++target;
-    }
-
-    // Try to fill the gaps by enlarging windows if they have the space
-    if (m_fillGaps) {
-        // Don't expand onto or over the border
-        QRegion borderRegion(area.adjusted(-200, -200, 200, 200));
-        borderRegion ^= area.adjusted(10 / scale, 10 / scale, -10 / scale, -10 / scale);
-
-        bool moved;
-        do {
-            moved = false;
-            foreach (EffectWindow * w, windowlist) {
-                QRect oldRect;
-                QRect *target = &targets[w];
-                // This may cause some slight distortion if the windows are enlarged a large amount
-                int widthDiff = m_accuracy;
-                int heightDiff = heightForWidth(w, target->width() + widthDiff) - target->height();
-                int xDiff = widthDiff / 2;  // Also move a bit in the direction of the enlarge, allows the
-                int yDiff = heightDiff / 2; // center windows to be enlarged if there is gaps on the side.
-
-                // heightDiff (and yDiff) will be re-computed after each successfull enlargement attempt
-                // so that the error introduced in the window's aspect ratio is minimized
-
-                // Attempt enlarging to the top-right
-                oldRect = *target;
-                target->setRect(target->x() + xDiff,
-                                target->y() - yDiff - heightDiff,
-                                target->width() + widthDiff,
-                                target->height() + heightDiff
-                                );
-                if (isOverlappingAny(w, targets, borderRegion))
-                    *target = oldRect;
-                else {
-                    moved = true;
-                    heightDiff = heightForWidth(w, target->width() + widthDiff) - target->height();
-                    yDiff = heightDiff / 2;
-                }
+    NaturalLayoutSolver::Parameters parameters;
+    parameters.area = area;
+    parameters.accuracy = m_accuracy;
+    parameters.fillGaps = m_fillGaps;
+    QVector<quintptr> keys;
+    QVector<QRect> geometries;
+    keys.reserve(windowlist.count());
+    geometries.reserve(windowlist.count());
+    foreach (EffectWindow * w, windowlist) {
+        keys.append(quintptr(w));
+        geometries.append(w->geometry());
+    }
 
-                // Attempt enlarging to the bottom-right
-                oldRect = *target;
-                target->setRect(
-                                 target->x() + xDiff,
-                                 target->y() + yDiff,
-                                 target->width() + widthDiff,
-                                 target->height() + heightDiff
-                             );
-                if (isOverlappingAny(w, targets, borderRegion))
-                    *target = oldRect;
-                else {
-                    moved = true;
-                    heightDiff = heightForWidth(w, target->width() + widthDiff) - target->height();
-                    yDiff = heightDiff / 2;
-                }
+    if (&motionManager != &m_motionManager) {
+        // Called externally, there is no previous solution to continue from
+        NaturalLayoutSolver solver;
+        const QVector<QRect> targets = solver.solve(keys, geometries, parameters);
+        for (int i = 0; i < windowlist.count(); ++i)
+            motionManager.moveWindow(windowlist[i], targets[i]);
+        return;
+    }
 
-                // Attempt enlarging to the bottom-left
-                oldRect = *target;
-                target->setRect(
-                                 target->x() - xDiff - widthDiff,
-                                 target->y() + yDiff,
-                                 target->width() + widthDiff,
-                                 target->height() + heightDiff
-                             );
-                if (isOverlappingAny(w, targets, borderRegion))
-                    *target = oldRect;
-                else {
-                    moved = true;
-                    heightDiff = heightForWidth(w, target->width() + widthDiff) - target->height();
-                    yDiff = heightDiff / 2;
-                }
+    NaturalLayout *&layout = m_naturalLayouts[screen];
+    if (!layout)
+        layout = new NaturalLayout;
+    if (layout->watcher) {
+        // Still solving for an older set of windows, start over once that is done
+        layout->pending = true;
+        return;
+    }
 
-                // Attempt enlarging to the top-left
-                oldRect = *target;
-                target->setRect(
-                                 target->x() - xDiff - widthDiff,
-                                 target->y() - yDiff - heightDiff,
-                                 target->width() + widthDiff,
-                                 target->height() + heightDiff
-                             );
-                if (isOverlappingAny(w, targets, borderRegion))
-                    *target = oldRect;
-                else
-                    moved = true;
-            }
-        } while (moved);
-
-        // The expanding code above can actually enlarge windows over 1.0/2.0 scale, we don't like this
-        // We can't add this to the loop above as it would cause a never-ending loop so we have to make
-        // do with the less-than-optimal space usage with using this method.
-        foreach (EffectWindow * w, windowlist) {
-            QRect *target = &targets[w];
-            double scale = target->width() / double(w->width());
-            if (scale > 2.0 || (scale > 1.0 && (w->width() > 300 || w->height() > 300))) {
-                scale = (w->width() > 300 || w->height() > 300) ? 1.0 : 2.0;
-                target->setRect(
-                                 target->center().x() - int(w->width() * scale) / 2,
-                                 target->center().y() - int(w->height() * scale) / 2,
-                                 w->width() * scale,
-                                 w->height() * scale);
-            }
-        }
+    if (windowlist.count() < s_asyncNaturalLayoutThreshold) {
+        const QVector<QRect> targets = layout->solver.solve(keys, geometries, parameters);
+        for (int i = 0; i < windowlist.count(); ++i)
+            motionManager.moveWindow(windowlist[i], targets[i]);
+        return;
     }
 
-    // Notify the motion manager of the targets
-    foreach (EffectWindow * w, windowlist)
-        motionManager.moveWindow(w, targets.value(w));
+    // Solving the layout for many windows takes a while, do it on a worker thread so that
+    // the effect doesn't block the compositor in the meantime
+    layout->windows = windowlist;
+    layout->watcher = new QFutureWatcher<QVector<QRect>>(this);
+    connect(layout->watcher, &QFutureWatcherBase::finished, this, [this, layout] {
+        finishNaturalLayout(layout);
+    });
+    NaturalLayoutSolver *solver = &layout->solver;
+    layout->watcher->setFuture(QtConcurrent::run([solver, keys, geometries, parameters] {
+        return solver->solve(keys, geometries, parameters);
+    }));
 }
 
+void PresentWindowsEffect::finishNaturalLayout(NaturalLayout *layout)
+{
+    const QVector<QRect> targets = layout->watcher->result();
+    const EffectWindowList windows = layout->windows;
+    layout->watcher->deleteLater();
+    layout->watcher = nullptr;
+    layout->windows.clear();
 
-bool PresentWindowsEffect::isOverlappingAny(EffectWindow *w, const QHash<EffectWindow*, QRect> &targets, const QRegion &border)
+    if (!m_activated)
+        return;
+    if (layout->pending) {
+        layout->pending = false;
+        rearrangeWindows();
+        return;
+    }
+    for (int i = 0; i < windows.count(); ++i) {
+        // windows might have been deleted while solving
+        if (m_motionManager.isManaging(windows[i]))
+            m_motionManager.moveWindow(windows[i], targets[i]);
+    }
+    updateTextFrames();
+    effects->addRepaintFull();
+}
+
+void PresentWindowsEffect::resetNaturalLayouts()
 {
-    QHash<EffectWindow*, QRect>::const_iterator winTarget = targets.find(w);
-    if (winTarget == targets.constEnd())
-        return false;
-    if (border.intersects(*winTarget))
-        return true;
-    // Is there a better way to do this?
-    QHash<EffectWindow*, QRect>::const_iterator target;
-    for (target = targets.constBegin(); target != targets.constEnd(); ++target) {
-        if (target == winTarget)
-            continue;
-        if (winTarget->adjusted(-5, -5, 5, 5).intersects(target->adjusted(-5, -5, 5, 5)))
-            return true;
+    foreach (NaturalLayout * layout, m_naturalLayouts) {
+        if (layout->watcher) {
+            // the solver can't be touched while a worker thread uses it
+            layout->watcher->waitForFinished();
+            delete layout->watcher;
+            layout->watcher = nullptr;
+        }
+        layout->solver.reset();
+        layout->windows.clear();
+        layout->pending = false;
     }
-    return false;
 }
 
 //-----------------------------------------------------------------------------
@@ -1536,6 +1402,7 @@ void PresentWindowsEffect::setActive(bool active)
         m_decalOpacity = 0.0;
         m_highlightedWindow = nullptr;
         m_windowFilter.clear();
+        resetNaturalLayouts();
 
         if (!(m_doNotCloseWindows || m_closeView)) {
             m_closeView = new CloseWindowView();
@@ -22,6 +22,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #ifndef KWIN_PRESENTWINDOWS_H
 #define KWIN_PRESENTWINDOWS_H
 
+#include "presentwindows_layout.h"
 #include "presentwindows_proxy.h"
 
 #include <kwineffects.h>
@@ -29,6 +30,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 class QMouseEvent;
 class QElapsedTimer;
 class QQuickView;
+template <typename T> class QFutureWatcher;
 
 namespace KWin
 {
@@ -104,6 +106,15 @@ private:
         int columns;
         int rows;
     };
+    // The natural layout of one screen, kept so that relayouts continue from the previous solution
+    struct NaturalLayout {
+        NaturalLayoutSolver solver;
+        // set while the layout is solved on a worker thread
+        QFutureWatcher<QVector<QRect>> *watcher = nullptr;
+        EffectWindowList windows;
+        // the windows changed while solving, the result is outdated
+        bool pending = false;
+    };
 
 public:
     PresentWindowsEffect();
@@ -255,7 +266,9 @@ protected:
     inline int heightForWidth(EffectWindow *w, int width) {
         return int((width / double(w->width())) * w->height());
     }
-    bool isOverlappingAny(EffectWindow *w, const QHash<EffectWindow*, QRect> &targets, const QRegion &border);
+    void finishNaturalLayout(NaturalLayout *layout);
+    void resetNaturalLayouts();
+    void updateTextFrames();
 
     // Filter box
     void updateFilterFrame();
@@ -309,6 +322,7 @@ private:
 
     // Grid layout info
     QList<GridSize> m_gridSizes;
+    QHash<int, NaturalLayout*> m_naturalLayouts;
 
     // Filter box
     EffectFrame* m_filterFrame;
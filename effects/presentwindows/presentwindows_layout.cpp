@@ -0,0 +1,363 @@
+/********************************************************************
+ KWin - the KDE window manager
+ This file is part of the KDE project.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*********************************************************************/
+#include "presentwindows_layout.h"
+
+#include <QRegion>
+
+#include <algorithm>
+
+namespace KWin
+{
+
+LayoutGrid::LayoutGrid(int cellSize)
+    : m_cellSize(qMax(1, cellSize))
+{
+}
+
+QRect LayoutGrid::cellRange(const QRect &rect) const
+{
+    // floor division, windows may be pushed to negative coordinates
+    auto cell = [this](int coordinate) {
+        return coordinate >= 0 ? coordinate / m_cellSize : -((-coordinate - 1) / m_cellSize) - 1;
+    };
+    return QRect(QPoint(cell(rect.left()), cell(rect.top())),
+                 QPoint(cell(rect.right()), cell(rect.bottom())));
+}
+
+void LayoutGrid::insert(int index, const QRect &rect)
+{
+    const QRect range = cellRange(rect);
+    for (int column = range.left(); column <= range.right(); ++column) {
+        for (int row = range.top(); row <= range.bottom(); ++row) {
+            m_cells[key(column, row)].append(index);
+        }
+    }
+}
+
+void LayoutGrid::remove(int index, const QRect &rect)
+{
+    const QRect range = cellRange(rect);
+    for (int column = range.left(); column <= range.right(); ++column) {
+        for (int row = range.top(); row <= range.bottom(); ++row) {
+            auto it = m_cells.find(key(column, row));
+            if (it == m_cells.end()) {
+                continue;
+            }
+            it->removeOne(index);
+            if (it->isEmpty()) {
+                m_cells.erase(it);
+            }
+        }
+    }
+}
+
+void LayoutGrid::move(int index, const QRect &oldRect, const QRect &newRect)
+{
+    if (cellRange(oldRect) == cellRange(newRect)) {
+        return;
+    }
+    remove(index, oldRect);
+    insert(index, newRect);
+}
+
+QVector<int> LayoutGrid::query(const QRect &rect) const
+{
+    QVector<int> result;
+    const QRect range = cellRange(rect);
+    for (int column = range.left(); column <= range.right(); ++column) {
+        for (int row = range.top(); row <= range.bottom(); ++row) {
+            auto it = m_cells.constFind(key(column, row));
+            if (it != m_cells.constEnd()) {
+                result += *it;
+            }
+        }
+    }
+    std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+    return result;
+}
+
+// Windows closer to each other than this are considered overlapping
+static inline QRect withMargin(const QRect &rect)
+{
+    return rect.adjusted(-5, -5, 5, 5);
+}
+
+static inline int heightForWidth(const QRect &geometry, int width)
+{
+    return int((width / double(geometry.width())) * geometry.height());
+}
+
+// A cell about the size of an average window keeps the number of cells per window
+// and the number of windows per cell low.
+static int cellSizeFor(const QVector<QRect> &rects)
+{
+    if (rects.isEmpty()) {
+        return 1;
+    }
+    qint64 sum = 0;
+    for (const QRect &rect : rects) {
+        sum += qMax(rect.width(), rect.height());
+    }
+    return qMax<qint64>(16, sum / rects.count());
+}
+
+void NaturalLayoutSolver::reset()
+{
+    m_previous.clear();
+    m_previousArea = QRect();
+}
+
+QVector<QRect> NaturalLayoutSolver::solve(const QVector<quintptr> &keys, const QVector<QRect> &geometries,
+                                          const Parameters &parameters)
+{
+    Q_ASSERT(keys.count() == geometries.count());
+    const QRect area = parameters.area;
+    const int accuracy = parameters.accuracy;
+    const int count = geometries.count();
+    if (area != m_previousArea) {
+        reset();
+        m_previousArea = area;
+    }
+
+    QRect bounds = area;
+    QVector<QRect> targets(count);
+    for (int i = 0; i < count; ++i) {
+        // continue from the previous solution if the window didn't change in the meantime
+        auto previous = m_previous.constFind(keys[i]);
+        if (previous != m_previous.constEnd() && previous->geometry == geometries[i]) {
+            targets[i] = previous->spread;
+        } else {
+            targets[i] = geometries[i];
+        }
+        bounds = bounds.united(targets[i]);
+    }
+
+    // Iterate over all windows, if two overlap push them apart _slightly_ as we try to
+    // brute-force the most optimal positions over many iterations.
+    LayoutGrid grid(cellSizeFor(targets));
+    for (int i = 0; i < count; ++i) {
+        grid.insert(i, withMargin(targets[i]));
+    }
+    m_lastPassCount = 0;
+    bool overlap;
+    do {
+        overlap = false;
+        ++m_lastPassCount;
+        for (int w = 0; w < count; ++w) {
+            const QVector<int> candidates = grid.query(withMargin(targets[w]));
+            for (int e : candidates) {
+                if (w == e) {
+                    continue;
+                }
+                QRect *target_w = &targets[w];
+                QRect *target_e = &targets[e];
+                if (!withMargin(*target_w).intersects(withMargin(*target_e))) {
+                    continue;
+                }
+                overlap = true;
+                const QRect oldTarget_w = *target_w;
+                const QRect oldTarget_e = *target_e;
+
+                // Determine pushing direction
+                QPoint diff(target_e->center() - target_w->center());
+                // Prevent dividing by zero and non-movement
+                if (diff.x() == 0 && diff.y() == 0)
+                    diff.setX(1);
+                // Approximate a vector of between 10px and 20px in magnitude in the same direction
+                diff *= accuracy / double(diff.manhattanLength());
+                // Move both windows apart
+                target_w->translate(-diff);
+                target_e->translate(diff);
+
+                // Try to keep the bounding rect the same aspect as the screen so that more
+                // screen real estate is utilised. We do this by splitting the screen into nine
+                // equal sections, if the window center is in any of the corner sections pull the
+                // window towards the outer corner. If it is in any of the other edge sections
+                // alternate between each corner on that edge. We don't want to determine it
+                // randomly as it will not produce consistant locations when using the filter.
+                // Only move one window so we don't cause large amounts of unnecessary zooming
+                // in some situations. We need to do this even when expanding later just in case
+                // all windows are the same size.
+                // (We are using an old bounding rect for this, hopefully it doesn't matter)
+                // The window's position in the list is used as its preferred direction.
+                const int direction = w % 4;
+                int xSection = (target_w->x() - bounds.x()) / (bounds.width() / 3);
+                int ySection = (target_w->y() - bounds.y()) / (bounds.height() / 3);
+                diff = QPoint(0, 0);
+                if (xSection != 1 || ySection != 1) { // Remove this if you want the center to pull as well
+                    if (xSection == 1)
+                        xSection = (direction / 2 ? 2 : 0);
+                    if (ySection == 1)
+                        ySection = (direction % 2 ? 2 : 0);
+                }
+                if (xSection == 0 && ySection == 0)
+                    diff = QPoint(bounds.topLeft() - target_w->center());
+                if (xSection == 2 && ySection == 0)
+                    diff = QPoint(bounds.topRight() - target_w->center());
+                if (xSection == 2 && ySection == 2)
+                    diff = QPoint(bounds.bottomRight() - target_w->center());
+                if (xSection == 0 && ySection == 2)
+                    diff = QPoint(bounds.bottomLeft() - target_w->center());
+                if (diff.x() != 0 || diff.y() != 0) {
+                    diff *= accuracy / double(diff.manhattanLength());
+                    target_w->translate(diff);
+                }
+
+                // Update bounding rect
+                bounds = bounds.united(*target_w);
+                bounds = bounds.united(*target_e);
+
+                grid.move(w, withMargin(oldTarget_w), withMargin(*target_w));
+                grid.move(e, withMargin(oldTarget_e), withMargin(*target_e));
+            }
+        }
+    } while (overlap);
+
+    for (int i = 0; i < count; ++i) {
+        m_previous[keys[i]] = Previous{geometries[i], targets[i]};
+    }
+
+    // Work out scaling by getting the most top-left and most bottom-right window coords.
+    // The 20's and 10's are so that the windows don't touch the edge of the screen.
+    double scale;
+    if (bounds == area)
+        scale = 1.0; // Don't add borders to the screen
+    else if (area.width() / double(bounds.width()) < area.height() / double(bounds.height()))
+        scale = (area.width() - 20) / double(bounds.width());
+    else
+        scale = (area.height() - 20) / double(bounds.height());
+    // Make bounding rect fill the screen size for later steps
+    bounds = QRect(
+                 bounds.x() - (area.width() - 20 - bounds.width() * scale) / 2 - 10 / scale,
+                 bounds.y() - (area.height() - 20 - bounds.height() * scale) / 2 - 10 / scale,
+                 area.width() / scale,
+                 area.height() / scale
+             );
+
+    // Move all windows back onto the screen and set their scale
+    for (QRect &target : targets) {
+        target.setRect((target.x() - bounds.x()) * scale + area.x(),
+                       (target.y() - bounds.y()) * scale + area.y(),
+                       target.width() * scale,
+                       target.height() * scale
+                       );
+    }
+
+    // Try to fill the gaps by enlarging windows if they have the space
+    if (parameters.fillGaps) {
+        // Don't expand onto or over the border
+        QRegion borderRegion(area.adjusted(-200, -200, 200, 200));
+        borderRegion ^= area.adjusted(10 / scale, 10 / scale, -10 / scale, -10 / scale);
+
+        LayoutGrid scaledGrid(cellSizeFor(targets));
+        for (int i = 0; i < count; ++i) {
+            scaledGrid.insert(i, withMargin(targets[i]));
+        }
+        auto tryEnlarge = [&](int index, const QRect &candidate) {
+            if (borderRegion.intersects(candidate)) {
+                return false;
+            }
+            const QRect candidateWithMargin = withMargin(candidate);
+            const QVector<int> neighbors = scaledGrid.query(candidateWithMargin);
+            for (int neighbor : neighbors) {
+                if (neighbor != index && candidateWithMargin.intersects(withMargin(targets[neighbor]))) {
+                    return false;
+                }
+            }
+            scaledGrid.move(index, withMargin(targets[index]), candidateWithMargin);
+            targets[index] = candidate;
+            return true;
+        };
+
+        bool moved;
+        do {
+            moved = false;
+            for (int i = 0; i < count; ++i) {
+                const QRect &target = targets[i];
+                // This may cause some slight distortion if the windows are enlarged a large amount
+                int widthDiff = accuracy;
+                int heightDiff = heightForWidth(geometries[i], target.width() + widthDiff) - target.height();
+                int xDiff = widthDiff / 2;  // Also move a bit in the direction of the enlarge, allows the
+                int yDiff = heightDiff / 2; // center windows to be enlarged if there is gaps on the side.
+
+                // heightDiff (and yDiff) will be re-computed after each successfull enlargement attempt
+                // so that the error introduced in the window's aspect ratio is minimized
+
+                // Attempt enlarging to the top-right
+                if (tryEnlarge(i, QRect(target.x() + xDiff,
+                                        target.y() - yDiff - heightDiff,
+                                        target.width() + widthDiff,
+                                        target.height() + heightDiff))) {
+                    moved = true;
+                    heightDiff = heightForWidth(geometries[i], target.width() + widthDiff) - target.height();
+                    yDiff = heightDiff / 2;
+                }
+
+                // Attempt enlarging to the bottom-right
+                if (tryEnlarge(i, QRect(target.x() + xDiff,
+                                        target.y() + yDiff,
+                                        target.width() + widthDiff,
+                                        target.height() + heightDiff))) {
+                    moved = true;
+                    heightDiff = heightForWidth(geometries[i], target.width() + widthDiff) - target.height();
+                    yDiff = heightDiff / 2;
+                }
+
+                // Attempt enlarging to the bottom-left
+                if (tryEnlarge(i, QRect(target.x() - xDiff - widthDiff,
+                                        target.y() + yDiff,
+                                        target.width() + widthDiff,
+                                        target.height() + heightDiff))) {
+                    moved = true;
+                    heightDiff = heightForWidth(geometries[i], target.width() + widthDiff) - target.height();
+                    yDiff = heightDiff / 2;
+                }
+
+                // Attempt enlarging to the top-left
+                if (tryEnlarge(i, QRect(target.x() - xDiff - widthDiff,
+                                        target.y() - yDiff - heightDiff,
+                                        target.width() + widthDiff,
+                                        target.height() + heightDiff))) {
+                    moved = true;
+                }
+            }
+        } while (moved);
+
+        // The expanding code above can actually enlarge windows over 1.0/2.0 scale, we don't like this
+        // We can't add this to the loop above as it would cause a never-ending loop so we have to make
+        // do with the less-than-optimal space usage with using this method.
+        for (int i = 0; i < count; ++i) {
+            QRect *target = &targets[i];
+            const QRect &geometry = geometries[i];
+            double scale = target->width() / double(geometry.width());
+            if (scale > 2.0 || (scale > 1.0 && (geometry.width() > 300 || geometry.height() > 300))) {
+                scale = (geometry.width() > 300 || geometry.height() > 300) ? 1.0 : 2.0;
+                target->setRect(
+                                 target->center().x() - int(geometry.width() * scale) / 2,
+                                 target->center().y() - int(geometry.height() * scale) / 2,
+                                 geometry.width() * scale,
+                                 geometry.height() * scale);
+            }
+        }
+    }
+
+    return targets;
+}
+
+} // namespace
@@ -0,0 +1,110 @@
+/********************************************************************
+ KWin - the KDE window manager
+ This file is part of the KDE project.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*********************************************************************/
+
+#ifndef KWIN_PRESENTWINDOWS_LAYOUT_H
+#define KWIN_PRESENTWINDOWS_LAYOUT_H
+
+#include <QHash>
+#include <QRect>
+#include <QVector>
+
+namespace KWin
+{
+
+/**
+ * Uniform grid over the layout space, used to find the windows close to a rectangle
+ * without testing every window.
+ */
+class LayoutGrid
+{
+public:
+    explicit LayoutGrid(int cellSize);
+
+    void insert(int index, const QRect &rect);
+    void remove(int index, const QRect &rect);
+    void move(int index, const QRect &oldRect, const QRect &newRect);
+
+    /**
+     * Returns the indices of all rectangles sharing a cell with @p rect, sorted and
+     * without duplicates.
+     */
+    QVector<int> query(const QRect &rect) const;
+
+private:
+    QRect cellRange(const QRect &rect) const;
+    static quint64 key(int column, int row) {
+        return (quint64(quint32(column)) << 32) | quint32(row);
+    }
+
+    int m_cellSize;
+    QHash<quint64, QVector<int>> m_cells;
+};
+
+/**
+ * The natural layout of the present windows effect.
+ *
+ * Windows start at their real positions and are pushed apart until none of them
+ * overlap, afterwards the result is scaled to fit the screen and windows are enlarged
+ * into the remaining gaps.
+ *
+ * The solver only deals with rectangles, so it can run on a worker thread. It remembers
+ * the positions it pushed the windows to, a following solve for a changed set of windows
+ * starts from there instead of from scratch. Removing windows, e.g. when filtering, then
+ * needs no further pushing at all.
+ */
+class NaturalLayoutSolver
+{
+public:
+    struct Parameters {
+        QRect area;
+        int accuracy = 20;
+        bool fillGaps = true;
+    };
+
+    /**
+     * Computes the target geometries for windows with the given @p geometries. The
+     * @p keys identify the windows across solves. The result is in the same order.
+     */
+    QVector<QRect> solve(const QVector<quintptr> &keys, const QVector<QRect> &geometries,
+                         const Parameters &parameters);
+
+    /**
+     * Forgets the previous solution, the next solve starts from scratch.
+     */
+    void reset();
+
+    /**
+     * The number of passes over all windows the last solve needed to resolve the overlaps.
+     */
+    int lastPassCount() const {
+        return m_lastPassCount;
+    }
+
+private:
+    struct Previous {
+        QRect geometry;
+        QRect spread;
+    };
+    QHash<quintptr, Previous> m_previous;
+    QRect m_previousArea;
+    int m_lastPassCount = 0;
+};
+
+} // namespace
+
+#endif
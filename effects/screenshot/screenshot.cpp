@@ -19,6 +19,7 @@ You should have received a copy of the GNU General Public License
 along with this program.  If not, see <http://www.gnu.org/licenses/>.
 *********************************************************************/
 #include "screenshot.h"
+#include "screenshot_readback.h"
 #include <kwinglplatform.h>
 #include <kwinglutils.h>
 #include <kwinxrenderutils.h>
@@ -30,11 +31,15 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <QVarLengthArray>
 #include <QPainter>
 #include <QMatrix4x4>
+#include <QFutureWatcher>
+#include <QTimer>
 #include <xcb/xcb_image.h>
 
 #include <KLocalizedString>
 #include <KNotification>
 
+#include <fcntl.h>
+#include <sys/mman.h>
 #include <unistd.h>
 
 namespace KWin
@@ -50,6 +55,13 @@ const static QString s_errorInvalidArea = QStringLiteral("org.kde.kwin.Screensho
 const static QString s_errorInvalidAreaMsg = QStringLiteral("Invalid area requested");
 const static QString s_errorInvalidScreen = QStringLiteral("org.kde.kwin.Screenshot.Error.InvalidScreen");
 const static QString s_errorInvalidScreenMsg = QStringLiteral("Invalid screen requested");
+const static QString s_errorInvalidWindow = QStringLiteral("org.kde.kwin.Screenshot.Error.InvalidWindow");
+const static QString s_errorInvalidWindowMsg = QStringLiteral("Invalid window requested");
+
+// upper limit for asynchronous captures which are in flight at the same time
+static const int s_maxCaptures = 4;
+// how often the readbacks are polled while the GPU is busy
+static const int s_readbackPollInterval = 5;
 
 bool ScreenShotEffect::supported()
 {
@@ -59,7 +71,11 @@ bool ScreenShotEffect::supported()
 
 ScreenShotEffect::ScreenShotEffect()
     : m_scheduledScreenshot(nullptr)
+    , m_readbackTimer(new QTimer(this))
 {
+    m_readbackTimer->setSingleShot(true);
+    m_readbackTimer->setInterval(s_readbackPollInterval);
+    connect(m_readbackTimer, &QTimer::timeout, this, &ScreenShotEffect::pollReadbacks);
     connect(effects, &EffectsHandler::windowClosed, this, &ScreenShotEffect::windowClosed);
     QDBusConnection::sessionBus().registerObject(QStringLiteral("/Screenshot"), this, QDBusConnection::ExportScriptableContents);
 }
@@ -67,6 +83,17 @@ ScreenShotEffect::ScreenShotEffect()
 ScreenShotEffect::~ScreenShotEffect()
 {
     QDBusConnection::sessionBus().unregisterObject(QStringLiteral("/Screenshot"));
+    // the workers might still read from mapped pixel buffers
+    for (PendingCapture *capture : qAsConst(m_deliveries)) {
+        capture->delivery.waitForFinished();
+    }
+    if (effects->isOpenGLCompositing()) {
+        effects->makeOpenGLContextCurrent();
+    }
+    qDeleteAll(m_pendingCaptures);
+    qDeleteAll(m_readbacks);
+    qDeleteAll(m_deliveries);
+    m_bufferPool.reset();
 }
 
 #ifdef KWIN_HAVE_XRENDER_COMPOSITING
@@ -156,6 +183,84 @@ static xcb_pixmap_t xpixmapFromImage(const QImage &image)
     return pixmap;
 }
 
+/**
+ * Computes the area of @p w, relative to its position, which ends up on the screenshot and
+ * strips the decoration quads from @p d unless @p includeDecoration is set.
+ */
+static QRect windowCaptureGeometry(EffectWindow *w, bool includeDecoration, WindowPaintData &d)
+{
+    double left = 0;
+    double top = 0;
+    double right = w->width();
+    double bottom = w->height();
+    if (w->hasDecoration() && includeDecoration) {
+        foreach (const WindowQuad & quad, d.quads) {
+            // we need this loop to include the decoration padding
+            left   = qMin(left, quad.left());
+            top    = qMin(top, quad.top());
+            right  = qMax(right, quad.right());
+            bottom = qMax(bottom, quad.bottom());
+        }
+    } else if (w->hasDecoration()) {
+        WindowQuadList newQuads;
+        left = w->width();
+        top = w->height();
+        right = 0;
+        bottom = 0;
+        foreach (const WindowQuad & quad, d.quads) {
+            if (quad.type() == WindowQuadContents) {
+                newQuads << quad;
+                left   = qMin(left, quad.left());
+                top    = qMin(top, quad.top());
+                right  = qMax(right, quad.right());
+                bottom = qMax(bottom, quad.bottom());
+            }
+        }
+        d.quads = newQuads;
+    }
+    return QRect(left, top, right - left, bottom - top);
+}
+
+/**
+ * Copies the pixels into an unlinked shared memory file and paints the cursor on top.
+ * Runs in a worker thread, returns the file descriptor or -1 on failure.
+ */
+static int writeSharedMemory(const uchar *bits, int stride, const QSize &size, QImage::Format format, bool bottomUp,
+                             const QImage &cursor, const QPoint &cursorPosition)
+{
+    const int fd = memfd_create("kwin-screenshot", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0) {
+        return -1;
+    }
+    const qint64 byteCount = qint64(stride) * size.height();
+    if (ftruncate(fd, byteCount) < 0) {
+        close(fd);
+        return -1;
+    }
+    void *mapping = mmap(nullptr, byteCount, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapping == MAP_FAILED) {
+        close(fd);
+        return -1;
+    }
+    uchar *address = static_cast<uchar *>(mapping);
+    for (int y = 0; y < size.height(); ++y) {
+        const int sourceLine = bottomUp ? size.height() - y - 1 : y;
+        memcpy(address + qint64(y) * stride, bits + qint64(sourceLine) * stride, stride);
+    }
+    if (!cursor.isNull()) {
+        QImage image(address, size.width(), size.height(), stride, format);
+        QPainter painter(&image);
+        painter.drawImage(cursorPosition, cursor);
+    }
+    munmap(mapping, byteCount);
+    // the client gets a read-only snapshot
+    if (fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
 void ScreenShotEffect::paintScreen(int mask, QRegion region, ScreenPaintData &data)
 {
     m_cachedOutputGeometry = data.outputGeometry();
@@ -165,88 +270,14 @@ void ScreenShotEffect::paintScreen(int mask, QRegion region, ScreenPaintData &da
 void ScreenShotEffect::postPaintScreen()
 {
     effects->postPaintScreen();
+    processPendingCaptures();
     if (m_scheduledScreenshot) {
         WindowPaintData d(m_scheduledScreenshot);
-        double left = 0;
-        double top = 0;
-        double right = m_scheduledScreenshot->width();
-        double bottom = m_scheduledScreenshot->height();
-        if (m_scheduledScreenshot->hasDecoration() && m_type & INCLUDE_DECORATION) {
-            foreach (const WindowQuad & quad, d.quads) {
-                // we need this loop to include the decoration padding
-                left   = qMin(left, quad.left());
-                top    = qMin(top, quad.top());
-                right  = qMax(right, quad.right());
-                bottom = qMax(bottom, quad.bottom());
-            }
-        } else if (m_scheduledScreenshot->hasDecoration()) {
-            WindowQuadList newQuads;
-            left = m_scheduledScreenshot->width();
-            top = m_scheduledScreenshot->height();
-            right = 0;
-            bottom = 0;
-            foreach (const WindowQuad & quad, d.quads) {
-                if (quad.type() == WindowQuadContents) {
-                    newQuads << quad;
-                    left   = qMin(left, quad.left());
-                    top    = qMin(top, quad.top());
-                    right  = qMax(right, quad.right());
-                    bottom = qMax(bottom, quad.bottom());
-                }
-            }
-            d.quads = newQuads;
-        }
-        const int width = right - left;
-        const int height = bottom - top;
-        bool validTarget = true;
-        QScopedPointer<GLTexture> offscreenTexture;
-        QScopedPointer<GLRenderTarget> target;
-        if (effects->isOpenGLCompositing()) {
-            offscreenTexture.reset(new GLTexture(GL_RGBA8, width, height));
-            offscreenTexture->setFilter(GL_LINEAR);
-            offscreenTexture->setWrapMode(GL_CLAMP_TO_EDGE);
-            target.reset(new GLRenderTarget(*offscreenTexture));
-            validTarget = target->valid();
-        }
-        if (validTarget) {
-            d.setXTranslation(-m_scheduledScreenshot->x() - left);
-            d.setYTranslation(-m_scheduledScreenshot->y() - top);
-
-            // render window into offscreen texture
-            int mask = PAINT_WINDOW_TRANSFORMED | PAINT_WINDOW_TRANSLUCENT;
-            QImage img;
-            if (effects->isOpenGLCompositing()) {
-                GLRenderTarget::pushRenderTarget(target.data());
-                glClearColor(0.0, 0.0, 0.0, 0.0);
-                glClear(GL_COLOR_BUFFER_BIT);
-                glClearColor(0.0, 0.0, 0.0, 1.0);
-
-                QMatrix4x4 projection;
-                projection.ortho(QRect(0, 0, offscreenTexture->width(), offscreenTexture->height()));
-                d.setProjectionMatrix(projection);
-
-                effects->drawWindow(m_scheduledScreenshot, mask, infiniteRegion(), d);
-
-                // copy content from framebuffer into image
-                img = QImage(QSize(width, height), QImage::Format_ARGB32);
-                glReadnPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, img.sizeInBytes(), (GLvoid*)img.bits());
-                GLRenderTarget::popRenderTarget();
-                ScreenShotEffect::convertFromGLImage(img, width, height);
-            }
-#ifdef KWIN_HAVE_XRENDER_COMPOSITING
-            xcb_image_t *xImage = nullptr;
-            if (effects->compositingType() == XRenderCompositing) {
-                setXRenderOffscreen(true);
-                effects->drawWindow(m_scheduledScreenshot, mask, QRegion(0, 0, width, height), d);
-                if (xRenderOffscreenTarget()) {
-                    img = xPictureToImage(xRenderOffscreenTarget(), QRect(0, 0, width, height), &xImage);
-                }
-                setXRenderOffscreen(false);
-            }
-#endif
-
+        const QRect geometry = windowCaptureGeometry(m_scheduledScreenshot, m_type & INCLUDE_DECORATION, d);
+        QImage img;
+        if (renderWindow(m_scheduledScreenshot, geometry, d, nullptr, &img)) {
             if (m_type & INCLUDE_CURSOR) {
-                grabPointerImage(img, m_scheduledScreenshot->x() + left, m_scheduledScreenshot->y() + top);
+                grabPointerImage(img, m_scheduledScreenshot->x() + geometry.x(), m_scheduledScreenshot->y() + geometry.y());
             }
 
             if (m_windowMode == WindowMode::Xpixmap) {
@@ -270,11 +301,6 @@ void ScreenShotEffect::postPaintScreen()
                 m_windowMode = WindowMode::NoCapture;
                 m_fd = -1;
             }
-#ifdef KWIN_HAVE_XRENDER_COMPOSITING
-            if (xImage) {
-                xcb_image_destroy(xImage);
-            }
-#endif
         }
         m_scheduledScreenshot = nullptr;
     }
@@ -287,7 +313,7 @@ void ScreenShotEffect::postPaintScreen()
                 // doesn't intersect, not going onto this screenshot
                 return;
             }
-            const QImage img = blitScreenshot(intersection);
+            const QImage img = blitScreenshot(intersection, m_captureCursor);
             if (img.size() == m_scheduledGeometry.size()) {
                 // we are done
                 sendReplyImage(img);
@@ -307,12 +333,235 @@ void ScreenShotEffect::postPaintScreen()
             }
 
         } else {
-            const QImage img = blitScreenshot(m_scheduledGeometry);
+            const QImage img = blitScreenshot(m_scheduledGeometry, m_captureCursor);
             sendReplyImage(img);
         }
     }
 }
 
+bool ScreenShotEffect::renderWindow(EffectWindow *w, const QRect &geometry, WindowPaintData &d,
+                                    ScreenShotReadback *readback, QImage *image)
+{
+    const int width = geometry.width();
+    const int height = geometry.height();
+    bool validTarget = true;
+    QScopedPointer<GLTexture> offscreenTexture;
+    QScopedPointer<GLRenderTarget> target;
+    if (effects->isOpenGLCompositing()) {
+        offscreenTexture.reset(new GLTexture(GL_RGBA8, width, height));
+        offscreenTexture->setFilter(GL_LINEAR);
+        offscreenTexture->setWrapMode(GL_CLAMP_TO_EDGE);
+        target.reset(new GLRenderTarget(*offscreenTexture));
+        validTarget = target->valid();
+    }
+    if (!validTarget) {
+        return false;
+    }
+    d.setXTranslation(-w->x() - geometry.x());
+    d.setYTranslation(-w->y() - geometry.y());
+
+    // render window into offscreen texture
+    int mask = PAINT_WINDOW_TRANSFORMED | PAINT_WINDOW_TRANSLUCENT;
+    if (effects->isOpenGLCompositing()) {
+        GLRenderTarget::pushRenderTarget(target.data());
+        glClearColor(0.0, 0.0, 0.0, 0.0);
+        glClear(GL_COLOR_BUFFER_BIT);
+        glClearColor(0.0, 0.0, 0.0, 1.0);
+
+        QMatrix4x4 projection;
+        projection.ortho(QRect(0, 0, offscreenTexture->width(), offscreenTexture->height()));
+        d.setProjectionMatrix(projection);
+
+        effects->drawWindow(w, mask, infiniteRegion(), d);
+
+        if (readback) {
+            readback->readFromRenderTarget(QSize(width, height), QPoint(0, 0));
+            GLRenderTarget::popRenderTarget();
+        } else {
+            // copy content from framebuffer into image
+            *image = QImage(QSize(width, height), QImage::Format_ARGB32);
+            glReadnPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, image->sizeInBytes(), (GLvoid*)image->bits());
+            GLRenderTarget::popRenderTarget();
+            ScreenShotEffect::convertFromGLImage(*image, width, height);
+        }
+    }
+#ifdef KWIN_HAVE_XRENDER_COMPOSITING
+    if (effects->compositingType() == XRenderCompositing) {
+        setXRenderOffscreen(true);
+        effects->drawWindow(w, mask, QRegion(0, 0, width, height), d);
+        if (xRenderOffscreenTarget()) {
+            xcb_image_t *xImage = nullptr;
+            *image = xPictureToImage(xRenderOffscreenTarget(), QRect(0, 0, width, height), &xImage);
+            if (xImage) {
+                xcb_image_destroy(xImage);
+            }
+        }
+        setXRenderOffscreen(false);
+    }
+#endif
+    return true;
+}
+
+void ScreenShotEffect::processPendingCaptures()
+{
+    auto it = m_pendingCaptures.begin();
+    while (it != m_pendingCaptures.end()) {
+        PendingCapture *capture = *it;
+        const bool complete = capture->window ? renderWindowCapture(capture) : renderAreaCapture(capture);
+        if (!complete) {
+            ++it;
+            continue;
+        }
+        it = m_pendingCaptures.erase(it);
+
+        if (capture->captureCursor) {
+            const auto cursor = effects->cursorImage();
+            capture->cursor = cursor.image();
+            capture->cursorPosition = effects->cursorPos() - cursor.hotSpot() - capture->geometry.topLeft();
+        }
+        if (capture->readback) {
+            capture->readback->finish();
+            m_readbacks.append(capture);
+            m_readbackTimer->start();
+        } else if (capture->image.isNull()) {
+            failCapture(capture, s_errorCancelled, s_errorCancelledMsg);
+        } else {
+            const QImage &image = capture->image;
+            deliverCapture(capture, image.constBits(), image.bytesPerLine(), image.format(), false);
+        }
+    }
+}
+
+bool ScreenShotEffect::renderAreaCapture(PendingCapture *capture)
+{
+    const QRect intersection = m_cachedOutputGeometry.isNull()
+        ? capture->geometry : capture->geometry.intersected(m_cachedOutputGeometry);
+    if (intersection.isEmpty()) {
+        // doesn't intersect, not going onto this capture
+        return false;
+    }
+    const QPoint position = intersection.topLeft() - capture->geometry.topLeft();
+    if (capture->readback) {
+        capture->readback->readFromFramebuffer(intersection, position);
+    } else {
+        if (capture->image.isNull()) {
+            capture->image = QImage(capture->geometry.size(), QImage::Format_ARGB32);
+            capture->image.fill(Qt::transparent);
+        }
+        QPainter p(&capture->image);
+        p.drawImage(position, blitScreenshot(intersection, false));
+    }
+    capture->missing -= intersection;
+    return capture->missing.isEmpty();
+}
+
+bool ScreenShotEffect::renderWindowCapture(PendingCapture *capture)
+{
+    EffectWindow *w = capture->window;
+    WindowPaintData d(w);
+    const QRect geometry = windowCaptureGeometry(w, capture->mask & INCLUDE_DECORATION, d);
+    // the cursor position is relative to the captured area
+    capture->geometry = geometry.translated(w->pos());
+    if (geometry.isEmpty()) {
+        return true;
+    }
+    if (effects->isOpenGLCompositing() && m_bufferPool) {
+        capture->readback.reset(new ScreenShotReadback(m_bufferPool.data(), geometry.size()));
+    }
+    if (!renderWindow(w, geometry, d, capture->readback.data(), &capture->image)) {
+        capture->readback.reset();
+        capture->image = QImage();
+    }
+    return true;
+}
+
+void ScreenShotEffect::pollReadbacks()
+{
+    effects->makeOpenGLContextCurrent();
+    auto it = m_readbacks.begin();
+    while (it != m_readbacks.end()) {
+        PendingCapture *capture = *it;
+        if (!capture->readback->isReady()) {
+            ++it;
+            continue;
+        }
+        it = m_readbacks.erase(it);
+        const uchar *bits = capture->readback->map();
+        if (!bits) {
+            failCapture(capture, s_errorCancelled, s_errorCancelledMsg);
+            continue;
+        }
+        ScreenShotReadback *readback = capture->readback.data();
+        deliverCapture(capture, bits, readback->stride(), readback->format(), true);
+    }
+    if (!m_readbacks.isEmpty()) {
+        m_readbackTimer->start();
+    }
+}
+
+void ScreenShotEffect::deliverCapture(PendingCapture *capture, const uchar *bits, int stride,
+                                      QImage::Format format, bool bottomUp)
+{
+    const QSize size = capture->readback ? capture->readback->size() : capture->image.size();
+    m_deliveries.append(capture);
+
+    auto watcher = new QFutureWatcher<int>(this);
+    connect(watcher, &QFutureWatcher<int>::finished, this,
+        [this, watcher, capture, size, stride, format] {
+            watcher->deleteLater();
+            m_deliveries.removeOne(capture);
+            const int fd = watcher->result();
+            if (fd == -1) {
+                failCapture(capture, s_errorFd, s_errorFdMsg);
+                return;
+            }
+            const QVariantList arguments{QVariant::fromValue(QDBusUnixFileDescriptor(fd)),
+                                         size.width(), size.height(), stride, int(format)};
+            QDBusConnection::sessionBus().send(capture->replyMessage.createReply(arguments));
+            close(fd);
+            if (capture->readback) {
+                // unmaps the buffer and hands it back to the pool
+                effects->makeOpenGLContextCurrent();
+            }
+            delete capture;
+        }
+    );
+    capture->delivery = QtConcurrent::run(writeSharedMemory, bits, stride, size, format, bottomUp,
+                                          capture->cursor, capture->cursorPosition);
+    watcher->setFuture(capture->delivery);
+}
+
+void ScreenShotEffect::failCapture(PendingCapture *capture, const QString &name, const QString &message)
+{
+    QDBusConnection::sessionBus().send(capture->replyMessage.createErrorReply(name, message));
+    if (capture->readback) {
+        effects->makeOpenGLContextCurrent();
+    }
+    delete capture;
+}
+
+void ScreenShotEffect::scheduleCapture(PendingCapture *capture)
+{
+    capture->replyMessage = message();
+    setDelayedReply(true);
+    if (effects->isOpenGLCompositing() && ScreenShotReadback::supported()) {
+        if (!m_bufferPool) {
+            m_bufferPool.reset(new PixelBufferPool);
+        }
+        // for windows the size is only known once the window gets rendered
+        if (!capture->window) {
+            effects->makeOpenGLContextCurrent();
+            capture->readback.reset(new ScreenShotReadback(m_bufferPool.data(), capture->geometry.size()));
+        }
+    }
+    m_pendingCaptures.append(capture);
+    if (capture->window) {
+        capture->window->addRepaintFull();
+    } else {
+        effects->addRepaint(capture->geometry);
+    }
+}
+
 void ScreenShotEffect::sendReplyImage(const QImage &img)
 {
     if (m_fd != -1) {
@@ -604,7 +853,91 @@ QString ScreenShotEffect::screenshotArea(int x, int y, int width, int height, bo
     return QString();
 }
 
-QImage ScreenShotEffect::blitScreenshot(const QRect &geometry)
+bool ScreenShotEffect::canCapture()
+{
+    if (m_pendingCaptures.count() + m_readbacks.count() + m_deliveries.count() >= s_maxCaptures) {
+        sendErrorReply(s_errorAlreadyTaking, s_errorAlreadyTakingMsg);
+        return false;
+    }
+    return true;
+}
+
+QDBusUnixFileDescriptor ScreenShotEffect::captureArea(int x, int y, int width, int height, bool captureCursor,
+                                                      int &imageWidth, int &imageHeight, int &stride, int &format)
+{
+    if (!calledFromDBus()) {
+        return QDBusUnixFileDescriptor();
+    }
+    // the values are delivered with the delayed reply
+    const QDBusUnixFileDescriptor result;
+    imageWidth = imageHeight = stride = format = 0;
+    if (!canCapture()) {
+        return result;
+    }
+    const QRect geometry(x, y, width, height);
+    if (geometry.isEmpty()) {
+        sendErrorReply(s_errorInvalidArea, s_errorInvalidAreaMsg);
+        return result;
+    }
+    QRegion screens;
+    for (int i = 0; i < effects->numScreens(); ++i) {
+        screens += effects->clientArea(FullScreenArea, i, 0);
+    }
+    auto capture = new PendingCapture;
+    capture->geometry = geometry;
+    capture->captureCursor = captureCursor;
+    capture->missing = screens & geometry;
+    if (capture->missing.isEmpty()) {
+        delete capture;
+        sendErrorReply(s_errorInvalidArea, s_errorInvalidAreaMsg);
+        return result;
+    }
+    scheduleCapture(capture);
+    return result;
+}
+
+QDBusUnixFileDescriptor ScreenShotEffect::captureScreen(int screen, bool captureCursor,
+                                                        int &imageWidth, int &imageHeight, int &stride, int &format)
+{
+    if (!calledFromDBus()) {
+        return QDBusUnixFileDescriptor();
+    }
+    const QRect geometry = effects->clientArea(FullScreenArea, screen, 0);
+    if (geometry.isNull()) {
+        imageWidth = imageHeight = stride = format = 0;
+        sendErrorReply(s_errorInvalidScreen, s_errorInvalidScreenMsg);
+        return QDBusUnixFileDescriptor();
+    }
+    return captureArea(geometry.x(), geometry.y(), geometry.width(), geometry.height(), captureCursor,
+                       imageWidth, imageHeight, stride, format);
+}
+
+QDBusUnixFileDescriptor ScreenShotEffect::captureWindow(qulonglong winid, int mask,
+                                                        int &imageWidth, int &imageHeight, int &stride, int &format)
+{
+    if (!calledFromDBus()) {
+        return QDBusUnixFileDescriptor();
+    }
+    // the values are delivered with the delayed reply
+    const QDBusUnixFileDescriptor result;
+    imageWidth = imageHeight = stride = format = 0;
+    if (!canCapture()) {
+        return result;
+    }
+    EffectWindow *w = effects->findWindow(winid);
+    if (!w || w->isMinimized() || w->isDeleted()) {
+        sendErrorReply(s_errorInvalidWindow, s_errorInvalidWindowMsg);
+        return result;
+    }
+    auto capture = new PendingCapture;
+    capture->window = w;
+    capture->mask = mask;
+    capture->captureCursor = mask & INCLUDE_CURSOR;
+    scheduleCapture(capture);
+    return result;
+}
+
+QImage ScreenShotEffect::blitScreenshot(const QRect &geometry, bool captureCursor)
 {
     QImage img;
     if (effects->isOpenGLCompositing())
@@ -634,7 +967,7 @@ QImage ScreenShotEffect::blitScreenshot(const QRect &geometry)
     }
 #endif
 
-    if (m_captureCursor) {
+    if (captureCursor) {
         grabPointerImage(img, geometry.x(), geometry.y());
     }
 
@@ -684,7 +1017,8 @@ void ScreenShotEffect::convertFromGLImage(QImage &img, int w, int h)
 
 bool ScreenShotEffect::isActive() const
 {
-    return (m_scheduledScreenshot != nullptr || !m_scheduledGeometry.isNull()) && !effects->isScreenLocked();
+    return (m_scheduledScreenshot != nullptr || !m_scheduledGeometry.isNull() || !m_pendingCaptures.isEmpty())
+            && !effects->isScreenLocked();
 }
 
 void ScreenShotEffect::windowClosed( EffectWindow* w )
@@ -693,6 +1027,15 @@ void ScreenShotEffect::windowClosed( EffectWindow* w )
         m_scheduledScreenshot = nullptr;
         screenshotWindowUnderCursor(m_type);
     }
+    auto it = m_pendingCaptures.begin();
+    while (it != m_pendingCaptures.end()) {
+        if ((*it)->window == w) {
+            failCapture(*it, s_errorInvalidWindow, s_errorInvalidWindowMsg);
+            it = m_pendingCaptures.erase(it);
+        } else {
+            ++it;
+        }
+    }
 }
 
 bool ScreenShotEffect::isTakingScreenshot() const
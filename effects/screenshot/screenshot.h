@@ -26,12 +26,18 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <QDBusConnection>
 #include <QDBusMessage>
 #include <QDBusUnixFileDescriptor>
+#include <QFuture>
 #include <QObject>
 #include <QImage>
 
+class QTimer;
+
 namespace KWin
 {
 
+class PixelBufferPool;
+class ScreenShotReadback;
+
 class ScreenShotEffect : public Effect, protected QDBusContext
 {
     Q_OBJECT
@@ -132,16 +138,79 @@ public Q_SLOTS:
      * @returns Path to stored screenshot, or null string in failure case.
      */
     Q_SCRIPTABLE QString screenshotArea(int x, int y, int width, int height, bool captureCursor = false);
+    /**
+     * Captures the selected geometry without stalling the compositor.
+     *
+     * The pixels are read back asynchronously on one of the next frames and are handed
+     * over in an unlinked shared memory file. This is intended for clients which take
+     * screenshots periodically and don't want every capture to cost a frame.
+     *
+     * @param x Left upper x coord of region
+     * @param y Left upper y coord of region
+     * @param width Width of the region to capture
+     * @param height Height of the region to capture
+     * @param captureCursor Whether to include the cursor in the image
+     * @param imageWidth Width of the image in the shared memory file
+     * @param imageHeight Height of the image in the shared memory file
+     * @param stride Number of bytes per line of the image
+     * @param format The QImage::Format of the pixel data
+     * @returns File descriptor of the shared memory file
+     */
+    Q_SCRIPTABLE QDBusUnixFileDescriptor captureArea(int x, int y, int width, int height, bool captureCursor,
+                                                     int &imageWidth, int &imageHeight, int &stride, int &format);
+    /**
+     * Captures the screen identified by @p screen without stalling the compositor.
+     * The result is delivered like with captureArea.
+     *
+     * @param screen Number of screen as numbered by QDesktopWidget
+     * @param captureCursor Whether to include the cursor in the image
+     */
+    Q_SCRIPTABLE QDBusUnixFileDescriptor captureScreen(int screen, bool captureCursor,
+                                                       int &imageWidth, int &imageHeight, int &stride, int &format);
+    /**
+     * Captures the window identified by @p winid without stalling the compositor.
+     * The result is delivered like with captureArea.
+     *
+     * @param winid The window to capture
+     * @param mask The mask for what to include in the screenshot
+     */
+    Q_SCRIPTABLE QDBusUnixFileDescriptor captureWindow(qulonglong winid, int mask,
+                                                       int &imageWidth, int &imageHeight, int &stride, int &format);
 
 Q_SIGNALS:
     Q_SCRIPTABLE void screenshotCreated(qulonglong handle);
 
 private Q_SLOTS:
     void windowClosed( KWin::EffectWindow* w );
+    void pollReadbacks();
 
 private:
+    struct PendingCapture {
+        QDBusMessage replyMessage;
+        // the area to capture in global coordinates, or the window
+        QRect geometry;
+        EffectWindow *window = nullptr;
+        int mask = 0;
+        bool captureCursor = false;
+        // the parts of the area which are on screen but were not captured yet
+        QRegion missing;
+        QScopedPointer<ScreenShotReadback> readback;
+        // used instead of the readback if asynchronous readbacks are not supported
+        QImage image;
+        QImage cursor;
+        QPoint cursorPosition;
+        QFuture<int> delivery;
+    };
+    void scheduleCapture(PendingCapture *capture);
+    void processPendingCaptures();
+    bool renderAreaCapture(PendingCapture *capture);
+    bool renderWindowCapture(PendingCapture *capture);
+    void deliverCapture(PendingCapture *capture, const uchar *bits, int stride, QImage::Format format, bool bottomUp);
+    void failCapture(PendingCapture *capture, const QString &name, const QString &message);
+    bool canCapture();
+    bool renderWindow(EffectWindow *w, const QRect &geometry, WindowPaintData &d, ScreenShotReadback *readback, QImage *image);
     void grabPointerImage(QImage& snapshot, int offsetx, int offsety);
-    QImage blitScreenshot(const QRect &geometry);
+    QImage blitScreenshot(const QRect &geometry, bool captureCursor);
     QString saveTempImage(const QImage &img);
     void sendReplyImage(const QImage &img);
     enum class InfoMessageMode {
@@ -167,6 +236,14 @@ private:
     };
     WindowMode m_windowMode = WindowMode::NoCapture;
     int m_fd = -1;
+    // captures waiting for the next frame
+    QList<PendingCapture*> m_pendingCaptures;
+    // captures waiting for the GPU to finish the readback
+    QList<PendingCapture*> m_readbacks;
+    // captures being written into shared memory
+    QList<PendingCapture*> m_deliveries;
+    QScopedPointer<PixelBufferPool> m_bufferPool;
+    QTimer *m_readbackTimer;
 };
 
 } // namespace
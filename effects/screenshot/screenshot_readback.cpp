@@ -0,0 +1,198 @@
+/********************************************************************
+ KWin - the KDE window manager
+ This file is part of the KDE project.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*********************************************************************/
+#include "screenshot_readback.h"
+
+#include <kwinglplatform.h>
+
+#include <algorithm>
+
+namespace KWin
+{
+
+// number of idle buffers kept around for the next readbacks
+static const int s_maxFreeBuffers = 3;
+
+PixelBufferPool::~PixelBufferPool()
+{
+    for (const Buffer &buffer : qAsConst(m_free)) {
+        glDeleteBuffers(1, &buffer.name);
+    }
+}
+
+GLuint PixelBufferPool::acquire(int size, int *capacity)
+{
+    // pick the smallest idle buffer which is large enough
+    auto best = m_free.end();
+    for (auto it = m_free.begin(); it != m_free.end(); ++it) {
+        if (it->capacity >= size && (best == m_free.end() || it->capacity < best->capacity)) {
+            best = it;
+        }
+    }
+    if (best != m_free.end()) {
+        const Buffer buffer = *best;
+        m_free.erase(best);
+        *capacity = buffer.capacity;
+        return buffer.name;
+    }
+
+    GLuint name = 0;
+    glGenBuffers(1, &name);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, name);
+    glBufferData(GL_PIXEL_PACK_BUFFER, size, nullptr, GL_STREAM_READ);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    *capacity = size;
+    return name;
+}
+
+void PixelBufferPool::release(GLuint buffer, int capacity)
+{
+    m_free.append({buffer, capacity});
+    if (m_free.count() <= s_maxFreeBuffers) {
+        return;
+    }
+    // drop the smallest buffer, it's the least likely to be reused
+    auto smallest = std::min_element(m_free.begin(), m_free.end(),
+        [] (const Buffer &a, const Buffer &b) {
+            return a.capacity < b.capacity;
+        }
+    );
+    glDeleteBuffers(1, &smallest->name);
+    m_free.erase(smallest);
+}
+
+ScreenShotReadback::ScreenShotReadback(PixelBufferPool *pool, const QSize &size)
+    : m_pool(pool)
+    , m_size(size)
+{
+    m_buffer = m_pool->acquire(stride() * m_size.height(), &m_capacity);
+}
+
+ScreenShotReadback::~ScreenShotReadback()
+{
+    if (m_mapped) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, m_buffer);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+    if (m_fence) {
+        glDeleteSync(m_fence);
+    }
+    m_pool->release(m_buffer, m_capacity);
+}
+
+bool ScreenShotReadback::supported()
+{
+    if (!GLRenderTarget::blitSupported()) {
+        return false;
+    }
+    if (GLPlatform::instance()->isGLES()) {
+        return hasGLVersion(3, 0);
+    }
+    return hasGLVersion(3, 2) ||
+        (hasGLExtension(QByteArrayLiteral("GL_ARB_sync")) && hasGLExtension(QByteArrayLiteral("GL_ARB_map_buffer_range")));
+}
+
+QImage::Format ScreenShotReadback::format() const
+{
+    // GL_BGRA is the fast path for readbacks on desktop drivers and matches ARGB32,
+    // OpenGL ES only guarantees GL_RGBA
+    return GLPlatform::instance()->isGLES() ? QImage::Format_RGBA8888 : QImage::Format_ARGB32;
+}
+
+void ScreenShotReadback::readFromFramebuffer(const QRect &source, const QPoint &position)
+{
+    // Blitting into a texture of the logical size takes care of the output scale,
+    // the readback from it is queued in the command stream behind the blit.
+    GLTexture texture(GL_RGBA8, source.size());
+    GLRenderTarget target(texture);
+    target.blitFromFramebuffer(source);
+
+    GLRenderTarget::pushRenderTarget(&target);
+    readPixels(QRect(QPoint(0, 0), source.size()), position);
+    GLRenderTarget::popRenderTarget();
+}
+
+void ScreenShotReadback::readFromRenderTarget(const QSize &size, const QPoint &position)
+{
+    readPixels(QRect(QPoint(0, 0), size), position);
+}
+
+void ScreenShotReadback::readPixels(const QRect &rect, const QPoint &position)
+{
+    Q_ASSERT(!m_fence);
+    const QRect destination = QRect(position, rect.size()) & QRect(QPoint(0, 0), m_size);
+    if (destination.isEmpty()) {
+        return;
+    }
+    // the buffer is filled bottom-up, row 0 is the last row of the image
+    const intptr_t offset = ((m_size.height() - destination.y() - destination.height()) * m_size.width()
+                             + destination.x()) * 4;
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, m_buffer);
+    glPixelStorei(GL_PACK_ROW_LENGTH, m_size.width());
+    if (GLPlatform::instance()->isGLES()) {
+        glReadPixels(rect.x(), rect.y(), destination.width(), destination.height(),
+                     GL_RGBA, GL_UNSIGNED_BYTE, reinterpret_cast<GLvoid *>(offset));
+    } else {
+        glReadPixels(rect.x(), rect.y(), destination.width(), destination.height(),
+                     GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, reinterpret_cast<GLvoid *>(offset));
+    }
+    glPixelStorei(GL_PACK_ROW_LENGTH, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+void ScreenShotReadback::finish()
+{
+    Q_ASSERT(!m_fence);
+    m_fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    // make sure the commands actually get submitted, otherwise the fence could
+    // only signal once the next frame is flushed
+    glFlush();
+}
+
+bool ScreenShotReadback::isReady()
+{
+    if (m_ready) {
+        return true;
+    }
+    if (!m_fence) {
+        return false;
+    }
+    GLint value = GL_UNSIGNALED;
+    glGetSynciv(m_fence, GL_SYNC_STATUS, 1, nullptr, &value);
+    if (value != GL_SIGNALED) {
+        return false;
+    }
+    glDeleteSync(m_fence);
+    m_fence = nullptr;
+    m_ready = true;
+    return true;
+}
+
+const uchar *ScreenShotReadback::map()
+{
+    Q_ASSERT(m_ready);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, m_buffer);
+    const uchar *data = static_cast<const uchar *>(glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0,
+                                                                    stride() * m_size.height(), GL_MAP_READ_BIT));
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    m_mapped = data != nullptr;
+    return data;
+}
+
+} // namespace
@@ -0,0 +1,121 @@
+/********************************************************************
+ KWin - the KDE window manager
+ This file is part of the KDE project.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*********************************************************************/
+
+#ifndef KWIN_SCREENSHOT_READBACK_H
+#define KWIN_SCREENSHOT_READBACK_H
+
+#include <kwinglutils.h>
+
+#include <QImage>
+#include <QRect>
+#include <QVector>
+
+namespace KWin
+{
+
+/**
+ * A small pool of pixel pack buffers which are recycled between readbacks, so that
+ * periodic captures don't have to allocate new buffer storage for every frame.
+ */
+class PixelBufferPool
+{
+public:
+    ~PixelBufferPool();
+
+    /**
+     * Returns a buffer with at least @p size bytes of storage, @p capacity is set to the
+     * actual size of the buffer.
+     */
+    GLuint acquire(int size, int *capacity);
+    void release(GLuint buffer, int capacity);
+
+private:
+    struct Buffer {
+        GLuint name;
+        int capacity;
+    };
+    QVector<Buffer> m_free;
+};
+
+/**
+ * Reads back pixels into a pixel pack buffer without stalling the command stream.
+ *
+ * The image is assembled from one or more reads, e.g. one per output. After the last
+ * read finish() inserts a fence and isReady() can be polled on later frames. Once the
+ * GPU is done, map() gives access to the pixels. They are stored bottom-up as OpenGL
+ * delivers them, with the layout described by size(), stride() and format().
+ */
+class ScreenShotReadback
+{
+public:
+    ScreenShotReadback(PixelBufferPool *pool, const QSize &size);
+    ~ScreenShotReadback();
+
+    /**
+     * Whether the platform provides pixel buffer objects, fences and framebuffer blits.
+     */
+    static bool supported();
+
+    QSize size() const {
+        return m_size;
+    }
+    int stride() const {
+        return m_size.width() * 4;
+    }
+    QImage::Format format() const;
+
+    /**
+     * Copies @p source, in virtual screen coordinates, of the default framebuffer to
+     * @p position in the image.
+     */
+    void readFromFramebuffer(const QRect &source, const QPoint &position);
+    /**
+     * Copies the @p size sized area at the origin of the currently bound render target
+     * to @p position in the image.
+     */
+    void readFromRenderTarget(const QSize &size, const QPoint &position);
+
+    /**
+     * Marks the end of the reads, no further reads may be issued afterwards.
+     */
+    void finish();
+    /**
+     * Polls the fence without blocking. Only valid after finish().
+     */
+    bool isReady();
+
+    /**
+     * Maps the pixel data into client memory. Only valid once isReady() returned @c true.
+     */
+    const uchar *map();
+
+private:
+    void readPixels(const QRect &rect, const QPoint &position);
+
+    PixelBufferPool *m_pool;
+    QSize m_size;
+    GLuint m_buffer = 0;
+    int m_capacity = 0;
+    GLsync m_fence = nullptr;
+    bool m_ready = false;
+    bool m_mapped = false;
+};
+
+} // namespace
+
+#endif
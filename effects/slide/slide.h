@@ -58,6 +58,9 @@ public:
     int requestedEffectChainPosition() const override {
         return 50;
     }
+    bool isBuildQuadsThreadSafe() const override {
+        return true;
+    }
 
     static bool supported();
 
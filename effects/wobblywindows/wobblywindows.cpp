@@ -12,6 +12,9 @@ License. See the file "COPYING" for the exact licensing terms.
 #include "wobblywindows.h"
 #include "wobblywindowsconfig.h"
 
+#include <QVarLengthArray>
+
+#include <algorithm>
 #include <cmath>
 
 //#define COMPUTE_STATS
@@ -132,12 +135,8 @@ WobblyWindowsEffect::~WobblyWindowsEffect()
 {
     if (!windows.empty()) {
         // we should be empty at this point...
-        // emit a warning and clean the list.
+        // emit a warning.
         qCDebug(KWINEFFECTS) << "Windows list not empty. Left items : " << windows.count();
-        QHash< const EffectWindow*,  WindowWobblyInfos >::iterator i;
-        for (i = windows.begin(); i != windows.end(); ++i) {
-            freeWobblyInfo(i.value());
-        }
     }
 }
 
@@ -271,9 +270,24 @@ void WobblyWindowsEffect::prePaintWindow(EffectWindow* w, WindowPrePaintData& da
 void WobblyWindowsEffect::paintWindow(EffectWindow* w, int mask, QRegion region, WindowPaintData& data)
 {
     if (!(mask & PAINT_SCREEN_TRANSFORMED) && windows.contains(w)) {
-        WindowWobblyInfos& wwi = windows[w];
-        int tx = w->geometry().x();
-        int ty = w->geometry().y();
+        const WindowWobblyInfos& wwi = windows[w];
+        const int tx = w->geometry().x();
+        const int ty = w->geometry().y();
+        const int vertexCount = data.quads.count() * 4;
+        m_vertexX.resize(vertexCount);
+        m_vertexY.resize(vertexCount);
+        float *x = m_vertexX.data();
+        float *y = m_vertexY.data();
+        for (int i = 0; i < data.quads.count(); ++i) {
+            for (int j = 0; j < 4; ++j) {
+                const WindowVertex& v = data.quads[i][j];
+                x[i * 4 + j] = tx + v.x();
+                y[i * 4 + j] = ty + v.y();
+            }
+        }
+
+        computeBezierPoints(wwi, x, y, vertexCount);
+
         double left = 0.0;
         double top = 0.0;
         double right = w->width();
@@ -281,14 +295,12 @@ void WobblyWindowsEffect::paintWindow(EffectWindow* w, int mask, QRegion region,
         for (int i = 0; i < data.quads.count(); ++i) {
             for (int j = 0; j < 4; ++j) {
                 WindowVertex& v = data.quads[i][j];
-                Pair oldPos = {tx + v.x(), ty + v.y()};
-                Pair newPos = computeBezierPoint(wwi, oldPos);
-                v.move(newPos.x - tx, newPos.y - ty);
+                v.move(x[i * 4 + j] - tx, y[i * 4 + j] - ty);
+                left   = qMin(left,   v.x());
+                top    = qMin(top,    v.y());
+                right  = qMax(right,  v.x());
+                bottom = qMax(bottom, v.y());
             }
-            left   = qMin(left,   data.quads[i].left());
-            top    = qMin(top,    data.quads[i].top());
-            right  = qMax(right,  data.quads[i].right());
-            bottom = qMax(bottom, data.quads[i].bottom());
         }
         QRectF dirtyRect(
             left * data.xScale() + w->x() + data.xTranslation(),
@@ -385,19 +397,19 @@ void WobblyWindowsEffect::startMovedResized(EffectWindow* w)
     wwi.status = Moving;
     const QRectF& rect = w->geometry();
 
-    qreal x_increment = rect.width() / (wwi.width - 1.0);
-    qreal y_increment = rect.height() / (wwi.height - 1.0);
+    qreal x_increment = rect.width() / (GridSize - 1.0);
+    qreal y_increment = rect.height() / (GridSize - 1.0);
 
     Pair picked = {static_cast<qreal>(cursorPos().x()), static_cast<qreal>(cursorPos().y())};
     int indx = (picked.x - rect.x()) / x_increment + 0.5;
     int indy = (picked.y - rect.y()) / y_increment + 0.5;
-    int pickedPointIndex = indy * wwi.width + indx;
+    int pickedPointIndex = indy * GridSize + indx;
     if (pickedPointIndex < 0) {
         qCDebug(KWINEFFECTS) << "Picked index == " << pickedPointIndex << " with (" << cursorPos().x() << "," << cursorPos().y() << ")";
         pickedPointIndex = 0;
-    } else if (static_cast<unsigned int>(pickedPointIndex) > wwi.count - 1) {
+    } else if (pickedPointIndex > NodeCount - 1) {
         qCDebug(KWINEFFECTS) << "Picked index == " << pickedPointIndex << " with (" << cursorPos().x() << "," << cursorPos().y() << ")";
-        pickedPointIndex = wwi.count - 1;
+        pickedPointIndex = NodeCount - 1;
     }
 #if defined VERBOSE_MODE
     qCDebug(KWINEFFECTS) << "Original Picked point -- x : " << picked.x << " - y : " << picked.y;
@@ -430,433 +442,239 @@ void WobblyWindowsEffect::stepMovedResized(EffectWindow* w)
     bool throb_direction_out = (new_geometry.top() == maximized_area.top() && new_geometry.bottom() == maximized_area.bottom()) ||
                                (new_geometry.left() == maximized_area.left() && new_geometry.right() == maximized_area.right());
     qreal magnitude = throb_direction_out ? 10 : -30; // a small throb out when maximized, a larger throb inwards when restored
-    for (unsigned int j = 0; j < wwi.height; ++j) {
-        for (unsigned int i = 0; i < wwi.width; ++i) {
-            Pair v = { magnitude*(i / qreal(wwi.width - 1) - 0.5), magnitude*(j / qreal(wwi.height - 1) - 0.5) };
-            wwi.velocity[j*wwi.width+i] = v;
+    for (int j = 0; j < GridSize; ++j) {
+        for (int i = 0; i < GridSize; ++i) {
+            wwi.velocity.x[j*GridSize+i] = magnitude*(i / qreal(GridSize - 1) - 0.5);
+            wwi.velocity.y[j*GridSize+i] = magnitude*(j / qreal(GridSize - 1) - 0.5);
         }
     }
 
     // constrain the middle of the window, so that any asymetry wont cause it to drift off-center
-    for (unsigned int j = 1; j < wwi.height - 1; ++j) {
-        for (unsigned int i = 1; i < wwi.width - 1; ++i) {
-            wwi.constraint[j*wwi.width+i] = true;
+    for (int j = 1; j < GridSize - 1; ++j) {
+        for (int i = 1; i < GridSize - 1; ++i) {
+            wwi.constraint[j*GridSize+i] = true;
         }
     }
 }
 
-void WobblyWindowsEffect::initWobblyInfo(WindowWobblyInfos& wwi, QRect geometry) const
+namespace
 {
-    wwi.count = 4 * 4;
-    wwi.width = 4;
-    wwi.height = 4;
-
-    wwi.bezierWidth = m_xTesselation;
-    wwi.bezierHeight = m_yTesselation;
-    wwi.bezierCount = m_xTesselation * m_yTesselation;
 
-    wwi.origin = new Pair[wwi.count];
-    wwi.position = new Pair[wwi.count];
-    wwi.velocity = new Pair[wwi.count];
-    wwi.acceleration = new Pair[wwi.count];
-    wwi.buffer = new Pair[wwi.count];
-    wwi.constraint = new bool[wwi.count];
+const int GridSize = WobblyWindowsEffect::GridSize;
+const int NodeCount = WobblyWindowsEffect::NodeCount;
 
-    wwi.bezierSurface = new Pair[wwi.bezierCount];
+// the nodes of the mesh spread evenly over the rectangle, the last row and column lie exactly on its edges
+static void computeGrid(const QRectF& rect, float* x, float* y)
+{
+    const qreal x_length = rect.width() / (GridSize - 1.0);
+    const qreal y_length = rect.height() / (GridSize - 1.0);
+
+    for (int j = 0; j < GridSize; ++j) {
+        const qreal rowY = j != GridSize - 1 ? rect.y() + j * y_length : rect.y() + rect.height();
+        for (int i = 0; i < GridSize; ++i) {
+            const qreal columnX = i != GridSize - 1 ? rect.x() + i * x_length : rect.x() + rect.width();
+            x[j * GridSize + i] = columnX;
+            y[j * GridSize + i] = rowY;
+        }
+    }
+}
 
-    wwi.status = Moving;
+/**
+ * A linear combination of every node of the mesh with its neighbours. The weights are
+ * indexed by source node first, applying the stencil is then a sequence of loops over all
+ * target nodes without any branches or reductions, which the compiler can vectorize.
+ */
+struct MeshStencil {
+    alignas(16) float weights[NodeCount][NodeCount];
+};
 
-    qreal x = geometry.x(), y = geometry.y();
-    qreal width = geometry.width(), height = geometry.height();
-
-    Pair initValue = {x, y};
-    static const Pair nullPair = {0.0, 0.0};
-
-    qreal x_increment = width / (wwi.width - 1.0);
-    qreal y_increment = height / (wwi.height - 1.0);
-
-    for (unsigned int j = 0; j < 4; ++j) {
-        for (unsigned int i = 0; i < 4; ++i) {
-            unsigned int idx = j * 4 + i;
-            wwi.origin[idx] = initValue;
-            wwi.position[idx] = initValue;
-            wwi.velocity[idx] = nullPair;
-            wwi.constraint[idx] = false;
-            if (i != 4 - 2) { // x grid count - 2, i.e. not the last point
-                initValue.x += x_increment;
-            } else {
-                initValue.x = width + x;
+// @p selfWeight is the weight of the node itself, @p meanWeight the one of the mean of its
+// direct neighbours and, if @p diagonals is true, also its diagonal neighbours
+static MeshStencil buildStencil(bool diagonals, float selfWeight, float meanWeight)
+{
+    MeshStencil stencil;
+    std::fill(&stencil.weights[0][0], &stencil.weights[0][0] + NodeCount * NodeCount, 0.0f);
+
+    for (int j = 0; j < GridSize; ++j) {
+        for (int i = 0; i < GridSize; ++i) {
+            const int target = j * GridSize + i;
+            QVarLengthArray<int, 8> neighbours;
+            for (int dy = -1; dy <= 1; ++dy) {
+                for (int dx = -1; dx <= 1; ++dx) {
+                    if ((dx == 0 && dy == 0) || (!diagonals && dx != 0 && dy != 0)) {
+                        continue;
+                    }
+                    if (i + dx < 0 || i + dx >= GridSize || j + dy < 0 || j + dy >= GridSize) {
+                        continue;
+                    }
+                    neighbours.append((j + dy) * GridSize + i + dx);
+                }
             }
-            initValue.x = initValue.x;
-        }
-        initValue.x = x;
-        initValue.x = initValue.x;
-        if (j != 4 - 2) { // y grid count - 2, i.e. not the last point
-            initValue.y += y_increment;
-        } else {
-            initValue.y = height + y;
+            for (int source : neighbours) {
+                stencil.weights[source][target] = meanWeight / neighbours.count();
+            }
+            stencil.weights[target][target] = selfWeight;
         }
-        initValue.y = initValue.y;
     }
+    return stencil;
 }
 
-void WobblyWindowsEffect::freeWobblyInfo(WindowWobblyInfos& wwi) const
-{
-    delete[] wwi.origin;
-    delete[] wwi.position;
-    delete[] wwi.velocity;
-    delete[] wwi.acceleration;
-    delete[] wwi.buffer;
-    delete[] wwi.constraint;
-
-    delete[] wwi.bezierSurface;
-}
+// the springs pull every node towards the mean of its direct neighbours, relative to where
+// they are on the window
+static const MeshStencil s_springStencil = buildStencil(false, -1.0f, 1.0f);
+// the ring mean smoothes values with all surrounding nodes
+static const MeshStencil s_ringMeanStencil = buildStencil(true, 0.5f, 0.5f);
 
-WobblyWindowsEffect::Pair WobblyWindowsEffect::computeBezierPoint(const WindowWobblyInfos& wwi, Pair point) const
+static inline void applyStencil(const MeshStencil& stencil, const float* in, float* out)
 {
-    // compute the input value
-    Pair topleft = wwi.origin[0];
-    Pair bottomright = wwi.origin[wwi.count-1];
-
-    qreal tx = (point.x - topleft.x) / (bottomright.x - topleft.x);
-    qreal ty = (point.y - topleft.y) / (bottomright.y - topleft.y);
-
-    // compute polynomial coeff
-
-    qreal px[4];
-    px[0] = (1 - tx) * (1 - tx) * (1 - tx);
-    px[1] = 3 * (1 - tx) * (1 - tx) * tx;
-    px[2] = 3 * (1 - tx) * tx * tx;
-    px[3] = tx * tx * tx;
-
-    qreal py[4];
-    py[0] = (1 - ty) * (1 - ty) * (1 - ty);
-    py[1] = 3 * (1 - ty) * (1 - ty) * ty;
-    py[2] = 3 * (1 - ty) * ty * ty;
-    py[3] = ty * ty * ty;
-
-    Pair res = {0.0, 0.0};
-
-    for (unsigned int j = 0; j < 4; ++j) {
-        for (unsigned int i = 0; i < 4; ++i) {
-            // this assume the grid is 4*4
-            res.x += px[i] * py[j] * wwi.position[i + j * wwi.width].x;
-            res.y += px[i] * py[j] * wwi.position[i + j * wwi.width].y;
+    std::fill(out, out + NodeCount, 0.0f);
+    for (int source = 0; source < NodeCount; ++source) {
+        const float value = in[source];
+        const float* weights = stencil.weights[source];
+        for (int target = 0; target < NodeCount; ++target) {
+            out[target] += weights[target] * value;
         }
     }
-
-    return res;
 }
 
-namespace
+static inline float fixBounds(float value, float min, float max)
 {
+    const float magnitude = std::fabs(value);
+    return magnitude < min ? 0.0f : (magnitude > max ? std::copysign(max, value) : value);
+}
 
-static inline void fixVectorBounds(WobblyWindowsEffect::Pair& vec, qreal min, qreal max)
+static inline void fixVectorBounds(float* values, float min, float max)
 {
-    if (fabs(vec.x) < min) {
-        vec.x = 0.0;
-    } else if (fabs(vec.x) > max) {
-        if (vec.x > 0.0) {
-            vec.x = max;
-        } else {
-            vec.x = -max;
-        }
+    for (int i = 0; i < NodeCount; ++i) {
+        values[i] = fixBounds(values[i], min, max);
     }
+}
 
-    if (fabs(vec.y) < min) {
-        vec.y = 0.0;
-    } else if (fabs(vec.y) > max) {
-        if (vec.y > 0.0) {
-            vec.y = max;
-        } else {
-            vec.y = -max;
-        }
+static inline qreal magnitudeSum(const float* x, const float* y)
+{
+    qreal sum = 0.0;
+    for (int i = 0; i < NodeCount; ++i) {
+        sum += std::fabs(x[i]) + std::fabs(y[i]);
     }
+    return sum;
 }
 
 #if defined COMPUTE_STATS
-static inline void computeVectorBounds(WobblyWindowsEffect::Pair& vec, WobblyWindowsEffect::Pair& bound)
+static inline void computeVectorBounds(const float* values, WobblyWindowsEffect::Pair& bound)
 {
-    if (fabs(vec.x) < bound.x) {
-        bound.x = fabs(vec.x);
-    } else if (fabs(vec.x) > bound.y) {
-        bound.y = fabs(vec.x);
-    }
-    if (fabs(vec.y) < bound.x) {
-        bound.x = fabs(vec.y);
-    } else if (fabs(vec.y) > bound.y) {
-        bound.y = fabs(vec.y);
+    for (int i = 0; i < NodeCount; ++i) {
+        if (fabs(values[i]) < bound.x) {
+            bound.x = fabs(values[i]);
+        } else if (fabs(values[i]) > bound.y) {
+            bound.y = fabs(values[i]);
+        }
     }
 }
 #endif
 
 } // close the anonymous namespace
 
-bool WobblyWindowsEffect::updateWindowWobblyDatas(EffectWindow* w, qreal time)
+void WobblyWindowsEffect::initWobblyInfo(WindowWobblyInfos& wwi, QRect geometry) const
 {
-    QRectF rect = w->geometry();
-    WindowWobblyInfos& wwi = windows[w];
+    wwi.status = Moving;
 
-    qreal x_length = rect.width() / (wwi.width - 1.0);
-    qreal y_length = rect.height() / (wwi.height - 1.0);
+    computeGrid(geometry, wwi.origin.x, wwi.origin.y);
+    wwi.position = wwi.origin;
+    std::fill(wwi.velocity.x, wwi.velocity.x + NodeCount, 0.0f);
+    std::fill(wwi.velocity.y, wwi.velocity.y + NodeCount, 0.0f);
+    std::fill(wwi.acceleration.x, wwi.acceleration.x + NodeCount, 0.0f);
+    std::fill(wwi.acceleration.y, wwi.acceleration.y + NodeCount, 0.0f);
+    std::fill(wwi.constraint, wwi.constraint + NodeCount, false);
+}
 
-#if defined VERBOSE_MODE
-    qCDebug(KWINEFFECTS) << "time " << time;
-    qCDebug(KWINEFFECTS) << "increment x " << x_length << " // y" <<  y_length;
-#endif
+void WobblyWindowsEffect::computeBezierPoints(const WindowWobblyInfos& wwi, float* x, float* y, int count)
+{
+    static_assert(GridSize == 4, "the bezier surface is bicubic");
+    // the points are evaluated in batches small enough for the weights to stay in the cache
+    const int batchSize = 64;
 
-    Pair origine = {rect.x(), rect.y()};
+    // compute the input value
+    const float left = wwi.origin.x[0];
+    const float top = wwi.origin.y[0];
+    const float width = wwi.origin.x[NodeCount - 1] - left;
+    const float height = wwi.origin.y[NodeCount - 1] - top;
+
+    alignas(16) float px[GridSize][batchSize];
+    alignas(16) float py[GridSize][batchSize];
+
+    for (int first = 0; first < count; first += batchSize) {
+        const int n = std::min(batchSize, count - first);
+        float* bx = x + first;
+        float* by = y + first;
+
+        // compute polynomial coeff
+        for (int k = 0; k < n; ++k) {
+            const float tx = (bx[k] - left) / width;
+            const float ty = (by[k] - top) / height;
+            px[0][k] = (1 - tx) * (1 - tx) * (1 - tx);
+            px[1][k] = 3 * (1 - tx) * (1 - tx) * tx;
+            px[2][k] = 3 * (1 - tx) * tx * tx;
+            px[3][k] = tx * tx * tx;
+            py[0][k] = (1 - ty) * (1 - ty) * (1 - ty);
+            py[1][k] = 3 * (1 - ty) * (1 - ty) * ty;
+            py[2][k] = 3 * (1 - ty) * ty * ty;
+            py[3][k] = ty * ty * ty;
+            bx[k] = 0.0f;
+            by[k] = 0.0f;
+        }
 
-    for (unsigned int j = 0; j < wwi.height; ++j) {
-        for (unsigned int i = 0; i < wwi.width; ++i) {
-            wwi.origin[wwi.width*j + i] = origine;
-            if (i != wwi.width - 2) {
-                origine.x += x_length;
-            } else {
-                origine.x = rect.width() + rect.x();
+        // blend the bezier curves of the rows of control points
+        for (int j = 0; j < GridSize; ++j) {
+            const float* cx = wwi.position.x + j * GridSize;
+            const float* cy = wwi.position.y + j * GridSize;
+            for (int k = 0; k < n; ++k) {
+                const float rowX = px[0][k] * cx[0] + px[1][k] * cx[1] + px[2][k] * cx[2] + px[3][k] * cx[3];
+                const float rowY = px[0][k] * cy[0] + px[1][k] * cy[1] + px[2][k] * cy[2] + px[3][k] * cy[3];
+                bx[k] += py[j][k] * rowX;
+                by[k] += py[j][k] * rowY;
             }
         }
-        origine.x = rect.x();
-        if (j != wwi.height - 2) {
-            origine.y += y_length;
-        } else {
-            origine.y = rect.height() + rect.y();
-        }
-    }
-
-    Pair neibourgs[4];
-    Pair acceleration;
-
-    qreal acc_sum = 0.0;
-    qreal vel_sum = 0.0;
-
-    // compute acceleration, velocity and position for each point
-
-    // for corners
-
-    // top-left
-
-    if (wwi.constraint[0]) {
-        Pair window_pos = wwi.origin[0];
-        Pair current_pos = wwi.position[0];
-        Pair move = {window_pos.x - current_pos.x, window_pos.y - current_pos.y};
-        Pair accel = {move.x*m_stiffness, move.y*m_stiffness};
-        wwi.acceleration[0] = accel;
-    } else {
-        Pair& pos = wwi.position[0];
-        neibourgs[0] = wwi.position[1];
-        neibourgs[1] = wwi.position[wwi.width];
-
-        acceleration.x = ((neibourgs[0].x - pos.x) - x_length) * m_stiffness + (neibourgs[1].x - pos.x) * m_stiffness;
-        acceleration.y = ((neibourgs[1].y - pos.y) - y_length) * m_stiffness + (neibourgs[0].y - pos.y) * m_stiffness;
-
-        acceleration.x /= 2;
-        acceleration.y /= 2;
-
-        wwi.acceleration[0] = acceleration;
     }
+}
 
-    // top-right
-
-    if (wwi.constraint[wwi.width-1]) {
-        Pair window_pos = wwi.origin[wwi.width-1];
-        Pair current_pos = wwi.position[wwi.width-1];
-        Pair move = {window_pos.x - current_pos.x, window_pos.y - current_pos.y};
-        Pair accel = {move.x*m_stiffness, move.y*m_stiffness};
-        wwi.acceleration[wwi.width-1] = accel;
-    } else {
-        Pair& pos = wwi.position[wwi.width-1];
-        neibourgs[0] = wwi.position[wwi.width-2];
-        neibourgs[1] = wwi.position[2*wwi.width-1];
-
-        acceleration.x = (x_length - (pos.x - neibourgs[0].x)) * m_stiffness + (neibourgs[1].x - pos.x) * m_stiffness;
-        acceleration.y = ((neibourgs[1].y - pos.y) - y_length) * m_stiffness + (neibourgs[0].y - pos.y) * m_stiffness;
-
-        acceleration.x /= 2;
-        acceleration.y /= 2;
-
-        wwi.acceleration[wwi.width-1] = acceleration;
-    }
-
-    // bottom-left
-
-    if (wwi.constraint[wwi.width*(wwi.height-1)]) {
-        Pair window_pos = wwi.origin[wwi.width*(wwi.height-1)];
-        Pair current_pos = wwi.position[wwi.width*(wwi.height-1)];
-        Pair move = {window_pos.x - current_pos.x, window_pos.y - current_pos.y};
-        Pair accel = {move.x*m_stiffness, move.y*m_stiffness};
-        wwi.acceleration[wwi.width*(wwi.height-1)] = accel;
-    } else {
-        Pair& pos = wwi.position[wwi.width*(wwi.height-1)];
-        neibourgs[0] = wwi.position[wwi.width*(wwi.height-1)+1];
-        neibourgs[1] = wwi.position[wwi.width*(wwi.height-2)];
-
-        acceleration.x = ((neibourgs[0].x - pos.x) - x_length) * m_stiffness + (neibourgs[1].x - pos.x) * m_stiffness;
-        acceleration.y = (y_length - (pos.y - neibourgs[1].y)) * m_stiffness + (neibourgs[0].y - pos.y) * m_stiffness;
-
-        acceleration.x /= 2;
-        acceleration.y /= 2;
-
-        wwi.acceleration[wwi.width*(wwi.height-1)] = acceleration;
-    }
-
-    // bottom-right
-
-    if (wwi.constraint[wwi.count-1]) {
-        Pair window_pos = wwi.origin[wwi.count-1];
-        Pair current_pos = wwi.position[wwi.count-1];
-        Pair move = {window_pos.x - current_pos.x, window_pos.y - current_pos.y};
-        Pair accel = {move.x*m_stiffness, move.y*m_stiffness};
-        wwi.acceleration[wwi.count-1] = accel;
-    } else {
-        Pair& pos = wwi.position[wwi.count-1];
-        neibourgs[0] = wwi.position[wwi.count-2];
-        neibourgs[1] = wwi.position[wwi.width*(wwi.height-1)-1];
-
-        acceleration.x = (x_length - (pos.x - neibourgs[0].x)) * m_stiffness + (neibourgs[1].x - pos.x) * m_stiffness;
-        acceleration.y = (y_length - (pos.y - neibourgs[1].y)) * m_stiffness + (neibourgs[0].y - pos.y) * m_stiffness;
-
-        acceleration.x /= 2;
-        acceleration.y /= 2;
-
-        wwi.acceleration[wwi.count-1] = acceleration;
-    }
+bool WobblyWindowsEffect::updateWindowWobblyDatas(EffectWindow* w, qreal time)
+{
+    QRectF rect = w->geometry();
+    WindowWobblyInfos& wwi = windows[w];
 
+#if defined VERBOSE_MODE
+    qCDebug(KWINEFFECTS) << "time " << time;
+    qCDebug(KWINEFFECTS) << "increment x " << rect.width() / (GridSize - 1.0) << " // y" <<  rect.height() / (GridSize - 1.0);
+#endif
 
-    // for borders
+    computeGrid(rect, wwi.origin.x, wwi.origin.y);
 
-    // top border
-    for (unsigned int i = 1; i < wwi.width - 1; ++i) {
-        if (wwi.constraint[i]) {
-            Pair window_pos = wwi.origin[i];
-            Pair current_pos = wwi.position[i];
-            Pair move = {window_pos.x - current_pos.x, window_pos.y - current_pos.y};
-            Pair accel = {move.x*m_stiffness, move.y*m_stiffness};
-            wwi.acceleration[i] = accel;
-        } else {
-            Pair& pos = wwi.position[i];
-            neibourgs[0] = wwi.position[i-1];
-            neibourgs[1] = wwi.position[i+1];
-            neibourgs[2] = wwi.position[i+wwi.width];
-
-            acceleration.x = (x_length - (pos.x - neibourgs[0].x)) * m_stiffness + ((neibourgs[1].x - pos.x) - x_length) * m_stiffness + (neibourgs[2].x - pos.x) * m_stiffness;
-            acceleration.y = ((neibourgs[2].y - pos.y) - y_length) * m_stiffness + (neibourgs[0].y - pos.y) * m_stiffness + (neibourgs[1].y - pos.y) * m_stiffness;
-
-            acceleration.x /= 3;
-            acceleration.y /= 3;
-
-            wwi.acceleration[i] = acceleration;
-        }
-    }
+    const float stiffness = m_stiffness;
+    const float drag = m_drag;
+    const float step = time;
+    const float move = time * m_move_factor;
 
-    // bottom border
-    for (unsigned int i = wwi.width * (wwi.height - 1) + 1; i < wwi.count - 1; ++i) {
-        if (wwi.constraint[i]) {
-            Pair window_pos = wwi.origin[i];
-            Pair current_pos = wwi.position[i];
-            Pair move = {window_pos.x - current_pos.x, window_pos.y - current_pos.y};
-            Pair accel = {move.x*m_stiffness, move.y*m_stiffness};
-            wwi.acceleration[i] = accel;
-        } else {
-            Pair& pos = wwi.position[i];
-            neibourgs[0] = wwi.position[i-1];
-            neibourgs[1] = wwi.position[i+1];
-            neibourgs[2] = wwi.position[i-wwi.width];
-
-            acceleration.x = (x_length - (pos.x - neibourgs[0].x)) * m_stiffness + ((neibourgs[1].x - pos.x) - x_length) * m_stiffness + (neibourgs[2].x - pos.x) * m_stiffness;
-            acceleration.y = (y_length - (pos.y - neibourgs[2].y)) * m_stiffness + (neibourgs[0].y - pos.y) * m_stiffness + (neibourgs[1].y - pos.y) * m_stiffness;
-
-            acceleration.x /= 3;
-            acceleration.y /= 3;
-
-            wwi.acceleration[i] = acceleration;
-        }
-    }
+    // compute acceleration, velocity and position for each point
 
-    // left border
-    for (unsigned int i = wwi.width; i < wwi.width*(wwi.height - 1); i += wwi.width) {
-        if (wwi.constraint[i]) {
-            Pair window_pos = wwi.origin[i];
-            Pair current_pos = wwi.position[i];
-            Pair move = {window_pos.x - current_pos.x, window_pos.y - current_pos.y};
-            Pair accel = {move.x*m_stiffness, move.y*m_stiffness};
-            wwi.acceleration[i] = accel;
-        } else {
-            Pair& pos = wwi.position[i];
-            neibourgs[0] = wwi.position[i+1];
-            neibourgs[1] = wwi.position[i-wwi.width];
-            neibourgs[2] = wwi.position[i+wwi.width];
-
-            acceleration.x = ((neibourgs[0].x - pos.x) - x_length) * m_stiffness + (neibourgs[1].x - pos.x) * m_stiffness + (neibourgs[2].x - pos.x) * m_stiffness;
-            acceleration.y = (y_length - (pos.y - neibourgs[1].y)) * m_stiffness + ((neibourgs[2].y - pos.y) - y_length) * m_stiffness + (neibourgs[0].y - pos.y) * m_stiffness;
-
-            acceleration.x /= 3;
-            acceleration.y /= 3;
-
-            wwi.acceleration[i] = acceleration;
-        }
+    // the springs act on the offset of the nodes from their place on the window
+    NodeVectors offset;
+    for (int i = 0; i < NodeCount; ++i) {
+        offset.x[i] = wwi.position.x[i] - wwi.origin.x[i];
+        offset.y[i] = wwi.position.y[i] - wwi.origin.y[i];
     }
 
-    // right border
-    for (unsigned int i = 2 * wwi.width - 1; i < wwi.count - 1; i += wwi.width) {
-        if (wwi.constraint[i]) {
-            Pair window_pos = wwi.origin[i];
-            Pair current_pos = wwi.position[i];
-            Pair move = {window_pos.x - current_pos.x, window_pos.y - current_pos.y};
-            Pair accel = {move.x*m_stiffness, move.y*m_stiffness};
-            wwi.acceleration[i] = accel;
-        } else {
-            Pair& pos = wwi.position[i];
-            neibourgs[0] = wwi.position[i-1];
-            neibourgs[1] = wwi.position[i-wwi.width];
-            neibourgs[2] = wwi.position[i+wwi.width];
-
-            acceleration.x = (x_length - (pos.x - neibourgs[0].x)) * m_stiffness + (neibourgs[1].x - pos.x) * m_stiffness + (neibourgs[2].x - pos.x) * m_stiffness;
-            acceleration.y = (y_length - (pos.y - neibourgs[1].y)) * m_stiffness + ((neibourgs[2].y - pos.y) - y_length) * m_stiffness + (neibourgs[0].y - pos.y) * m_stiffness;
-
-            acceleration.x /= 3;
-            acceleration.y /= 3;
-
-            wwi.acceleration[i] = acceleration;
-        }
-    }
+    NodeVectors buffer;
+    applyStencil(s_springStencil, offset.x, buffer.x);
+    applyStencil(s_springStencil, offset.y, buffer.y);
 
-    // for the inner points
-    for (unsigned int j = 1; j < wwi.height - 1; ++j) {
-        for (unsigned int i = 1; i < wwi.width - 1; ++i) {
-            unsigned int index = i + j * wwi.width;
-
-            if (wwi.constraint[index]) {
-                Pair window_pos = wwi.origin[index];
-                Pair current_pos = wwi.position[index];
-                Pair move = {window_pos.x - current_pos.x, window_pos.y - current_pos.y};
-                Pair accel = {move.x*m_stiffness, move.y*m_stiffness};
-                wwi.acceleration[index] = accel;
-            } else {
-                Pair& pos = wwi.position[index];
-                neibourgs[0] = wwi.position[index-1];
-                neibourgs[1] = wwi.position[index+1];
-                neibourgs[2] = wwi.position[index-wwi.width];
-                neibourgs[3] = wwi.position[index+wwi.width];
-
-                acceleration.x = ((neibourgs[0].x - pos.x) - x_length) * m_stiffness +
-                                 (x_length - (pos.x - neibourgs[1].x)) * m_stiffness +
-                                 (neibourgs[2].x - pos.x) * m_stiffness +
-                                 (neibourgs[3].x - pos.x) * m_stiffness;
-                acceleration.y = (y_length - (pos.y - neibourgs[2].y)) * m_stiffness +
-                                 ((neibourgs[3].y - pos.y) - y_length) * m_stiffness +
-                                 (neibourgs[0].y - pos.y) * m_stiffness +
-                                 (neibourgs[1].y - pos.y) * m_stiffness;
-
-                acceleration.x /= 4;
-                acceleration.y /= 4;
-
-                wwi.acceleration[index] = acceleration;
-            }
-        }
+    // a constrained node is only pulled back to its place on the window
+    for (int i = 0; i < NodeCount; ++i) {
+        buffer.x[i] = stiffness * (wwi.constraint[i] ? -offset.x[i] : buffer.x[i]);
+        buffer.y[i] = stiffness * (wwi.constraint[i] ? -offset.y[i] : buffer.y[i]);
     }
 
-    heightRingLinearMean(&wwi.acceleration, wwi);
+    applyStencil(s_ringMeanStencil, buffer.x, wwi.acceleration.x);
+    applyStencil(s_ringMeanStencil, buffer.y, wwi.acceleration.y);
 
 #if defined COMPUTE_STATS
     Pair accBound = {m_maxAcceleration, m_minAcceleration};
@@ -864,64 +682,56 @@ bool WobblyWindowsEffect::updateWindowWobblyDatas(EffectWindow* w, qreal time)
 #endif
 
     // compute the new velocity of each vertex.
-    for (unsigned int i = 0; i < wwi.count; ++i) {
-        Pair acc = wwi.acceleration[i];
-        fixVectorBounds(acc, m_minAcceleration, m_maxAcceleration);
-
+    fixVectorBounds(wwi.acceleration.x, m_minAcceleration, m_maxAcceleration);
+    fixVectorBounds(wwi.acceleration.y, m_minAcceleration, m_maxAcceleration);
 #if defined COMPUTE_STATS
-        computeVectorBounds(acc, accBound);
+    computeVectorBounds(wwi.acceleration.x, accBound);
+    computeVectorBounds(wwi.acceleration.y, accBound);
 #endif
 
-        Pair& vel = wwi.velocity[i];
-        vel.x = acc.x * time + vel.x * m_drag;
-        vel.y = acc.y * time + vel.y * m_drag;
-
-        acc_sum += fabs(acc.x) + fabs(acc.y);
+    for (int i = 0; i < NodeCount; ++i) {
+        buffer.x[i] = wwi.acceleration.x[i] * step + wwi.velocity.x[i] * drag;
+        buffer.y[i] = wwi.acceleration.y[i] * step + wwi.velocity.y[i] * drag;
     }
 
-    heightRingLinearMean(&wwi.velocity, wwi);
+    applyStencil(s_ringMeanStencil, buffer.x, wwi.velocity.x);
+    applyStencil(s_ringMeanStencil, buffer.y, wwi.velocity.y);
 
     // compute the new pos of each vertex.
-    for (unsigned int i = 0; i < wwi.count; ++i) {
-        Pair& pos = wwi.position[i];
-        Pair& vel = wwi.velocity[i];
-
-        fixVectorBounds(vel, m_minVelocity, m_maxVelocity);
+    fixVectorBounds(wwi.velocity.x, m_minVelocity, m_maxVelocity);
+    fixVectorBounds(wwi.velocity.y, m_minVelocity, m_maxVelocity);
 #if defined COMPUTE_STATS
-        computeVectorBounds(vel, velBound);
+    computeVectorBounds(wwi.velocity.x, velBound);
+    computeVectorBounds(wwi.velocity.y, velBound);
 #endif
 
-        pos.x += vel.x * time * m_move_factor;
-        pos.y += vel.y * time * m_move_factor;
-
-        vel_sum += fabs(vel.x) + fabs(vel.y);
+    for (int i = 0; i < NodeCount; ++i) {
+        wwi.position.x[i] += wwi.velocity.x[i] * move;
+        wwi.position.y[i] += wwi.velocity.y[i] * move;
+    }
 
 #if defined VERBOSE_MODE
+    for (int i = 0; i < NodeCount; ++i) {
         if (wwi.constraint[i]) {
-            qCDebug(KWINEFFECTS) << "Constraint point ** vel : " << vel.x << "," << vel.y << " ** move : " << vel.x*time << "," << vel.y*time;
+            qCDebug(KWINEFFECTS) << "Constraint point ** vel : " << wwi.velocity.x[i] << "," << wwi.velocity.y[i]
+                                 << " ** move : " << wwi.velocity.x[i]*time << "," << wwi.velocity.y[i]*time;
         }
-#endif
     }
+#endif
 
-    if (!wwi.can_wobble_top) {
-        for (unsigned int i = 0; i < wwi.width; ++i)
-            for (unsigned j = 0; j < wwi.width - 1; ++j)
-                wwi.position[i+wwi.width*j].y = wwi.origin[i+wwi.width*j].y;
-    }
-    if (!wwi.can_wobble_bottom) {
-        for (unsigned int i = wwi.width * (wwi.height - 1); i < wwi.count; ++i)
-            for (unsigned j = 0; j < wwi.width - 1; ++j)
-                wwi.position[i-wwi.width*j].y = wwi.origin[i-wwi.width*j].y;
-    }
-    if (!wwi.can_wobble_left) {
-        for (unsigned int i = 0; i < wwi.count; i += wwi.width)
-            for (unsigned j = 0; j < wwi.width - 1; ++j)
-                wwi.position[i+j].x = wwi.origin[i+j].x;
-    }
-    if (!wwi.can_wobble_right) {
-        for (unsigned int i = wwi.width - 1; i < wwi.count; i += wwi.width)
-            for (unsigned j = 0; j < wwi.width - 1; ++j)
-                wwi.position[i-j].x = wwi.origin[i-j].x;
+    const qreal acc_sum = magnitudeSum(wwi.acceleration.x, wwi.acceleration.y);
+    const qreal vel_sum = magnitudeSum(wwi.velocity.x, wwi.velocity.y);
+
+    // sides which may not wobble keep all but the opposite row or column of nodes in place
+    for (int i = 0; i < NodeCount; ++i) {
+        const int row = i / GridSize;
+        const int column = i % GridSize;
+        if ((!wwi.can_wobble_top && row != GridSize - 1) || (!wwi.can_wobble_bottom && row != 0)) {
+            wwi.position.y[i] = wwi.origin.y[i];
+        }
+        if ((!wwi.can_wobble_left && column != GridSize - 1) || (!wwi.can_wobble_right && column != 0)) {
+            wwi.position.x[i] = wwi.origin.x[i];
+        }
     }
 
 #if defined VERBOSE_MODE
@@ -933,7 +743,6 @@ bool WobblyWindowsEffect::updateWindowWobblyDatas(EffectWindow* w, qreal time)
 #endif
 
     if (wwi.status != Moving && acc_sum < m_stopAcceleration && vel_sum < m_stopVelocity) {
-        freeWobblyInfo(wwi);
         windows.remove(w);
         if (windows.isEmpty())
             effects->addRepaintFull();
@@ -943,149 +752,6 @@ bool WobblyWindowsEffect::updateWindowWobblyDatas(EffectWindow* w, qreal time)
     return true;
 }
 
-void WobblyWindowsEffect::heightRingLinearMean(Pair** data_pointer, WindowWobblyInfos& wwi)
-{
-    Pair* data = *data_pointer;
-    Pair neibourgs[8];
-
-    // for corners
-
-    // top-left
-    {
-        Pair& res = wwi.buffer[0];
-        Pair vit = data[0];
-        neibourgs[0] = data[1];
-        neibourgs[1] = data[wwi.width];
-        neibourgs[2] = data[wwi.width+1];
-
-        res.x = (neibourgs[0].x + neibourgs[1].x + neibourgs[2].x + 3.0 * vit.x) / 6.0;
-        res.y = (neibourgs[0].y + neibourgs[1].y + neibourgs[2].y + 3.0 * vit.y) / 6.0;
-    }
-
-
-    // top-right
-    {
-        Pair& res = wwi.buffer[wwi.width-1];
-        Pair vit = data[wwi.width-1];
-        neibourgs[0] = data[wwi.width-2];
-        neibourgs[1] = data[2*wwi.width-1];
-        neibourgs[2] = data[2*wwi.width-2];
-
-        res.x = (neibourgs[0].x + neibourgs[1].x + neibourgs[2].x + 3.0 * vit.x) / 6.0;
-        res.y = (neibourgs[0].y + neibourgs[1].y + neibourgs[2].y + 3.0 * vit.y) / 6.0;
-    }
-
-
-    // bottom-left
-    {
-        Pair& res = wwi.buffer[wwi.width*(wwi.height-1)];
-        Pair vit = data[wwi.width*(wwi.height-1)];
-        neibourgs[0] = data[wwi.width*(wwi.height-1)+1];
-        neibourgs[1] = data[wwi.width*(wwi.height-2)];
-        neibourgs[2] = data[wwi.width*(wwi.height-2)+1];
-
-        res.x = (neibourgs[0].x + neibourgs[1].x + neibourgs[2].x + 3.0 * vit.x) / 6.0;
-        res.y = (neibourgs[0].y + neibourgs[1].y + neibourgs[2].y + 3.0 * vit.y) / 6.0;
-    }
-
-
-    // bottom-right
-    {
-        Pair& res = wwi.buffer[wwi.count-1];
-        Pair vit = data[wwi.count-1];
-        neibourgs[0] = data[wwi.count-2];
-        neibourgs[1] = data[wwi.width*(wwi.height-1)-1];
-        neibourgs[2] = data[wwi.width*(wwi.height-1)-2];
-
-        res.x = (neibourgs[0].x + neibourgs[1].x + neibourgs[2].x + 3.0 * vit.x) / 6.0;
-        res.y = (neibourgs[0].y + neibourgs[1].y + neibourgs[2].y + 3.0 * vit.y) / 6.0;
-    }
-
-
-    // for borders
-
-    // top border
-    for (unsigned int i = 1; i < wwi.width - 1; ++i) {
-        Pair& res = wwi.buffer[i];
-        Pair vit = data[i];
-        neibourgs[0] = data[i-1];
-        neibourgs[1] = data[i+1];
-        neibourgs[2] = data[i+wwi.width];
-        neibourgs[3] = data[i+wwi.width-1];
-        neibourgs[4] = data[i+wwi.width+1];
-
-        res.x = (neibourgs[0].x + neibourgs[1].x + neibourgs[2].x + neibourgs[3].x + neibourgs[4].x + 5.0 * vit.x) / 10.0;
-        res.y = (neibourgs[0].y + neibourgs[1].y + neibourgs[2].y + neibourgs[3].y + neibourgs[4].y + 5.0 * vit.y) / 10.0;
-    }
-
-    // bottom border
-    for (unsigned int i = wwi.width * (wwi.height - 1) + 1; i < wwi.count - 1; ++i) {
-        Pair& res = wwi.buffer[i];
-        Pair vit = data[i];
-        neibourgs[0] = data[i-1];
-        neibourgs[1] = data[i+1];
-        neibourgs[2] = data[i-wwi.width];
-        neibourgs[3] = data[i-wwi.width-1];
-        neibourgs[4] = data[i-wwi.width+1];
-
-        res.x = (neibourgs[0].x + neibourgs[1].x + neibourgs[2].x + neibourgs[3].x + neibourgs[4].x + 5.0 * vit.x) / 10.0;
-        res.y = (neibourgs[0].y + neibourgs[1].y + neibourgs[2].y + neibourgs[3].y + neibourgs[4].y + 5.0 * vit.y) / 10.0;
-    }
-
-    // left border
-    for (unsigned int i = wwi.width; i < wwi.width*(wwi.height - 1); i += wwi.width) {
-        Pair& res = wwi.buffer[i];
-        Pair vit = data[i];
-        neibourgs[0] = data[i+1];
-        neibourgs[1] = data[i-wwi.width];
-        neibourgs[2] = data[i+wwi.width];
-        neibourgs[3] = data[i-wwi.width+1];
-        neibourgs[4] = data[i+wwi.width+1];
-
-        res.x = (neibourgs[0].x + neibourgs[1].x + neibourgs[2].x + neibourgs[3].x + neibourgs[4].x + 5.0 * vit.x) / 10.0;
-        res.y = (neibourgs[0].y + neibourgs[1].y + neibourgs[2].y + neibourgs[3].y + neibourgs[4].y + 5.0 * vit.y) / 10.0;
-    }
-
-    // right border
-    for (unsigned int i = 2 * wwi.width - 1; i < wwi.count - 1; i += wwi.width) {
-        Pair& res = wwi.buffer[i];
-        Pair vit = data[i];
-        neibourgs[0] = data[i-1];
-        neibourgs[1] = data[i-wwi.width];
-        neibourgs[2] = data[i+wwi.width];
-        neibourgs[3] = data[i-wwi.width-1];
-        neibourgs[4] = data[i+wwi.width-1];
-
-        res.x = (neibourgs[0].x + neibourgs[1].x + neibourgs[2].x + neibourgs[3].x + neibourgs[4].x + 5.0 * vit.x) / 10.0;
-        res.y = (neibourgs[0].y + neibourgs[1].y + neibourgs[2].y + neibourgs[3].y + neibourgs[4].y + 5.0 * vit.y) / 10.0;
-    }
-
-    // for the inner points
-    for (unsigned int j = 1; j < wwi.height - 1; ++j) {
-        for (unsigned int i = 1; i < wwi.width - 1; ++i) {
-            unsigned int index = i + j * wwi.width;
-
-            Pair& res = wwi.buffer[index];
-            Pair& vit = data[index];
-            neibourgs[0] = data[index-1];
-            neibourgs[1] = data[index+1];
-            neibourgs[2] = data[index-wwi.width];
-            neibourgs[3] = data[index+wwi.width];
-            neibourgs[4] = data[index-wwi.width-1];
-            neibourgs[5] = data[index-wwi.width+1];
-            neibourgs[6] = data[index+wwi.width-1];
-            neibourgs[7] = data[index+wwi.width+1];
-
-            res.x = (neibourgs[0].x + neibourgs[1].x + neibourgs[2].x + neibourgs[3].x + neibourgs[4].x + neibourgs[5].x + neibourgs[6].x + neibourgs[7].x + 8.0 * vit.x) / 16.0;
-            res.y = (neibourgs[0].y + neibourgs[1].y + neibourgs[2].y + neibourgs[3].y + neibourgs[4].y + neibourgs[5].y + neibourgs[6].y + neibourgs[7].y + 8.0 * vit.y) / 16.0;
-        }
-    }
-
-    Pair* tmp = data;
-    *data_pointer = wwi.buffer;
-    wwi.buffer = tmp;
-}
-
 bool WobblyWindowsEffect::isActive() const
 {
     return !windows.isEmpty();
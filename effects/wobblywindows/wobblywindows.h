@@ -68,6 +68,12 @@ public:
         qreal y;
     };
 
+    // the spring mesh, its nodes are also the control points of a bicubic bezier surface
+    enum {
+        GridSize = 4,
+        NodeCount = GridSize * GridSize
+    };
+
     enum WindowStatus {
         Free,
         Moving,
@@ -127,25 +133,24 @@ private:
     void stepMovedResized(EffectWindow* w);
     bool updateWindowWobblyDatas(EffectWindow* w, qreal time);
 
+    /**
+     * One vector per node of the spring mesh, the components are kept in separate arrays
+     * so that the loops over all nodes can be vectorized.
+     */
+    struct NodeVectors {
+        alignas(16) float x[NodeCount];
+        alignas(16) float y[NodeCount];
+    };
+
     struct WindowWobblyInfos {
-        Pair* origin;
-        Pair* position;
-        Pair* velocity;
-        Pair* acceleration;
-        Pair* buffer;
+        NodeVectors origin;
+        NodeVectors position;
+        NodeVectors velocity;
+        NodeVectors acceleration;
 
         // if true, the physics system moves this point based only on it "normal" destination
         // given by the window position, ignoring neighbour points.
-        bool* constraint;
-
-        unsigned int width;
-        unsigned int height;
-        unsigned int count;
-
-        Pair* bezierSurface;
-        unsigned int bezierWidth;
-        unsigned int bezierHeight;
-        unsigned int bezierCount;
+        bool constraint[NodeCount];
 
         WindowStatus status;
 
@@ -178,12 +183,16 @@ private:
     bool m_moveWobble;
     bool m_resizeWobble;
 
-    void initWobblyInfo(WindowWobblyInfos& wwi, QRect geometry) const;
-    void freeWobblyInfo(WindowWobblyInfos& wwi) const;
+    // scratch buffers for the vertices deformed in paintWindow
+    QVector<float> m_vertexX;
+    QVector<float> m_vertexY;
 
-    WobblyWindowsEffect::Pair computeBezierPoint(const WindowWobblyInfos& wwi, Pair point) const;
+    void initWobblyInfo(WindowWobblyInfos& wwi, QRect geometry) const;
 
-    static void heightRingLinearMean(Pair** data_pointer, WindowWobblyInfos& wwi);
+    /**
+     * Moves the @p count points in @p x and @p y onto the bezier surface of @p wwi.
+     */
+    static void computeBezierPoints(const WindowWobblyInfos& wwi, float* x, float* y, int count);
 
     void setParameterSet(const ParameterSet& pset);
 };
@@ -28,6 +28,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <QStyle>
 #include <QVector2D>
 #include <QDBusConnection>
+#include <cmath>
 #include <kstandardaction.h>
 #include <KConfigGroup>
 #include <KGlobalAccel>
@@ -132,6 +133,7 @@ ZoomEffect::ZoomEffect()
     timeline.setFrameRange(0, 100);
     connect(&timeline, &QTimeLine::frameChanged, this, &ZoomEffect::timelineFrameChanged);
     connect(effects, &EffectsHandler::mouseChanged, this, &ZoomEffect::slotMouseChanged);
+    connect(effects, &EffectsHandler::windowDamaged, this, &ZoomEffect::slotWindowDamaged);
 
     source_zoom = -1; // used to trigger initialZoom reading
     reconfigure(ReconfigureAll);
@@ -263,12 +265,26 @@ void ZoomEffect::prePaintScreen(ScreenPrePaintData& data, int time)
 
     if (zoom == 1.0) {
         showCursor();
+        if (m_sceneTexture) {
+            // the zoomed screen was only resampled from the cached scene so far,
+            // it has to be repainted as a whole now
+            data.paint |= effects->virtualScreenGeometry();
+            m_sceneTarget.reset();
+            m_sceneTexture.reset();
+        }
     } else {
         hideCursor();
         data.mask |= PAINT_SCREEN_TRANSFORMED;
     }
 
     effects->prePaintScreen(data, time);
+
+    if (zoom != 1.0 && sceneCacheSupported()) {
+        // Everything painted from now on only updates the cached scene. The repaint asked
+        // for by scheduleRecomposite() only resamples it.
+        m_sceneDamage |= data.paint - m_recompositeRepaint;
+    }
+    m_recompositeRepaint = QRegion();
 }
 
 void ZoomEffect::paintScreen(int mask, QRegion region, ScreenPaintData& data)
@@ -330,9 +346,17 @@ void ZoomEffect::paintScreen(int mask, QRegion region, ScreenPaintData& data)
                 prevPoint = focusPoint;
             }
         }
+
+        const QRectF zoomedArea(-data.xTranslation() / zoom, -data.yTranslation() / zoom,
+                                screenSize.width() / zoom, screenSize.height() / zoom);
+        m_zoomedArea = zoomedArea.toAlignedRect() & effects->virtualScreenGeometry();
     }
 
-    effects->paintScreen(mask, region, data);
+    if (zoom != 1.0 && sceneCacheSupported()) {
+        paintCachedScene(mask, data);
+    } else {
+        effects->paintScreen(mask, region, data);
+    }
 
     if (zoom != 1.0 && mousePointer != MousePointerHide) {
         // Draw the mouse-texture at the position matching to zoomed-in image of the desktop. Hiding the
@@ -390,10 +414,87 @@ void ZoomEffect::paintScreen(int mask, QRegion region, ScreenPaintData& data)
 void ZoomEffect::postPaintScreen()
 {
     if (zoom != target_zoom)
-        effects->addRepaintFull();
+        scheduleRecomposite();
     effects->postPaintScreen();
 }
 
+bool ZoomEffect::sceneCacheSupported() const
+{
+    return effects->isOpenGLCompositing() && GLRenderTarget::supported();
+}
+
+void ZoomEffect::paintCachedScene(int mask, ScreenPaintData &data)
+{
+    const QRect screen = effects->virtualScreenGeometry();
+    if (!m_sceneTexture || m_sceneTexture->size() != screen.size()) {
+        // mipmaps are only needed when zooming out, but the storage is allocated up front
+        const int levels = std::log2(qMax(screen.width(), screen.height())) + 1;
+        m_sceneTexture.reset(new GLTexture(GL_RGBA8, screen.size(), levels));
+        m_sceneTexture->setYInverted(false);
+        m_sceneTexture->setWrapMode(GL_CLAMP_TO_EDGE);
+        m_sceneTarget.reset(new GLRenderTarget(*m_sceneTexture));
+        m_sceneDamage = screen;
+    }
+
+    // Only the real scene damage is rendered into the cache, panning and zoom changes are
+    // just a resample of it. The cache is a single persistent buffer, so unlike the back
+    // buffers of the platform no damage history has to be kept.
+    const QRegion damage = m_sceneDamage & screen;
+    m_sceneDamage = QRegion();
+    if (!damage.isEmpty()) {
+        ScreenPaintData sceneData(data.projectionMatrix(), data.outputGeometry());
+        GLRenderTarget::pushRenderTarget(m_sceneTarget.data());
+        effects->paintScreen((mask & ~PAINT_SCREEN_TRANSFORMED) | PAINT_SCREEN_REGION, damage, sceneData);
+        GLRenderTarget::popRenderTarget();
+        m_mipmapsDirty = true;
+    }
+
+    m_sceneTexture->bind();
+    if (zoom < 1.0) {
+        if (m_mipmapsDirty) {
+            m_sceneTexture->generateMipmaps();
+            m_mipmapsDirty = false;
+        }
+        m_sceneTexture->setFilter(GL_LINEAR_MIPMAP_LINEAR);
+        // the scaled down scene doesn't cover the whole screen
+        glClearColor(0.0, 0.0, 0.0, 1.0);
+        glClear(GL_COLOR_BUFFER_BIT);
+    } else {
+        m_sceneTexture->setFilter(GL_LINEAR);
+    }
+
+    auto s = ShaderManager::instance()->pushShader(ShaderTrait::MapTexture);
+    QMatrix4x4 mvp = data.projectionMatrix();
+    mvp.translate(data.xTranslation(), data.yTranslation());
+    mvp.scale(zoom, zoom);
+    s->setUniform(GLShader::ModelViewProjectionMatrix, mvp);
+    m_sceneTexture->render(infiniteRegion(), screen);
+    ShaderManager::instance()->popShader();
+    m_sceneTexture->unbind();
+}
+
+void ZoomEffect::slotWindowDamaged(EffectWindow *w, const QRect &r)
+{
+    if (!m_sceneTexture) {
+        return;
+    }
+    // The damage of the windows is collected here rather than while painting them, as
+    // that happens in the pass which updates the cache. X11 windows don't tell the area.
+    m_sceneDamage |= r.isEmpty() ? w->expandedGeometry() : r.translated(w->pos());
+}
+
+void ZoomEffect::scheduleRecomposite()
+{
+    if (m_sceneTexture && !m_zoomedArea.isEmpty()) {
+        // A new frame only has to resample the cached scene, the zoomed area is repainted
+        // without marking it as damaged in the cache.
+        m_recompositeRepaint |= m_zoomedArea;
+        effects->addRepaint(m_zoomedArea);
+    } else {
+        effects->addRepaintFull();
+    }
+}
+
 void ZoomEffect::zoomIn(double to)
 {
     source_zoom = zoom;
@@ -444,7 +545,7 @@ void ZoomEffect::timelineFrameChanged(int /* frame */)
     prevPoint.setX(qMax(0, qMin(screenSize.width(), prevPoint.x() + xMove)));
     prevPoint.setY(qMax(0, qMin(screenSize.height(), prevPoint.y() + yMove)));
     cursorPoint = prevPoint;
-    effects->addRepaintFull();
+    scheduleRecomposite();
 }
 
 void ZoomEffect::moveZoom(int x, int y)
@@ -509,7 +610,7 @@ void ZoomEffect::slotMouseChanged(const QPoint& pos, const QPoint& old, Qt::Mous
     cursorPoint = pos;
     if (pos != old) {
         lastMouseEvent = QTime::currentTime();
-        effects->addRepaintFull();
+        scheduleRecomposite();
     }
 }
 
@@ -521,7 +622,7 @@ void ZoomEffect::focusChanged(int px, int py, int rx, int ry, int rwidth, int rh
     focusPoint = (px >= 0 && py >= 0) ? QPoint(px, py) : QPoint(rx + qMax(0, (qMin(screenSize.width(), rwidth) / 2) - 60), ry + qMax(0, (qMin(screenSize.height(), rheight) / 2) - 60));
     if (enableFocusTracking) {
         lastFocusEvent = QTime::currentTime();
-        effects->addRepaintFull();
+        scheduleRecomposite();
     }
 }
 
@@ -29,6 +29,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 namespace KWin
 {
 
+class GLRenderTarget;
 class GLTexture;
 class XRenderPicture;
 
@@ -94,10 +95,14 @@ private Q_SLOTS:
                               Qt::MouseButtons buttons, Qt::MouseButtons oldbuttons,
                               Qt::KeyboardModifiers modifiers, Qt::KeyboardModifiers oldmodifiers);
     void recreateTexture();
+    void slotWindowDamaged(KWin::EffectWindow *w, const QRect &r);
 private:
     void showCursor();
     void hideCursor();
     void moveZoom(int x, int y);
+    bool sceneCacheSupported() const;
+    void paintCachedScene(int mask, ScreenPaintData &data);
+    void scheduleRecomposite();
 private:
     double zoom;
     double target_zoom;
@@ -127,6 +132,14 @@ private:
     QTimeLine timeline;
     int xMove, yMove;
     double moveFactor;
+    // the unzoomed scene, only updated where it is damaged
+    QScopedPointer<GLTexture> m_sceneTexture;
+    QScopedPointer<GLRenderTarget> m_sceneTarget;
+    QRegion m_sceneDamage;
+    // the part of the scene visible while zoomed and the repaint requested for it
+    QRect m_zoomedArea;
+    QRegion m_recompositeRepaint;
+    bool m_mipmapsDirty = false;
 };
 
 } // namespace
@@ -44,6 +44,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <QDebug>
 #include <QVarLengthArray>
 
+#include <algorithm>
+
 #include "outline.h"
 #include "xdgshellclient.h"
 #include "wayland_server.h"
@@ -115,9 +117,6 @@ void Workspace::updateClientArea(bool force)
     const Screens *s = Screens::self();
     int nscreens = s->count();
     const int numberOfDesktops = VirtualDesktopManager::self()->count();
-    QVector< QRect > new_wareas(numberOfDesktops + 1);
-    QVector< StrutRects > new_rmoveareas(numberOfDesktops + 1);
-    QVector< QVector< QRect > > new_sareas(numberOfDesktops + 1);
     QVector< QRect > screens(nscreens);
     QRect desktopArea;
     for (int i = 0; i < nscreens; i++) {
@@ -128,31 +127,68 @@ void Workspace::updateClientArea(bool force)
             iS ++) {
         screens [iS] = s->geometry(iS);
     }
-    for (int i = 1;
-            i <= numberOfDesktops;
-            ++i) {
-        new_wareas[ i ] = desktopArea;
-        new_sareas[ i ].resize(nscreens);
-        for (int iS = 0;
-                iS < nscreens;
-                iS ++)
-            new_sareas[ i ][ iS ] = screens[ iS ];
+
+    // The cached strut contributions are only valid for the screen layout they were computed for
+    const bool layoutChanged = workarea.size() != numberOfDesktops + 1
+            || screenarea.size() != numberOfDesktops + 1
+            || desktopArea != m_strutDesktopArea
+            || screens != m_strutScreens;
+    if (layoutChanged) {
+        m_strutContributions.clear();
+        m_strutDesktopArea = desktopArea;
+        m_strutScreens = screens;
     }
+
+    // desktops whose areas have to be recomputed
+    QVector<bool> dirtyDesktops(numberOfDesktops + 1, layoutChanged || force);
+    auto markDirty = [&dirtyDesktops, numberOfDesktops] (const StrutContribution &contribution) {
+        if (contribution.onAllDesktops) {
+            dirtyDesktops.fill(true);
+        } else if (contribution.desktop >= 1 && contribution.desktop <= numberOfDesktops) {
+            dirtyDesktops[contribution.desktop] = true;
+        }
+    };
+    // clients with struts, in the order their contributions are applied
+    QVector<const AbstractClient *> strutClients;
+    // returns the contribution to recompute for @p c or nullptr if the cached one is still valid
+    auto outdatedContribution = [this, &strutClients, &markDirty] (const AbstractClient *c, const StrutRects &strut) -> StrutContribution * {
+        strutClients << c;
+        auto it = m_strutContributions.find(c);
+        if (it == m_strutContributions.end()) {
+            it = m_strutContributions.insert(c, StrutContribution());
+        } else if (it->frameGeometry == c->frameGeometry() && it->screen == c->screen() &&
+                   it->desktop == c->desktop() && it->onAllDesktops == c->isOnAllDesktops() &&
+                   it->strut == strut) {
+            return nullptr;
+        } else {
+            markDirty(*it);
+        }
+        it->frameGeometry = c->frameGeometry();
+        it->screen = c->screen();
+        it->desktop = c->desktop();
+        it->onAllDesktops = c->isOnAllDesktops();
+        it->strut = strut;
+        return &(*it);
+    };
+
     for (ClientList::ConstIterator it = clients.constBegin(); it != clients.constEnd(); ++it) {
         if (!(*it)->hasStrut())
             continue;
+        StrutContribution *contribution = outdatedContribution(*it, (*it)->strutRects());
+        if (!contribution)
+            continue;
         QRect r = (*it)->adjustedClientArea(desktopArea, desktopArea);
         // sanity check that a strut doesn't exclude a complete screen geometry
         // this is a violation to EWMH, as KWin just ignores the strut
-        for (int i = 0; i < Screens::self()->count(); i++) {
-            if (!r.intersects(Screens::self()->geometry(i))) {
+        for (int i = 0; i < nscreens; i++) {
+            if (!r.intersects(screens[i])) {
                 qCDebug(KWIN_CORE) << "Adjusted client area would exclude a complete screen, ignore";
                 r = desktopArea;
                 break;
             }
         }
-        StrutRects strutRegion = (*it)->strutRects();
-        const QRect clientsScreenRect = KWin::screens()->geometry((*it)->screen());
+        StrutRects strutRegion = contribution->strut;
+        const QRect clientsScreenRect = s->geometry((*it)->screen());
         for (auto strut = strutRegion.begin(); strut != strutRegion.end(); strut++) {
             *strut = StrutRect((*strut).intersected(clientsScreenRect), (*strut).area());
         }
@@ -163,42 +199,19 @@ void Workspace::updateClientArea(bool force)
         // This goes against the EWMH description of the work area but it is a toss up between
         // having unusable sections of the screen (Which can be quite large with newer monitors)
         // or having some content appear offscreen (Relatively rare compared to other).
-        bool hasOffscreenXineramaStrut = (*it)->hasOffscreenXineramaStrut();
-
-        if ((*it)->isOnAllDesktops()) {
-            for (int i = 1;
-                    i <= numberOfDesktops;
-                    ++i) {
-                if (!hasOffscreenXineramaStrut)
-                    new_wareas[ i ] = new_wareas[ i ].intersected(r);
-                new_rmoveareas[ i ] += strutRegion;
-                for (int iS = 0;
-                        iS < nscreens;
-                        iS ++) {
-                    const auto geo = new_sareas[ i ][ iS ].intersected(
-                                                (*it)->adjustedClientArea(desktopArea, screens[ iS ]));
-                    // ignore the geometry if it results in the screen getting removed completely
-                    if (!geo.isEmpty()) {
-                        new_sareas[ i ][ iS ] = geo;
-                    }
-                }
-            }
-        } else {
-            if (!hasOffscreenXineramaStrut)
-                new_wareas[(*it)->desktop()] = new_wareas[(*it)->desktop()].intersected(r);
-            new_rmoveareas[(*it)->desktop()] += strutRegion;
-            for (int iS = 0;
-                    iS < nscreens;
-                    iS ++) {
-//                            qDebug() << "adjusting new_sarea: " << screens[ iS ];
-                const auto geo = new_sareas[(*it)->desktop()][ iS ].intersected(
-                      (*it)->adjustedClientArea(desktopArea, screens[ iS ]));
-                // ignore the geometry if it results in the screen getting removed completely
-                if (!geo.isEmpty()) {
-                    new_sareas[(*it)->desktop()][ iS ] = geo;
-                }
-            }
+        if ((*it)->hasOffscreenXineramaStrut())
+            r = desktopArea;
+
+        contribution->workArea = r;
+        contribution->moveArea = strutRegion;
+        contribution->screenAreas.resize(nscreens);
+        for (int iS = 0;
+                iS < nscreens;
+                iS ++) {
+            contribution->screenAreas[ iS ] = (*it)->adjustedClientArea(desktopArea, screens[ iS ]);
         }
+        contribution->keepEmptyScreenAreas = false;
+        markDirty(*contribution);
     }
     if (waylandServer()) {
         auto updateStrutsForWaylandClient = [&] (XdgShellClient *c) {
@@ -246,60 +259,90 @@ void Workspace::updateClientArea(bool force)
                 }
                 return StrutAreaInvalid;
             };
-            const auto strut = margins(KWin::screens()->geometry(c->screen()));
+            const auto strut = margins(s->geometry(c->screen()));
             const StrutRects strutRegion = StrutRects{StrutRect(c->frameGeometry(), marginsToStrutArea(strut))};
-            QRect r = desktopArea - margins(KWin::screens()->geometry());
-            if (c->isOnAllDesktops()) {
-                for (int i = 1; i <= numberOfDesktops; ++i) {
-                    new_wareas[ i ] = new_wareas[ i ].intersected(r);
-                    for (int iS = 0; iS < nscreens; ++iS) {
-                        new_sareas[ i ][ iS ] = new_sareas[ i ][ iS ].intersected(screens[iS] - margins(screens[iS]));
-                    }
-                    new_rmoveareas[ i ] += strutRegion;
-                }
-            } else {
-                new_wareas[c->desktop()] = new_wareas[c->desktop()].intersected(r);
-                for (int iS = 0; iS < nscreens; iS++) {
-                    new_sareas[c->desktop()][ iS ] = new_sareas[c->desktop()][ iS ].intersected(screens[iS] - margins(screens[iS]));
-                }
-                new_rmoveareas[ c->desktop() ] += strutRegion;
+            StrutContribution *contribution = outdatedContribution(c, strutRegion);
+            if (!contribution) {
+                return;
             }
+            contribution->workArea = desktopArea - margins(s->geometry());
+            contribution->moveArea = strutRegion;
+            contribution->screenAreas.resize(nscreens);
+            for (int iS = 0; iS < nscreens; ++iS) {
+                contribution->screenAreas[ iS ] = screens[iS] - margins(screens[iS]);
+            }
+            contribution->keepEmptyScreenAreas = true;
+            markDirty(*contribution);
         };
         const auto clients = waylandServer()->clients();
         for (auto c : clients) {
             updateStrutsForWaylandClient(c);
         }
     }
-#if 0
+
+    // drop the contributions of clients which no longer have struts
+    for (auto it = m_strutContributions.begin(); it != m_strutContributions.end();) {
+        if (strutClients.contains(it.key())) {
+            ++it;
+        } else {
+            markDirty(*it);
+            it = m_strutContributions.erase(it);
+        }
+    }
+
+    QVector< QRect > new_wareas = workarea;
+    QVector< StrutRects > new_rmoveareas = restrictedmovearea;
+    QVector< QVector< QRect > > new_sareas = screenarea;
+    new_wareas.resize(numberOfDesktops + 1);
+    new_rmoveareas.resize(numberOfDesktops + 1);
+    new_sareas.resize(numberOfDesktops + 1);
     for (int i = 1;
-            i <= numberOfDesktops();
+            i <= numberOfDesktops;
             ++i) {
-        for (int iS = 0;
-                iS < nscreens;
-                iS ++)
-            qCDebug(KWIN_CORE) << "new_sarea: " << new_sareas[ i ][ iS ];
+        if (!dirtyDesktops[ i ])
+            continue;
+        new_wareas[ i ] = desktopArea;
+        new_rmoveareas[ i ].clear();
+        new_sareas[ i ] = screens;
+        for (const AbstractClient *c : qAsConst(strutClients)) {
+            const StrutContribution &contribution = *m_strutContributions.constFind(c);
+            if (!contribution.onAllDesktops && contribution.desktop != i)
+                continue;
+            new_wareas[ i ] = new_wareas[ i ].intersected(contribution.workArea);
+            new_rmoveareas[ i ] += contribution.moveArea;
+            for (int iS = 0;
+                    iS < nscreens;
+                    iS ++) {
+                const auto geo = new_sareas[ i ][ iS ].intersected(contribution.screenAreas[ iS ]);
+                // ignore the geometry if it results in the screen getting removed completely
+                if (!geo.isEmpty() || contribution.keepEmptyScreenAreas) {
+                    new_sareas[ i ][ iS ] = geo;
+                }
+            }
+        }
     }
-#endif
-
-    bool changed = force;
-
-    if (screenarea.isEmpty())
-        changed = true;
 
+    // Track which desktops and screens changed, only the clients on them need to be checked
+    bool changed = force || layoutChanged;
+    QVector<bool> desktopChanged(numberOfDesktops + 1, changed);
+    QVector<bool> screenChanged((numberOfDesktops + 1) * nscreens, changed);
     for (int i = 1;
-            !changed && i <= numberOfDesktops;
+            !force && !layoutChanged && i <= numberOfDesktops;
             ++i) {
-        if (workarea[ i ] != new_wareas[ i ])
-            changed = true;
-        if (restrictedmovearea[ i ] != new_rmoveareas[ i ])
-            changed = true;
-        if (screenarea[ i ].size() != new_sareas[ i ].size())
+        if (!dirtyDesktops[ i ])
+            continue;
+        if (workarea[ i ] != new_wareas[ i ] || restrictedmovearea[ i ] != new_rmoveareas[ i ]) {
+            desktopChanged[ i ] = true;
             changed = true;
+        }
         for (int iS = 0;
-                !changed && iS < nscreens;
-                iS ++)
-            if (new_sareas[ i ][ iS ] != screenarea [ i ][ iS ])
+                iS < nscreens;
+                iS ++) {
+            if (new_sareas[ i ][ iS ] != screenarea [ i ][ iS ]) {
+                screenChanged[ i * nscreens + iS ] = true;
                 changed = true;
+            }
+        }
     }
 
     if (changed) {
@@ -310,6 +353,8 @@ void Workspace::updateClientArea(bool force)
         if (rootInfo()) {
             NETRect r;
             for (int i = 1; i <= numberOfDesktops; i++) {
+                if (!desktopChanged[ i ])
+                    continue;
                 r.pos.x = workarea[ i ].x();
                 r.pos.y = workarea[ i ].y();
                 r.size.width = workarea[ i ].width();
@@ -318,12 +363,20 @@ void Workspace::updateClientArea(bool force)
             }
         }
 
+        const int currentDesktop = VirtualDesktopManager::self()->current();
         for (auto it = m_allClients.constBegin();
                 it != m_allClients.constEnd();
-                ++it)
-            (*it)->checkWorkspacePosition();
+                ++it) {
+            const int desktop = (*it)->isOnAllDesktops() ? currentDesktop : (*it)->desktop();
+            const int screen = s->number((*it)->frameGeometry().center());
+            if (desktop < 1 || desktop > numberOfDesktops || screen < 0 || screen >= nscreens ||
+                    desktopChanged[ desktop ] || screenChanged[ desktop * nscreens + screen ])
+                (*it)->checkWorkspacePosition();
+        }
 
         oldrestrictedmovearea.clear(); // reset, no longer valid or needed
+        // the movement areas changed
+        resetSnapTargets();
     }
 }
 
@@ -442,6 +495,93 @@ int Workspace::oldDisplayHeight() const
     return olddisplaysize.height();
 }
 
+void Workspace::updateSnapTargets(AbstractClient *c)
+{
+    // only a window which is interactively moved keeps its targets across calls
+    if (m_snapTargets.client == c && c == movingClient && m_snapTargets.desktop == c->desktop() &&
+            m_snapTargets.clientCount == m_allClients.count()) {
+        return;
+    }
+    resetSnapTargets();
+    m_snapTargets.client = c;
+    m_snapTargets.desktop = c->desktop();
+    m_snapTargets.clientCount = m_allClients.count();
+
+    for (auto l = m_allClients.constBegin(); l != m_allClients.constEnd(); ++l) {
+        if ((*l) == c)
+            continue;
+        if ((*l)->isMinimized())
+            continue; // is minimized
+        if (!(*l)->isShown(false))
+            continue;
+        if (!((*l)->isOnDesktop(c->desktop()) || c->isOnDesktop((*l)->desktop())))
+            continue; // wrong virtual desktop
+        if (!(*l)->isOnCurrentActivity())
+            continue; // wrong activity
+        if ((*l)->isDesktop() || (*l)->isSplash())
+            continue;
+
+        if (c == movingClient) {
+            // the targets are kept while moving, they go stale when the window moves
+            m_snapTargets.connections << connect(*l, &Toplevel::geometryShapeChanged, this, &Workspace::resetSnapTargets);
+        }
+        const QRect geometry((*l)->x(), (*l)->y(), (*l)->width(), (*l)->height());
+        const int index = m_snapTargets.windows.count();
+        m_snapTargets.windows.append(geometry);
+        m_snapTargets.left.append(qMakePair(geometry.x(), index));
+        m_snapTargets.right.append(qMakePair(geometry.x() + geometry.width(), index));
+        m_snapTargets.top.append(qMakePair(geometry.y(), index));
+        m_snapTargets.bottom.append(qMakePair(geometry.y() + geometry.height(), index));
+    }
+    std::sort(m_snapTargets.left.begin(), m_snapTargets.left.end());
+    std::sort(m_snapTargets.right.begin(), m_snapTargets.right.end());
+    std::sort(m_snapTargets.top.begin(), m_snapTargets.top.end());
+    std::sort(m_snapTargets.bottom.begin(), m_snapTargets.bottom.end());
+
+    for (int i = 0; i < screens()->count(); ++i) {
+        m_snapTargets.movementAreas.append(clientArea(MovementArea, i, c->desktop()));
+    }
+}
+
+void Workspace::resetSnapTargets()
+{
+    for (const QMetaObject::Connection &connection : qAsConst(m_snapTargets.connections)) {
+        disconnect(connection);
+    }
+    m_snapTargets = SnapTargets();
+}
+
+/**
+ * Returns the indices of the snap targets which have an edge closer than @p snap to one
+ * of the edges of the moved window, in the order of m_allClients. No other window can
+ * affect the snapped position.
+ */
+QVector<int> Workspace::snapCandidates(int cx, int cy, int rx, int ry, int snap) const
+{
+    QVector<int> candidates;
+    auto collect = [&candidates, snap] (const QVector<QPair<int, int>> &edges, int coordinate) {
+        auto it = std::lower_bound(edges.constBegin(), edges.constEnd(), coordinate - snap + 1,
+            [] (const QPair<int, int> &edge, int value) {
+                return edge.first < value;
+            }
+        );
+        for (; it != edges.constEnd() && it->first < coordinate + snap; ++it) {
+            candidates.append(it->second);
+        }
+    };
+    collect(m_snapTargets.left, cx);
+    collect(m_snapTargets.left, rx);
+    collect(m_snapTargets.right, cx);
+    collect(m_snapTargets.right, rx);
+    collect(m_snapTargets.top, cy);
+    collect(m_snapTargets.top, ry);
+    collect(m_snapTargets.bottom, cy);
+    collect(m_snapTargets.bottom, ry);
+    std::sort(candidates.begin(), candidates.end());
+    candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+    return candidates;
+}
+
 /**
  * Client \a c is moved around to position \a pos. This gives the
  * workspace the opportunity to interveniate and to implement
@@ -473,8 +613,10 @@ QPoint Workspace::adjustClientPosition(AbstractClient* c, QPoint pos, bool unres
 
         const bool sOWO = options->isSnapOnlyWhenOverlapping();
         const int screen = screens()->number(pos + c->rect().center());
+        updateSnapTargets(c);
         if (maxRect.isNull())
-            maxRect = clientArea(MovementArea, screen, c->desktop());
+            maxRect = screen < m_snapTargets.movementAreas.count() ? m_snapTargets.movementAreas.at(screen)
+                                                                   : clientArea(MovementArea, screen, c->desktop());
         const int xmin = maxRect.left();
         const int xmax = maxRect.right() + 1;             //desk size
         const int ymin = maxRect.top();
@@ -540,24 +682,13 @@ QPoint Workspace::adjustClientPosition(AbstractClient* c, QPoint pos, bool unres
         // windows snap
         int snap = options->windowSnapZone() * snapAdjust;
         if (snap) {
-            for (auto l = m_allClients.constBegin(); l != m_allClients.constEnd(); ++l) {
-                if ((*l) == c)
-                    continue;
-                if ((*l)->isMinimized())
-                    continue; // is minimized
-                if (!(*l)->isShown(false))
-                    continue;
-                if (!((*l)->isOnDesktop(c->desktop()) || c->isOnDesktop((*l)->desktop())))
-                    continue; // wrong virtual desktop
-                if (!(*l)->isOnCurrentActivity())
-                    continue; // wrong activity
-                if ((*l)->isDesktop() || (*l)->isSplash())
-                    continue;
-
-                lx = (*l)->x();
-                ly = (*l)->y();
-                lrx = lx + (*l)->width();
-                lry = ly + (*l)->height();
+            const QVector<int> candidates = snapCandidates(cx, cy, rx, ry, snap);
+            for (int candidate : candidates) {
+                const QRect &l = m_snapTargets.windows.at(candidate);
+                lx = l.x();
+                ly = l.y();
+                lrx = lx + l.width();
+                lry = ly + l.height();
 
                 if (!(guideMaximized & MaximizeHorizontal) &&
                     (((cy <= lry) && (cy  >= ly)) || ((ry >= ly) && (ry  <= lry)) || ((cy <= ly) && (ry >= lry)))) {
@@ -882,6 +1013,7 @@ void Workspace::setMoveResizeClient(AbstractClient *c)
     Q_ASSERT(!c || !movingClient); // Catch attempts to move a second
     // window while still moving the first one.
     movingClient = c;
+    resetSnapTargets();
     if (movingClient)
         ++block_focus;
     else
@@ -2607,6 +2739,14 @@ bool X11Client::doStartMoveResize()
 
 void AbstractClient::finishMoveResize(bool cancel)
 {
+    if (!cancel && m_moveResize.samplePending) {
+        // end up where the pointer was released, even if that position wasn't sampled yet
+        // or the client didn't catch up with the previous one
+        m_moveResize.samplePending = false;
+        m_moveResize.finishing = true;
+        applyMoveResize(m_moveResize.sampleLocal, m_moveResize.sampleGlobal);
+        m_moveResize.finishing = false;
+    }
     GeometryUpdatesBlocker blocker(this);
     const bool wasResize = isResize(); // store across leaveMoveResize
     leaveMoveResize();
@@ -2672,8 +2812,6 @@ void X11Client::leaveMoveResize()
     move_resize_has_keyboard_grab = false;
     xcb_ungrab_pointer(connection(), xTime());
     m_moveResizeGrabWindow.reset();
-    if (syncRequest.counter == XCB_NONE) // don't forget to sanitize since the timeout will no more fire
-        syncRequest.isPending = false;
     delete syncRequest.timeout;
     syncRequest.timeout = nullptr;
     AbstractClient::leaveMoveResize();
@@ -2682,7 +2820,7 @@ void X11Client::leaveMoveResize()
 // This function checks if it actually makes sense to perform a restricted move/resize.
 // If e.g. the titlebar is already outside of the workarea, there's no point in performing
 // a restricted move resize, because then e.g. resize would also move the window (#74555).
-// NOTE: Most of it is duplicated from handleMoveResize().
+// NOTE: Most of it is duplicated from applyMoveResizeGeometry().
 void AbstractClient::checkUnrestrictedMoveResize()
 {
     if (isUnrestrictedMoveResize())
@@ -2751,9 +2889,57 @@ void AbstractClient::stopDelayedMoveResize()
 }
 
 void AbstractClient::handleMoveResize(const QPoint &local, const QPoint &global)
+{
+    if (!isMoveResize()) {
+        // the drag distance which starts the move resize mode is checked on every event
+        applyMoveResize(local, global);
+        return;
+    }
+    m_moveResize.sampleLocal = local;
+    m_moveResize.sampleGlobal = global;
+    m_moveResize.samplePending = true;
+    scheduleMoveResizeSample();
+}
+
+void AbstractClient::scheduleMoveResizeSample()
+{
+    if (Compositor::compositing()) {
+        if (!m_moveResize.frameConnection) {
+            m_moveResize.frameConnection = connect(Compositor::self(), &Compositor::aboutToPaintFrame,
+                                                   this, &AbstractClient::sampleMoveResize);
+        }
+        Compositor::self()->scheduleRepaint();
+        return;
+    }
+    // without compositing there is no frame to align to, fall back to the refresh rate
+    if (!m_moveResize.sampleTimer) {
+        m_moveResize.sampleTimer = new QTimer(this);
+        m_moveResize.sampleTimer->setSingleShot(true);
+        connect(m_moveResize.sampleTimer, &QTimer::timeout, this, &AbstractClient::sampleMoveResize);
+    }
+    if (!m_moveResize.sampleTimer->isActive()) {
+        const int refreshRate = Compositor::self() ? Compositor::self()->refreshRate() : 60;
+        m_moveResize.sampleTimer->start(1000 / qMax(refreshRate, 1));
+    }
+}
+
+void AbstractClient::sampleMoveResize()
+{
+    if (!m_moveResize.samplePending || !isMoveResize()) {
+        return;
+    }
+    if (isWaitingForMoveResizeSync()) {
+        // keep the sample, resumeMoveResizeSampling() schedules it again once the client caught up
+        return;
+    }
+    m_moveResize.samplePending = false;
+    applyMoveResize(m_moveResize.sampleLocal, m_moveResize.sampleGlobal);
+}
+
+void AbstractClient::applyMoveResize(const QPoint &local, const QPoint &global)
 {
     const QRect oldGeo = frameGeometry();
-    handleMoveResize(local.x(), local.y(), global.x(), global.y());
+    applyMoveResizeGeometry(local.x(), local.y(), global.x(), global.y());
     if (!isFullScreen() && isMove()) {
         if (quickTileMode() != QuickTileMode(QuickTileFlag::None) && oldGeo != frameGeometry()) {
             GeometryUpdatesBlocker blocker(this);
@@ -2763,7 +2949,7 @@ void AbstractClient::handleMoveResize(const QPoint &local, const QPoint &global)
                                  double(moveOffset().y()) / double(oldGeo.height()) * double(geom_restore.height())));
             if (rules()->checkMaximize(MaximizeRestore) == MaximizeRestore)
                 setMoveResizeGeometry(geom_restore);
-            handleMoveResize(local.x(), local.y(), global.x(), global.y()); // fix position
+            applyMoveResizeGeometry(local.x(), local.y(), global.x(), global.y()); // fix position
         } else if (quickTileMode() == QuickTileMode(QuickTileFlag::None) && isResizable()) {
             checkQuickTilingMaximizationZones(global.x(), global.y());
         }
@@ -2775,9 +2961,9 @@ bool X11Client::isWaitingForMoveResizeSync() const
     return syncRequest.isPending && isResize();
 }
 
-void AbstractClient::handleMoveResize(int x, int y, int x_root, int y_root)
+void AbstractClient::applyMoveResizeGeometry(int x, int y, int x_root, int y_root)
 {
-    if (isWaitingForMoveResizeSync())
+    if (isWaitingForMoveResizeSync() && !m_moveResize.finishing)
         return; // we're still waiting for the client or the timeout
 
     const Position mode = moveResizePointerMode();
@@ -3098,19 +3284,23 @@ void AbstractClient::handleMoveResize(int x, int y, int x_root, int y_root)
 
 void X11Client::doResizeSync()
 {
+    const QRect &moveResizeGeom = moveResizeGeometry();
+    if (syncRequest.counter == XCB_NONE) {
+        // Clients without XSYNC can't tell when they caught up. The resize is already paced
+        // by the compositor frames, so just follow along.
+        m_client.setGeometry(0, 0, moveResizeGeom.width() - (borderLeft() + borderRight()), moveResizeGeom.height() - (borderTop() + borderBottom()));
+        performMoveResize();
+        return;
+    }
     if (!syncRequest.timeout) {
         syncRequest.timeout = new QTimer(this);
         connect(syncRequest.timeout, &QTimer::timeout, this, &X11Client::performMoveResize);
         syncRequest.timeout->setSingleShot(true);
     }
-    if (syncRequest.counter != XCB_NONE) {
-        syncRequest.timeout->start(250);
-        sendSyncRequest();
-    } else {                            // for clients not supporting the XSYNC protocol, we
-        syncRequest.isPending = true;   // limit the resizes to 30Hz to take pointless load from X11
-        syncRequest.timeout->start(33); // and the client, the mouse is still moved at full speed
-    }                                   // and no human can control faster resizes anyway
-    const QRect &moveResizeGeom = moveResizeGeometry();
+    // Only one sync request is in flight, further pointer motion is sampled once the client
+    // replied. The timeout merely updates the frame for a client which is slow to repaint.
+    syncRequest.timeout->start(250);
+    sendSyncRequest();
     m_client.setGeometry(0, 0, moveResizeGeom.width() - (borderLeft() + borderRight()), moveResizeGeom.height() - (borderTop() + borderBottom()));
 }
 
@@ -3125,13 +3315,14 @@ void AbstractClient::performMoveResize()
         addRepaintFull();
     positionGeometryTip();
     emit clientStepUserMovedResized(this, moveResizeGeom);
+    resumeMoveResizeSampling();
 }
 
-void X11Client::doPerformMoveResize()
+void AbstractClient::resumeMoveResizeSampling()
 {
-    if (syncRequest.counter == XCB_NONE)   // client w/o XSYNC support. allow the next resize event
-        syncRequest.isPending = false; // NEVER do this for clients with a valid counter
-                                       // (leads to sync request races in some clients)
+    if (m_moveResize.samplePending) {
+        scheduleMoveResizeSample();
+    }
 }
 
 void AbstractClient::setElectricBorderMode(QuickTileMode mode)
@@ -450,7 +450,7 @@ public:
         }
         switch (event->type()) {
         case QEvent::MouseMove:
-            c->updateMoveResize(event->screenPos().toPoint());
+            c->queueMoveResize(event->screenPos().toPoint());
             break;
         case QEvent::MouseButtonRelease:
             if (event->buttons() == Qt::NoButton) {
@@ -504,7 +504,7 @@ public:
             m_set = true;
         }
         if (m_id == id) {
-            c->updateMoveResize(pos.toPoint());
+            c->queueMoveResize(pos.toPoint());
         }
         return true;
     }
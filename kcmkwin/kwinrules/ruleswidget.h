@@ -100,6 +100,7 @@ private Q_SLOTS:
     void updateEnableshortcut();
     void updateEnabledisableglobalshortcuts();
     void updateEnableblockcompositing();
+    void updateEnablethrottleframes();
     void updateEnabledesktopfile();
     // internal
     void detected(bool);
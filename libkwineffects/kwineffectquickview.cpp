@@ -21,6 +21,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "kwineffectquickview.h"
 
 #include "kwinglutils.h"
+#include "kwinglplatform.h"
 #include "kwineffects.h"
 #include "logging_p.h"
 
@@ -32,17 +33,220 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <QQuickRenderControl>
 #include <QUrl>
 
+#include <QMutex>
 #include <QOffscreenSurface>
 #include <QOpenGLContext>
 #include <QOpenGLFramebufferObject>
+#include <QThread>
 #include <QTimer>
+#include <QWaitCondition>
 
 #include <KDeclarative/QmlObjectSharedEngine>
 
+#include <functional>
+
 using namespace KWin;
 
 static std::unique_ptr<QOpenGLContext> s_shareContext;
 
+/**
+ * Renders the scene graph of an EffectQuickView on a dedicated thread.
+ *
+ * The Quick scene is rendered alternately into one of two framebuffer objects whose
+ * textures are shared with the compositor. A fence inserted after rendering tells the
+ * compositor when a frame is complete, a fence inserted by the compositor when it moves
+ * on to a newer frame tells the render thread when the old texture can be reused.
+ * Neither side ever blocks on the other one, except for the scene graph
+ * synchronization which requires the gui thread to be blocked.
+ */
+class Q_DECL_HIDDEN EffectQuickRenderer : public QObject
+{
+public:
+    enum class BufferState {
+        Free,
+        Rendering,
+        Ready,
+        Displayed
+    };
+    struct Buffer {
+        QOpenGLFramebufferObject *fbo = nullptr;
+        // signaled once the Quick scene has been rendered into the buffer
+        GLsync readyFence = nullptr;
+        // signaled once the compositor doesn't sample the buffer anymore
+        GLsync releaseFence = nullptr;
+        BufferState state = BufferState::Free;
+    };
+
+    EffectQuickRenderer(QQuickWindow *view, QQuickRenderControl *renderControl,
+                        QOpenGLContext *context, QOffscreenSurface *surface);
+
+    /**
+     * Synchronizes and renders the scene graph into a buffer of @p size.
+     * Runs on the render thread, @p done is invoked on the gui thread afterwards.
+     */
+    void render(const QSize &size, const std::function<void()> &done, QObject *receiver);
+    /**
+     * Releases all GL resources. Runs on the render thread.
+     */
+    void cleanup();
+
+    /**
+     * Makes the most recently finished frame the displayed one and returns its buffer,
+     * or the currently displayed buffer if there is no newer frame.
+     * Runs on the gui thread with the compositor's context current.
+     */
+    QOpenGLFramebufferObject *acquireFrame(bool *changed);
+
+    QMutex mutex;
+    QWaitCondition synchronized;
+
+private:
+    QQuickWindow *m_view;
+    QQuickRenderControl *m_renderControl;
+    QOpenGLContext *m_context;
+    QOffscreenSurface *m_surface;
+    bool m_initialized = false;
+    Buffer m_buffers[2];
+};
+
+EffectQuickRenderer::EffectQuickRenderer(QQuickWindow *view, QQuickRenderControl *renderControl,
+                                         QOpenGLContext *context, QOffscreenSurface *surface)
+    : m_view(view)
+    , m_renderControl(renderControl)
+    , m_context(context)
+    , m_surface(surface)
+{
+}
+
+void EffectQuickRenderer::render(const QSize &size, const std::function<void()> &done, QObject *receiver)
+{
+    auto finish = [done, receiver]() {
+        QMetaObject::invokeMethod(receiver, done, Qt::QueuedConnection);
+    };
+
+    mutex.lock();
+    if (!m_context->makeCurrent(m_surface)) {
+        // probably a context loss event, kwin is about to reset all the effects anyway
+        synchronized.wakeOne();
+        mutex.unlock();
+        finish();
+        return;
+    }
+    if (!m_initialized) {
+        m_renderControl->initialize(m_context);
+        m_initialized = true;
+    }
+
+    // render into the buffer which the compositor doesn't display, a finished frame
+    // which hasn't been picked up yet is simply replaced
+    Buffer *buffer = m_buffers[0].state == BufferState::Displayed ? &m_buffers[1] : &m_buffers[0];
+    Buffer *other = buffer == &m_buffers[0] ? &m_buffers[1] : &m_buffers[0];
+    if (other->state == BufferState::Ready) {
+        glDeleteSync(other->readyFence);
+        other->readyFence = nullptr;
+        other->state = BufferState::Free;
+    }
+    if (buffer->readyFence) {
+        glDeleteSync(buffer->readyFence);
+        buffer->readyFence = nullptr;
+    }
+    buffer->state = BufferState::Rendering;
+    GLsync releaseFence = buffer->releaseFence;
+    buffer->releaseFence = nullptr;
+
+    m_renderControl->sync();
+    synchronized.wakeOne();
+    mutex.unlock();
+
+    if (releaseFence) {
+        glWaitSync(releaseFence, 0, GL_TIMEOUT_IGNORED);
+        glDeleteSync(releaseFence);
+    }
+
+    if (!buffer->fbo || buffer->fbo->size() != size) {
+        delete buffer->fbo;
+        buffer->fbo = new QOpenGLFramebufferObject(size, QOpenGLFramebufferObject::CombinedDepthStencil);
+        if (!buffer->fbo->isValid()) {
+            delete buffer->fbo;
+            buffer->fbo = nullptr;
+        }
+    }
+    if (!buffer->fbo) {
+        QMutexLocker locker(&mutex);
+        buffer->state = BufferState::Free;
+        m_context->doneCurrent();
+        finish();
+        return;
+    }
+
+    m_view->setRenderTarget(buffer->fbo);
+    m_renderControl->render();
+    m_view->resetOpenGLState();
+    QOpenGLFramebufferObject::bindDefault();
+
+    GLsync readyFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    // submit the frame, the compositor can't wait for an unflushed fence of another context
+    glFlush();
+    m_context->doneCurrent();
+
+    {
+        QMutexLocker locker(&mutex);
+        buffer->readyFence = readyFence;
+        buffer->state = BufferState::Ready;
+    }
+    finish();
+}
+
+QOpenGLFramebufferObject *EffectQuickRenderer::acquireFrame(bool *changed)
+{
+    QMutexLocker locker(&mutex);
+    Buffer *ready = nullptr;
+    Buffer *displayed = nullptr;
+    for (Buffer &buffer : m_buffers) {
+        if (buffer.state == BufferState::Ready) {
+            ready = &buffer;
+        } else if (buffer.state == BufferState::Displayed) {
+            displayed = &buffer;
+        }
+    }
+    *changed = ready != nullptr;
+    if (!ready) {
+        return displayed ? displayed->fbo : nullptr;
+    }
+    if (displayed) {
+        // all commands sampling the old texture have been issued by now
+        displayed->releaseFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glFlush();
+        displayed->state = BufferState::Free;
+    }
+    glWaitSync(ready->readyFence, 0, GL_TIMEOUT_IGNORED);
+    glDeleteSync(ready->readyFence);
+    ready->readyFence = nullptr;
+    ready->state = BufferState::Displayed;
+    return ready->fbo;
+}
+
+void EffectQuickRenderer::cleanup()
+{
+    m_context->makeCurrent(m_surface);
+    if (m_initialized) {
+        m_renderControl->invalidate();
+    }
+    for (Buffer &buffer : m_buffers) {
+        delete buffer.fbo;
+        if (buffer.readyFence) {
+            glDeleteSync(buffer.readyFence);
+        }
+        if (buffer.releaseFence) {
+            glDeleteSync(buffer.releaseFence);
+        }
+        buffer = Buffer();
+    }
+    m_context->doneCurrent();
+    // the context is destroyed together with the view on the gui thread
+    m_context->moveToThread(QCoreApplication::instance()->thread());
+}
+
 class Q_DECL_HIDDEN EffectQuickView::Private
 {
 public:
@@ -59,9 +263,28 @@ public:
     bool m_useBlit = false;
     bool m_visible = true;
 
+    // only set up in the threaded render mode
+    QThread *m_renderThread = nullptr;
+    EffectQuickRenderer *m_renderer = nullptr;
+    bool m_rendering = false;
+    bool m_updatePending = false;
+
     void releaseResources();
 };
 
+static bool threadedRenderingEnabled()
+{
+    static const bool enabled = qEnvironmentVariableIntValue("KWIN_THREADED_QUICK_VIEWS") == 1;
+    if (!enabled) {
+        return false;
+    }
+    // frames are handed over to the compositor with sync objects
+    if (GLPlatform::instance()->isGLES()) {
+        return hasGLVersion(3, 0);
+    }
+    return hasGLVersion(3, 2) || hasGLExtension(QByteArrayLiteral("GL_ARB_sync"));
+}
+
 class Q_DECL_HIDDEN EffectQuickScene::Private
 {
 public:
@@ -109,9 +332,21 @@ EffectQuickView::EffectQuickView(QObject *parent, ExportMode exportMode)
         d->m_offscreenSurface->setFormat(d->m_glcontext->format());
         d->m_offscreenSurface->create();
 
-        d->m_glcontext->makeCurrent(d->m_offscreenSurface.data());
-        d->m_renderControl->initialize(d->m_glcontext.data());
-        d->m_glcontext->doneCurrent();
+        if (!d->m_useBlit && d->m_glcontext->shareContext() && threadedRenderingEnabled()) {
+            // the render control is initialized on the render thread with the first frame
+            d->m_renderThread = new QThread(this);
+            d->m_renderThread->setObjectName(QStringLiteral("EffectQuickView render thread"));
+            d->m_renderer = new EffectQuickRenderer(d->m_view, d->m_renderControl,
+                                                    d->m_glcontext.data(), d->m_offscreenSurface.data());
+            d->m_renderControl->prepareThread(d->m_renderThread);
+            d->m_glcontext->moveToThread(d->m_renderThread);
+            d->m_renderer->moveToThread(d->m_renderThread);
+            d->m_renderThread->start();
+        } else {
+            d->m_glcontext->makeCurrent(d->m_offscreenSurface.data());
+            d->m_renderControl->initialize(d->m_glcontext.data());
+            d->m_glcontext->doneCurrent();
+        }
 
         if (!d->m_glcontext->shareContext()) {
             qCDebug(LIBKWINEFFECTS) << "Failed to create a shared context, falling back to raster rendering";
@@ -141,7 +376,14 @@ EffectQuickView::EffectQuickView(QObject *parent, ExportMode exportMode)
 
 EffectQuickView::~EffectQuickView()
 {
-    if (d->m_glcontext) {
+    if (d->m_renderThread) {
+        d->m_textureExport.reset();
+        EffectQuickRenderer *renderer = d->m_renderer;
+        QMetaObject::invokeMethod(renderer, [renderer]() { renderer->cleanup(); }, Qt::BlockingQueuedConnection);
+        d->m_renderThread->quit();
+        d->m_renderThread->wait();
+        delete d->m_renderer;
+    } else if (d->m_glcontext) {
         d->m_glcontext->makeCurrent(d->m_offscreenSurface.data());
         d->m_renderControl->invalidate();
         d->m_glcontext->doneCurrent();
@@ -157,6 +399,36 @@ void EffectQuickView::update()
         return;
     }
 
+    if (d->m_renderThread) {
+        // only one frame is in flight, the next one is started once it's done
+        if (d->m_rendering) {
+            d->m_updatePending = true;
+            return;
+        }
+        d->m_rendering = true;
+        d->m_updatePending = false;
+
+        d->m_renderControl->polishItems();
+
+        EffectQuickRenderer *renderer = d->m_renderer;
+        const QSize size = d->m_view->size();
+        auto done = [this]() {
+            d->m_rendering = false;
+            emit repaintNeeded();
+            if (d->m_updatePending) {
+                update();
+            }
+        };
+        // the scene graph may only be synchronized while the gui thread is blocked,
+        // rendering continues after that without holding up the compositor
+        QMutexLocker locker(&renderer->mutex);
+        QMetaObject::invokeMethod(renderer, [renderer, size, done, this]() {
+            renderer->render(size, done, this);
+        }, Qt::QueuedConnection);
+        renderer->synchronized.wait(&renderer->mutex);
+        return;
+    }
+
     bool usingGl = d->m_glcontext;
 
     if (usingGl) {
@@ -266,6 +538,16 @@ void EffectQuickView::hide()
 
 GLTexture *EffectQuickView::bufferAsTexture()
 {
+    if (d->m_renderThread) {
+        bool changed = false;
+        QOpenGLFramebufferObject *fbo = d->m_renderer->acquireFrame(&changed);
+        if (!fbo) {
+            d->m_textureExport.reset();
+        } else if (changed || !d->m_textureExport) {
+            d->m_textureExport.reset(new GLTexture(fbo->texture(), fbo->format().internalTextureFormat(), fbo->size()));
+        }
+        return d->m_textureExport.data();
+    }
     if (d->m_useBlit) {
         if (d->m_image.isNull()) {
             return nullptr;
@@ -301,7 +583,11 @@ void EffectQuickView::setGeometry(const QRect &rect)
 
 void EffectQuickView::Private::releaseResources()
 {
-    if (m_glcontext) {
+    if (m_renderThread) {
+        // the context belongs to the render thread, GL resources of the scene graph
+        // are released there with the next frame
+        m_view->releaseResources();
+    } else if (m_glcontext) {
         m_glcontext->makeCurrent(m_offscreenSurface.data());
         m_view->releaseResources();
         m_glcontext->doneCurrent();
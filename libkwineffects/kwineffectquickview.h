@@ -101,6 +101,10 @@ public:
      *
      * It can be manually invoked to update the contents immediately.
      * Note this will change the GL context
+     *
+     * If threaded rendering is enabled with KWIN_THREADED_QUICK_VIEWS=1, only the
+     * scene graph synchronization happens immediately. The new contents become
+     * available once the render thread has finished, signalled by repaintNeeded.
      */
     void update();
 
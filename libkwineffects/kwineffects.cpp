@@ -620,6 +620,11 @@ void Effect::buildQuads(EffectWindow* w, WindowQuadList& quadList)
     effects->buildQuads(w, quadList);
 }
 
+bool Effect::isBuildQuadsThreadSafe() const
+{
+    return false;
+}
+
 void Effect::setPositionTransformations(WindowPaintData& data, QRect& region, EffectWindow* w,
                                         const QRect& r, Qt::AspectRatioMode aspect)
 {
@@ -49,6 +49,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <netwm.h>
 
+#include <chrono>
 #include <climits>
 #include <functional>
 
@@ -188,7 +189,7 @@ X-KDE-Library=kwin4_effect_cooleffect
 
 #define KWIN_EFFECT_API_MAKE_VERSION( major, minor ) (( major ) << 8 | ( minor ))
 #define KWIN_EFFECT_API_VERSION_MAJOR 0
-#define KWIN_EFFECT_API_VERSION_MINOR 229
+#define KWIN_EFFECT_API_VERSION_MINOR 230
 #define KWIN_EFFECT_API_VERSION KWIN_EFFECT_API_MAKE_VERSION( \
         KWIN_EFFECT_API_VERSION_MAJOR, KWIN_EFFECT_API_VERSION_MINOR )
 
@@ -523,6 +524,16 @@ public:
      * It's up to the effect to keep track of them.
      */
     virtual void buildQuads(EffectWindow* w, WindowQuadList& quadList);
+    /**
+     * Reimplement this method to indicate that buildQuads() may be invoked from a worker
+     * thread, concurrently for different windows. The effect must not touch any shared
+     * state in buildQuads() then, passing the call on to the next effect is fine.
+     *
+     * Quads are only built in parallel if all effects of the painting pass return @c true.
+     * The default implementation returns @c false.
+     * @since 5.18
+     */
+    virtual bool isBuildQuadsThreadSafe() const;
 
     virtual void windowInputMouseEvent(QEvent* e);
     virtual void grabbedKeyboardEvent(QKeyEvent* e);
@@ -1367,6 +1378,17 @@ public:
      */
     virtual void renderEffectQuickView(EffectQuickView *effectQuickView) const = 0;
 
+    /**
+     * Returns the time at which the frame that is currently being painted is expected to be
+     * presented on screen, in the CLOCK_MONOTONIC domain.
+     *
+     * Unlike the time passed to prePaintScreen() this has nanosecond resolution and is
+     * derived from the presentation timestamps the platform reports, if it does. Effects
+     * can compute the progress of their animations from it to have them paced precisely.
+     * @since 5.18
+     */
+    virtual std::chrono::nanoseconds presentationTime() const = 0;
+
 Q_SIGNALS:
     /**
      * Signal emitted when the current desktop changed.
@@ -94,6 +94,15 @@ GLTexture::GLTexture(const QImage& image, GLenum target)
 
     glGenTextures(1, &d->m_texture);
     bind();
+    d->m_internalFormat = GLTexturePrivate::uploadImage(d->m_target, image, &d->m_immutable);
+
+    unbind();
+    setFilter(GL_LINEAR);
+}
+
+GLenum GLTexturePrivate::uploadImage(GLenum target, const QImage &image, bool *immutable)
+{
+    *immutable = false;
 
     if (!GLPlatform::instance()->isGLES()) {
         // Note: Blending is set up to expect premultiplied data, so non-premultiplied
@@ -150,34 +159,29 @@ GLTexture::GLTexture(const QImage& image, GLenum target)
             type = GL_UNSIGNED_INT_8_8_8_8_REV;
         }
 
-        d->m_internalFormat = internalFormat;
-
-        if (d->s_supportsTextureStorage) {
-            glTexStorage2D(d->m_target, 1, internalFormat, im.width(), im.height());
-            glTexSubImage2D(d->m_target, 0, 0, 0, im.width(), im.height(),
+        if (s_supportsTextureStorage) {
+            glTexStorage2D(target, 1, internalFormat, im.width(), im.height());
+            glTexSubImage2D(target, 0, 0, 0, im.width(), im.height(),
                             format, type, im.bits());
-            d->m_immutable = true;
+            *immutable = true;
         } else {
-            glTexParameteri(d->m_target, GL_TEXTURE_MAX_LEVEL, d->m_mipLevels - 1);
-            glTexImage2D(d->m_target, 0, internalFormat, im.width(), im.height(), 0,
+            glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, 0);
+            glTexImage2D(target, 0, internalFormat, im.width(), im.height(), 0,
                          format, type, im.bits());
         }
-    } else {
-        d->m_internalFormat = GL_RGBA8;
-
-        if (d->s_supportsARGB32) {
-            const QImage im = image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
-            glTexImage2D(d->m_target, 0, GL_BGRA_EXT, im.width(), im.height(),
-                         0, GL_BGRA_EXT, GL_UNSIGNED_BYTE, im.bits());
-        } else {
-            const QImage im = image.convertToFormat(QImage::Format_RGBA8888_Premultiplied);
-            glTexImage2D(d->m_target, 0, GL_RGBA, im.width(), im.height(),
-                         0, GL_RGBA, GL_UNSIGNED_BYTE, im.bits());
-        }
+        return internalFormat;
     }
 
-    unbind();
-    setFilter(GL_LINEAR);
+    if (s_supportsARGB32) {
+        const QImage im = image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+        glTexImage2D(target, 0, GL_BGRA_EXT, im.width(), im.height(),
+                     0, GL_BGRA_EXT, GL_UNSIGNED_BYTE, im.bits());
+    } else {
+        const QImage im = image.convertToFormat(QImage::Format_RGBA8888_Premultiplied);
+        glTexImage2D(target, 0, GL_RGBA, im.width(), im.height(),
+                     0, GL_RGBA, GL_UNSIGNED_BYTE, im.bits());
+    }
+    return GL_RGBA8;
 }
 
 GLTexture::GLTexture(const QPixmap& pixmap, GLenum target)
@@ -347,6 +351,16 @@ QSize GLTexture::size() const
 }
 
 void GLTexture::update(const QImage &image, const QPoint &offset, const QRect &src)
+{
+    const QRect source = src.isNull() ? image.rect() : src;
+    update(image, QRegion(source), offset - source.topLeft());
+}
+
+// The fixed cost of a single glTexSubImage2D call, in uploaded pixels. Rects are merged into
+// their bounding rect if that uploads fewer additional pixels than the saved calls cost.
+static const int s_uploadOverhead = 64 * 64;
+
+void GLTexture::update(const QImage &image, const QRegion &region, const QPoint &offset)
 {
     if (image.isNull() || isNull())
         return;
@@ -354,51 +368,66 @@ void GLTexture::update(const QImage &image, const QPoint &offset, const QRect &s
     Q_D(GLTexture);
     Q_ASSERT(!d->m_foreign);
 
-    bool useUnpack = !src.isNull() && d->s_supportsUnpack && d->s_supportsARGB32 && image.format() == QImage::Format_ARGB32_Premultiplied;
-
-    int width = image.width();
-    int height = image.height();
-    QImage tmpImage;
+    const QRegion clipped = region & image.rect();
+    if (clipped.isEmpty()) {
+        return;
+    }
+    const QRect bounds = clipped.boundingRect();
 
-    if (!src.isNull()) {
-        if (useUnpack) {
-            glPixelStorei(GL_UNPACK_ROW_LENGTH, image.width());
-            glPixelStorei(GL_UNPACK_SKIP_PIXELS, src.x());
-            glPixelStorei(GL_UNPACK_SKIP_ROWS, src.y());
+    QImage::Format imageFormat = QImage::Format_ARGB32_Premultiplied;
+    GLenum format = GL_BGRA;
+    GLenum type = GL_UNSIGNED_INT_8_8_8_8_REV;
+    if (GLPlatform::instance()->isGLES()) {
+        type = GL_UNSIGNED_BYTE;
+        if (d->s_supportsARGB32) {
+            format = GL_BGRA_EXT;
         } else {
-            tmpImage = image.copy(src);
+            imageFormat = QImage::Format_RGBA8888_Premultiplied;
+            format = GL_RGBA;
         }
-        width = src.width();
-        height = src.height();
     }
 
-    const QImage &img = tmpImage.isNull() ? image : tmpImage;
+    QVector<QRect> rects;
+    int area = 0;
+    for (const QRect &rect : clipped) {
+        rects << rect;
+        area += rect.width() * rect.height();
+    }
+    if (bounds.width() * bounds.height() <= area + (rects.count() - 1) * s_uploadOverhead) {
+        rects = {bounds};
+    }
+
+    // only convert the part which gets uploaded
+    QImage im = image;
+    QPoint origin(0, 0);
+    if (image.format() != imageFormat) {
+        im = image.copy(bounds).convertToFormat(imageFormat);
+        origin = bounds.topLeft();
+    }
 
     bind();
 
-    if (!GLPlatform::instance()->isGLES()) {
-        const QImage im = img.convertToFormat(QImage::Format_ARGB32_Premultiplied);
-        glTexSubImage2D(d->m_target, 0, offset.x(), offset.y(), width, height,
-                        GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, im.bits());
-    } else {
-        if (d->s_supportsARGB32) {
-            const QImage im = img.convertToFormat(QImage::Format_ARGB32_Premultiplied);
-            glTexSubImage2D(d->m_target, 0, offset.x(), offset.y(), width, height,
-                            GL_BGRA_EXT, GL_UNSIGNED_BYTE, im.bits());
+    if (d->s_supportsUnpack) {
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, im.bytesPerLine() / 4);
+    }
+    for (const QRect &rect : qAsConst(rects)) {
+        const QRect r = rect.translated(-origin);
+        QImage tmpImage;
+        const uchar *bits = nullptr;
+        if (d->s_supportsUnpack || r.width() == im.width()) {
+            bits = im.constScanLine(r.y()) + r.x() * 4;
         } else {
-            const QImage im = img.convertToFormat(QImage::Format_RGBA8888_Premultiplied);
-            glTexSubImage2D(d->m_target, 0, offset.x(), offset.y(), width, height,
-                            GL_RGBA, GL_UNSIGNED_BYTE, im.bits());
+            tmpImage = im.copy(r);
+            bits = tmpImage.constBits();
         }
+        glTexSubImage2D(d->m_target, 0, offset.x() + rect.x(), offset.y() + rect.y(), r.width(), r.height(),
+                        format, type, bits);
     }
-
-    unbind();
-
-    if (useUnpack) {
+    if (d->s_supportsUnpack) {
         glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
-        glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
-        glPixelStorei(GL_UNPACK_SKIP_ROWS, 0);
     }
+
+    unbind();
 }
 
 void GLTexture::discard()
@@ -103,6 +103,17 @@ public:
     QMatrix4x4 matrix(TextureCoordinateType type) const;
 
     void update(const QImage& image, const QPoint &offset = QPoint(0, 0), const QRect &src = QRect());
+    /**
+     * Uploads the parts of @p image covered by @p region, in image coordinates, to the
+     * same position moved by @p offset in the texture.
+     *
+     * Depending on how much of its bounding rect the region covers, it is either
+     * uploaded at once or rect by rect. Only the uploaded parts are converted to the
+     * texture format and no copies are made if the platform can unpack sub-images.
+     *
+     * @since 5.18
+     */
+    void update(const QImage &image, const QRegion &region, const QPoint &offset = QPoint(0, 0));
     virtual void discard();
     void bind();
     void unbind();
@@ -151,6 +162,7 @@ protected:
 
 private:
     Q_DECLARE_PRIVATE(GLTexture)
+    friend class GLTextureUploader;
 };
 
 } // namespace
@@ -72,6 +72,11 @@ public:
     QSize m_cachedSize;
 
     static void initStatic();
+    /**
+     * Uploads @p image to the texture bound to @p target and returns the internal format
+     * used. Only needs the statics, so it can be used from the texture upload thread.
+     */
+    static GLenum uploadImage(GLenum target, const QImage &image, bool *immutable);
 
     static bool s_supportsFramebufferObjects;
     static bool s_supportsARGB32;
@@ -28,14 +28,21 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "kwinglplatform.h"
 #include "logging_p.h"
 
+#include <QCryptographicHash>
+#include <QDir>
 #include <QPixmap>
 #include <QImage>
 #include <QHash>
 #include <QFile>
+#include <QSaveFile>
+#include <QStandardPaths>
 #include <QVector2D>
 #include <QVector3D>
 #include <QVector4D>
 #include <QMatrix4x4>
+#include <QPointer>
+#include <QSemaphore>
+#include <QThread>
 #include <QVarLengthArray>
 
 #include <array>
@@ -85,6 +92,7 @@ void initGL(std::function<resolveFuncPtr(const char*)> resolveFunction)
 
 void cleanupGL()
 {
+    GLTextureUploader::cleanup();
     ShaderManager::cleanup();
     GLTexturePrivate::cleanup();
     GLRenderTarget::cleanup();
@@ -307,6 +315,32 @@ bool GLShader::load(const QByteArray &vertexSource, const QByteArray &fragmentSo
     return link();
 }
 
+bool GLShader::loadProgramBinary(GLenum format, const QByteArray &binary)
+{
+    glProgramBinary(mProgram, format, binary.constData(), binary.size());
+
+    // The driver rejects binaries it can't use, e.g. after an update, in which
+    // case the program can still be built from source
+    int status;
+    glGetProgramiv(mProgram, GL_LINK_STATUS, &status);
+    mValid = status != 0;
+    return mValid;
+}
+
+QByteArray GLShader::programBinary(GLenum *format) const
+{
+    int length = 0;
+    glGetProgramiv(mProgram, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) {
+        return QByteArray();
+    }
+    QByteArray binary(length, Qt::Uninitialized);
+    GLsizei written = 0;
+    glGetProgramBinary(mProgram, length, &written, format, binary.data());
+    binary.resize(written);
+    return binary;
+}
+
 void GLShader::bindAttributeLocation(const char *name, int index)
 {
     glBindAttribLocation(mProgram, index, name);
@@ -564,6 +598,48 @@ ShaderManager::ShaderManager()
     } else {
         m_resourcePath = QStringLiteral(":/effect-shaders-1.10/");
     }
+
+    initProgramCache();
+}
+
+void ShaderManager::initProgramCache()
+{
+    if (qEnvironmentVariableIsSet("KWIN_GL_NO_PROGRAM_CACHE")) {
+        return;
+    }
+    if (GLPlatform::instance()->isGLES()) {
+        if (!hasGLVersion(3, 0)) {
+            return;
+        }
+    } else if (!hasGLVersion(4, 1) && !hasGLExtension(QByteArrayLiteral("GL_ARB_get_program_binary"))) {
+        return;
+    }
+    int formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    if (formats <= 0) {
+        return;
+    }
+
+    // Binaries are only valid for the driver which created them, every driver
+    // gets its own directory and the ones of previous drivers are dropped
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(GLPlatform::instance()->glVendorString());
+    hash.addData(GLPlatform::instance()->glRendererString());
+    hash.addData(GLPlatform::instance()->glVersionString());
+    const QString driver = QString::fromLatin1(hash.result().toHex());
+
+    QDir cache(QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation) + QStringLiteral("/kwin/glprograms"));
+    if (!cache.mkpath(driver)) {
+        qCWarning(LIBKWINGLUTILS) << "Failed to create the shader program cache in" << cache.path();
+        return;
+    }
+    const QStringList entries = cache.entryList(QDir::Dirs | QDir::NoDotAndDotDot);
+    for (const QString &entry : entries) {
+        if (entry != driver) {
+            QDir(cache.filePath(entry)).removeRecursively();
+        }
+    }
+    m_programCachePath = cache.filePath(driver) + QLatin1Char('/');
 }
 
 ShaderManager::~ShaderManager()
@@ -920,14 +996,59 @@ GLShader *ShaderManager::generateCustomShader(ShaderTraits traits, const QByteAr
     qCDebug(LIBKWINGLUTILS) << "**************";
 #endif
 
+    return linkShader(vertex, fragment, QByteArrayLiteral("position,texcoord,fragColor"),
+        [] (GLShader *shader) {
+            shader->bindAttributeLocation("position", VA_Position);
+            shader->bindAttributeLocation("texcoord", VA_TexCoord);
+            shader->bindFragDataLocation("fragColor", 0);
+        }
+    );
+}
+
+GLShader *ShaderManager::linkShader(const QByteArray &vertexSource, const QByteArray &fragmentSource,
+                                    const QByteArray &bindings, std::function<void (GLShader *)> bindLocations)
+{
     GLShader *shader = new GLShader(GLShader::ExplicitLinking);
-    shader->load(vertex, fragment);
 
-    shader->bindAttributeLocation("position", VA_Position);
-    shader->bindAttributeLocation("texcoord", VA_TexCoord);
-    shader->bindFragDataLocation("fragColor", 0);
+    QString cacheFile;
+    if (!m_programCachePath.isEmpty()) {
+        QCryptographicHash hash(QCryptographicHash::Sha1);
+        hash.addData(bindings);
+        hash.addData(shader->prepareSource(GL_VERTEX_SHADER, vertexSource));
+        hash.addData(shader->prepareSource(GL_FRAGMENT_SHADER, fragmentSource));
+        cacheFile = m_programCachePath + QString::fromLatin1(hash.result().toHex());
 
+        QFile file(cacheFile);
+        if (file.open(QIODevice::ReadOnly)) {
+            const QByteArray data = file.readAll();
+            GLenum format = 0;
+            if (data.size() > int(sizeof(format))) {
+                memcpy(&format, data.constData(), sizeof(format));
+                if (shader->loadProgramBinary(format, data.mid(sizeof(format)))) {
+                    return shader;
+                }
+            }
+            file.remove();
+        }
+    }
+
+    shader->load(vertexSource, fragmentSource);
+    bindLocations(shader);
+    if (!cacheFile.isEmpty()) {
+        glProgramParameteri(shader->mProgram, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
     shader->link();
+
+    if (shader->isValid() && !cacheFile.isEmpty()) {
+        GLenum format = 0;
+        const QByteArray binary = shader->programBinary(&format);
+        QSaveFile file(cacheFile);
+        if (!binary.isEmpty() && file.open(QIODevice::WriteOnly)) {
+            file.write(reinterpret_cast<const char *>(&format), sizeof(format));
+            file.write(binary);
+            file.commit();
+        }
+    }
     return shader;
 }
 
@@ -1034,12 +1155,12 @@ void ShaderManager::bindAttributeLocations(GLShader *shader) const
 
 GLShader *ShaderManager::loadShaderFromCode(const QByteArray &vertexSource, const QByteArray &fragmentSource)
 {
-    GLShader *shader = new GLShader(GLShader::ExplicitLinking);
-    shader->load(vertexSource, fragmentSource);
-    bindAttributeLocations(shader);
-    bindFragDataLocations(shader);
-    shader->link();
-    return shader;
+    return linkShader(vertexSource, fragmentSource, QByteArrayLiteral("vertex,texCoord,fragColor"),
+        [this] (GLShader *shader) {
+            bindAttributeLocations(shader);
+            bindFragDataLocations(shader);
+        }
+    );
 }
 
 /***  GLRenderTarget  ***/
@@ -2314,4 +2435,171 @@ GLVertexBuffer *GLVertexBuffer::streamingBuffer()
     return GLVertexBufferPrivate::streamingBuffer;
 }
 
+//*********************************
+// GLTextureUploader
+//*********************************
+
+namespace
+{
+
+class GLTextureUploadThread : public QThread
+{
+public:
+    GLTextureUploadThread(std::function<bool()> makeCurrent, std::function<void()> doneCurrent)
+        : m_makeCurrent(makeCurrent)
+        , m_doneCurrent(doneCurrent)
+    {
+        setObjectName(QStringLiteral("KWinGLTextureUpload"));
+    }
+
+    /**
+     * Starts the thread and returns whether the upload context could be made current on it.
+     */
+    bool startAndWait() {
+        start(QThread::LowPriority);
+        m_started.acquire();
+        return m_current;
+    }
+
+protected:
+    void run() override {
+        m_current = m_makeCurrent();
+        m_started.release();
+        if (!m_current) {
+            return;
+        }
+        exec();
+        m_doneCurrent();
+    }
+
+private:
+    std::function<bool()> m_makeCurrent;
+    std::function<void()> m_doneCurrent;
+    QSemaphore m_started;
+    bool m_current = false;
+};
+
+}
+
+GLTextureUploader *GLTextureUploader::s_uploader = nullptr;
+
+GLTextureUploader *GLTextureUploader::instance()
+{
+    if (!s_uploader) {
+        s_uploader = new GLTextureUploader();
+    }
+    return s_uploader;
+}
+
+void GLTextureUploader::cleanup()
+{
+    delete s_uploader;
+    s_uploader = nullptr;
+}
+
+GLTextureUploader::GLTextureUploader()
+    : m_receiver(new QObject)
+{
+}
+
+GLTextureUploader::~GLTextureUploader()
+{
+    if (m_thread) {
+        // Queued uploads are dropped, their textures go away with the context
+        m_thread->quit();
+        m_thread->wait();
+        delete m_worker;
+        delete m_thread;
+    }
+    delete m_receiver;
+}
+
+void GLTextureUploader::setUploadContext(std::function<bool()> createContext,
+                                         std::function<bool()> makeCurrent,
+                                         std::function<void()> doneCurrent)
+{
+    GLTextureUploader *uploader = instance();
+    if (uploader->m_thread) {
+        return;
+    }
+    uploader->m_createContext = createContext;
+    uploader->m_makeCurrent = makeCurrent;
+    uploader->m_doneCurrent = doneCurrent;
+}
+
+void GLTextureUploader::startThread()
+{
+    // Only tried once, failures keep uploading on the compositor thread
+    const auto createContext = m_createContext;
+    m_createContext = nullptr;
+    if (!createContext()) {
+        return;
+    }
+    auto thread = new GLTextureUploadThread(m_makeCurrent, m_doneCurrent);
+    if (!thread->startAndWait()) {
+        qCWarning(LIBKWINGLUTILS) << "Failed to make the texture upload context current, uploading on the compositor thread";
+        thread->wait();
+        delete thread;
+        return;
+    }
+    m_worker = new QObject;
+    m_worker->moveToThread(thread);
+    m_thread = thread;
+}
+
+void GLTextureUploader::upload(const QImage &image, QObject *context, std::function<void(GLTexture *)> done)
+{
+    if (!m_thread && m_createContext) {
+        startThread();
+    }
+    if (!m_thread) {
+        done(new GLTexture(image));
+        return;
+    }
+    const bool haveSyncFences = GLVertexBufferPrivate::haveSyncFences;
+    QPointer<QObject> guard(context);
+    QObject *receiver = m_receiver;
+    QMetaObject::invokeMethod(m_worker, [image, guard, done, receiver, haveSyncFences] {
+        GLuint name = 0;
+        glGenTextures(1, &name);
+        glBindTexture(GL_TEXTURE_2D, name);
+        bool immutable = false;
+        const GLenum internalFormat = GLTexturePrivate::uploadImage(GL_TEXTURE_2D, image, &immutable);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        // The compositing context may only use the texture once the upload completed
+        if (haveSyncFences) {
+            GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            GLenum status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+            while (status == GL_TIMEOUT_EXPIRED) {
+                status = glClientWaitSync(fence, 0, 1000000000);
+            }
+            glDeleteSync(fence);
+        } else {
+            glFinish();
+        }
+
+        const QSize size = image.size();
+        QMetaObject::invokeMethod(receiver, [name, internalFormat, size, immutable, guard, done] {
+            if (!guard) {
+                GLTextureUploader::instance()->deleteTexture(name);
+                return;
+            }
+            GLTexture *texture = new GLTexture(name, internalFormat, size);
+            texture->d_ptr->m_foreign = false;
+            texture->d_ptr->m_immutable = immutable;
+            texture->setYInverted(true);
+            texture->setFilter(GL_LINEAR);
+            done(texture);
+        }, Qt::QueuedConnection);
+    }, Qt::QueuedConnection);
+}
+
+void GLTextureUploader::deleteTexture(GLuint texture)
+{
+    QMetaObject::invokeMethod(m_worker, [texture] {
+        glDeleteTextures(1, &texture);
+    }, Qt::QueuedConnection);
+}
+
 } // namespace
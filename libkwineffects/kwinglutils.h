@@ -34,6 +34,9 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 /** @addtogroup kwineffects */
 /** @{ */
 
+class QImage;
+class QObject;
+class QThread;
 class QVector2D;
 class QVector3D;
 class QVector4D;
@@ -161,6 +164,11 @@ protected:
     bool load(const QByteArray &vertexSource, const QByteArray &fragmentSource);
     const QByteArray prepareSource(GLenum shaderType, const QByteArray &sourceCode) const;
     bool compile(GLuint program, GLenum shaderType, const QByteArray &sourceCode) const;
+    /**
+     * Loads a program binary retrieved with programBinary(), sets the shader valid on success.
+     */
+    bool loadProgramBinary(GLenum format, const QByteArray &binary);
+    QByteArray programBinary(GLenum *format) const;
     void bind();
     void unbind();
     void resolveLocations();
@@ -327,11 +335,20 @@ private:
     QByteArray generateVertexSource(ShaderTraits traits) const;
     QByteArray generateFragmentSource(ShaderTraits traits) const;
     GLShader *generateShader(ShaderTraits traits);
+    /**
+     * Compiles and links the sources, or loads the program from the program cache.
+     * @p bindings identifies what @p bindLocations binds, it is part of the cache key.
+     */
+    GLShader *linkShader(const QByteArray &vertexSource, const QByteArray &fragmentSource,
+                         const QByteArray &bindings, std::function<void (GLShader *)> bindLocations);
+    void initProgramCache();
 
     QStack<GLShader*> m_boundShaders;
     QHash<ShaderTraits, GLShader *> m_shaderHash;
     bool m_debug;
     QString m_resourcePath;
+    // directory of the program binaries for the current driver, empty if not supported
+    QString m_programCachePath;
     static ShaderManager *s_shaderManager;
 };
 
@@ -816,6 +833,75 @@ private:
     static qreal s_virtualScreenScale;
 };
 
+/**
+ * @short Uploads images to textures on a worker thread.
+ *
+ * If the compositing backend provides an OpenGL context sharing its objects with the
+ * compositing context, it gets made current on a worker thread. The context and the thread
+ * are only created when the first image gets queued. Images queued with
+ * upload() are converted and copied to textures there and the compositor thread only
+ * receives finished textures. This keeps large uploads, e.g. of wallpapers, out of
+ * the frames.
+ *
+ * Without such a context images are uploaded right away. The EGL backends only provide it
+ * if enabled with KWIN_GL_UPLOAD_THREAD=1.
+ *
+ * @since 5.18
+ */
+class KWINGLUTILS_EXPORT GLTextureUploader
+{
+public:
+    ~GLTextureUploader();
+
+    /**
+     * Queues uploading the non-null @p image to a texture. Once it's complete @p done is
+     * invoked on the compositor thread with the texture, which it takes ownership of. If
+     * @p context got destroyed in the meantime the texture is dropped instead.
+     *
+     * Without an upload thread @p done is invoked right away, the compositing context has
+     * to be current in that case.
+     */
+    void upload(const QImage &image, QObject *context, std::function<void(GLTexture *)> done);
+
+    /**
+     * Whether uploads happen on a worker thread. The thread is only started by the first
+     * upload().
+     */
+    bool isThreaded() const {
+        return m_thread != nullptr;
+    }
+
+    static GLTextureUploader *instance();
+
+    /**
+     * Sets up the upload thread, it's started by the first upload(). @p createContext is
+     * invoked then on the compositor thread, with the compositing context current, and
+     * returns whether the upload context could be created. @p makeCurrent and
+     * @p doneCurrent are invoked on the upload thread to bind and release it.
+     *
+     * @internal
+     */
+    static void setUploadContext(std::function<bool()> createContext,
+                                 std::function<bool()> makeCurrent,
+                                 std::function<void()> doneCurrent);
+
+private:
+    GLTextureUploader();
+    void startThread();
+    void deleteTexture(GLuint texture);
+    friend void KWin::cleanupGL();
+    static void cleanup();
+    std::function<bool()> m_createContext;
+    std::function<bool()> m_makeCurrent;
+    std::function<void()> m_doneCurrent;
+    QThread *m_thread = nullptr;
+    // Lives on the upload thread, the jobs are queued to it
+    QObject *m_worker = nullptr;
+    // Lives on the compositor thread, finished uploads are queued to it
+    QObject *m_receiver = nullptr;
+    static GLTextureUploader *s_uploader;
+};
+
 } // namespace
 
 Q_DECLARE_OPERATORS_FOR_FLAGS(KWin::ShaderTraits)
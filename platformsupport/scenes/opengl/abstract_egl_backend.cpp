@@ -77,8 +77,21 @@ void AbstractEglBackend::unbindWaylandDisplay()
 
 void AbstractEglBackend::cleanup()
 {
+    if (m_dmaBuf) {
+        // the textures of the client buffers go away with the context
+        m_dmaBuf->releaseTextures();
+    }
+    // stops the texture upload thread as well
     cleanupGL();
     doneCurrent();
+    if (m_uploadContext != EGL_NO_CONTEXT) {
+        eglDestroyContext(m_display, m_uploadContext);
+        m_uploadContext = EGL_NO_CONTEXT;
+    }
+    if (m_uploadSurface != EGL_NO_SURFACE) {
+        eglDestroySurface(m_display, m_uploadSurface);
+        m_uploadSurface = EGL_NO_SURFACE;
+    }
     eglDestroyContext(m_display, m_context);
     cleanupSurfaces();
     eglReleaseThread();
@@ -137,6 +150,61 @@ void AbstractEglBackend::initKWinGL()
         options->setGlPreferBufferSwap('e'); // for unknown drivers - should not happen
     glPlatform->printResults();
     initGL(&getProcAddress);
+    initTextureUploadThread();
+}
+
+void AbstractEglBackend::initTextureUploadThread()
+{
+    // Opt-in for now, only few images are uploaded through it so far
+    if (m_contextAttributes.empty() || qEnvironmentVariableIntValue("KWIN_GL_UPLOAD_THREAD") != 1) {
+        return;
+    }
+    // The context and the thread are only created once something gets uploaded
+    GLTextureUploader::setUploadContext(
+        [this] {
+            return createUploadContext();
+        },
+        [this] {
+            return eglMakeCurrent(m_display, m_uploadSurface, m_uploadSurface, m_uploadContext) == EGL_TRUE;
+        },
+        [this] {
+            eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+            eglReleaseThread();
+        }
+    );
+}
+
+bool AbstractEglBackend::createUploadContext()
+{
+    // Same attributes as the compositing context, but uploads must not be prioritized
+    std::vector<int> attribs;
+    for (size_t i = 0; m_contextAttributes[i] != EGL_NONE; i += 2) {
+        if (m_contextAttributes[i] == EGL_CONTEXT_PRIORITY_LEVEL_IMG) {
+            continue;
+        }
+        attribs.emplace_back(m_contextAttributes[i]);
+        attribs.emplace_back(m_contextAttributes[i + 1]);
+    }
+    attribs.emplace_back(EGL_NONE);
+
+    if (!hasExtension(QByteArrayLiteral("EGL_KHR_surfaceless_context"))) {
+        const EGLint pbufferAttribs[] = {
+            EGL_WIDTH, 1,
+            EGL_HEIGHT, 1,
+            EGL_NONE
+        };
+        m_uploadSurface = eglCreatePbufferSurface(m_display, m_config, pbufferAttribs);
+        if (m_uploadSurface == EGL_NO_SURFACE) {
+            qCDebug(KWIN_OPENGL) << "No surface for the texture upload context, uploading on the compositor thread";
+            return false;
+        }
+    }
+    m_uploadContext = eglCreateContext(m_display, m_config, m_context, attribs.data());
+    if (m_uploadContext == EGL_NO_CONTEXT) {
+        qCWarning(KWIN_OPENGL) << "Failed to create the texture upload context:" << eglGetError();
+        return false;
+    }
+    return true;
 }
 
 void AbstractEglBackend::initBufferAge()
@@ -149,6 +217,69 @@ void AbstractEglBackend::initBufferAge()
         if (useBufferAge != "0")
             setSupportsBufferAge(true);
     }
+
+    // Telling the driver which parts of the buffers are touched saves a lot of memory
+    // bandwidth on tiled renderers, which otherwise load and store every tile per frame.
+    m_havePartialUpdate = false;
+    m_swapBuffersWithDamage = SwapBuffersWithDamage::None;
+    if (qgetenv("KWIN_USE_PARTIAL_UPDATE") == "0") {
+        return;
+    }
+    // partial updates rely on the buffer age to know what needs to be repainted
+    m_havePartialUpdate = supportsBufferAge() && hasExtension(QByteArrayLiteral("EGL_KHR_partial_update"));
+    if (hasExtension(QByteArrayLiteral("EGL_KHR_swap_buffers_with_damage"))) {
+        m_swapBuffersWithDamage = SwapBuffersWithDamage::KHR;
+    } else if (hasExtension(QByteArrayLiteral("EGL_EXT_swap_buffers_with_damage"))) {
+        m_swapBuffersWithDamage = SwapBuffersWithDamage::EXT;
+    }
+}
+
+// Converts @p region to the rectangles of a surface showing @p geometry, which have their
+// origin in the bottom left corner.
+static QVector<EGLint> regionToRects(const QRegion &region, const QRect &geometry, qreal scale)
+{
+    const QRegion clipped = region.intersected(geometry);
+    QVector<EGLint> rects;
+    rects.reserve(clipped.rectCount() * 4);
+    for (const QRect &r : clipped) {
+        const QRect rect = QRectF((r.x() - geometry.x()) * scale,
+                                  (geometry.y() + geometry.height() - r.y() - r.height()) * scale,
+                                  r.width() * scale, r.height() * scale).toAlignedRect();
+        rects << rect.x() << rect.y() << rect.width() << rect.height();
+    }
+    return rects;
+}
+
+void AbstractEglBackend::setDamageRegion(EGLSurface surface, const QRegion &region, const QRect &geometry, qreal scale)
+{
+    if (!m_havePartialUpdate) {
+        return;
+    }
+    const QVector<EGLint> rects = regionToRects(region, geometry, scale);
+    if (rects.isEmpty()) {
+        // an empty list of rectangles would announce the whole buffer
+        return;
+    }
+    if (eglSetDamageRegionKHR(m_display, surface, const_cast<EGLint *>(rects.constData()), rects.count() / 4) == EGL_FALSE) {
+        qCWarning(KWIN_OPENGL) << "eglSetDamageRegionKHR failed:" << eglGetError();
+    }
+}
+
+void AbstractEglBackend::swapBuffers(EGLSurface surface, const QRegion &damage, const QRect &geometry, qreal scale)
+{
+    if (m_swapBuffersWithDamage != SwapBuffersWithDamage::None) {
+        const QVector<EGLint> rects = regionToRects(damage, geometry, scale);
+        if (!rects.isEmpty()) {
+            EGLint *data = const_cast<EGLint *>(rects.constData());
+            if (m_swapBuffersWithDamage == SwapBuffersWithDamage::KHR) {
+                eglSwapBuffersWithDamageKHR(m_display, surface, data, rects.count() / 4);
+            } else {
+                eglSwapBuffersWithDamageEXT(m_display, surface, data, rects.count() / 4);
+            }
+            return;
+        }
+    }
+    eglSwapBuffers(m_display, surface);
 }
 
 void AbstractEglBackend::initWayland()
@@ -171,7 +302,7 @@ void AbstractEglBackend::initWayland()
         }
     }
 
-    LinuxDmabuf::factory(this);
+    m_dmaBuf = LinuxDmabuf::factory(this);
 }
 
 void AbstractEglBackend::initClientExtensions()
@@ -291,6 +422,7 @@ bool AbstractEglBackend::createContext()
         ctx = eglCreateContext(m_display, config(), EGL_NO_CONTEXT, attribs.data());
         if (ctx != EGL_NO_CONTEXT) {
             qCDebug(KWIN_OPENGL) << "Created EGL context with attributes:" << (*it).get();
+            m_contextAttributes = attribs;
             break;
         }
     }
@@ -368,6 +500,18 @@ bool AbstractEglTexture::loadTexture(WindowPixmap *pixmap)
     return loadEglTexture(buffer);
 }
 
+static QRegion scaleRegion(const QRegion &region, qreal scale)
+{
+    if (scale == 1) {
+        return region;
+    }
+    QRegion scaled;
+    for (const QRect &rect : region) {
+        scaled += QRect(rect.x() * scale, rect.y() * scale, rect.width() * scale, rect.height() * scale);
+    }
+    return scaled;
+}
+
 void AbstractEglTexture::updateTexture(WindowPixmap *pixmap)
 {
     // FIXME: Refactor this method.
@@ -384,9 +528,10 @@ void AbstractEglTexture::updateTexture(WindowPixmap *pixmap)
     }
     auto s = pixmap->surface();
     if (DmabufBuffer *dmabuf = static_cast<DmabufBuffer *>(buffer->linuxDmabufBuffer())) {
-        q->bind();
-        glEGLImageTargetTexture2DOES(GL_TEXTURE_2D, (GLeglImageOES) dmabuf->images()[0]);   //TODO
-        q->unbind();
+        // Every buffer has its own texture, switching to it needs no import
+        if (const auto texture = dmabuf->texture(m_backend)) {
+            setBufferTexture(texture);
+        }
         if (m_image != EGL_NO_IMAGE_KHR) {
             eglDestroyImageKHR(m_backend->eglDisplay(), m_image);
         }
@@ -403,6 +548,14 @@ void AbstractEglTexture::updateTexture(WindowPixmap *pixmap)
         }
         return;
     }
+    if (m_bufferTexture) {
+        // The texture belongs to the dma-buf the client used before
+        m_bufferTexture.reset();
+        m_texture = 0;
+        m_foreign = false;
+        loadTexture(pixmap);
+        return;
+    }
     if (!buffer->shmBuffer()) {
         q->bind();
         EGLImageKHR image = attach(buffer);
@@ -430,37 +583,11 @@ void AbstractEglTexture::updateTexture(WindowPixmap *pixmap)
         }
     }
     Q_ASSERT(image.size() == m_size);
-    q->bind();
     const QRegion damage = s->trackedDamage();
     s->resetTrackedDamage();
     auto scale = s->scale(); //damage is normalised, so needs converting up to match texture
 
-    // TODO: this should be shared with GLTexture::update
-    if (GLPlatform::instance()->isGLES()) {
-        if (s_supportsARGB32 && (image.format() == QImage::Format_ARGB32 || image.format() == QImage::Format_ARGB32_Premultiplied)) {
-            const QImage im = image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
-            for (const QRect &rect : damage) {
-                auto scaledRect = QRect(rect.x() * scale, rect.y() * scale, rect.width() * scale, rect.height() * scale);
-                glTexSubImage2D(m_target, 0, scaledRect.x(), scaledRect.y(), scaledRect.width(), scaledRect.height(),
-                                GL_BGRA_EXT, GL_UNSIGNED_BYTE, im.copy(scaledRect).bits());
-            }
-        } else {
-            const QImage im = image.convertToFormat(QImage::Format_RGBA8888_Premultiplied);
-            for (const QRect &rect : damage) {
-                auto scaledRect = QRect(rect.x() * scale, rect.y() * scale, rect.width() * scale, rect.height() * scale);
-                glTexSubImage2D(m_target, 0, scaledRect.x(), scaledRect.y(), scaledRect.width(), scaledRect.height(),
-                                GL_RGBA, GL_UNSIGNED_BYTE, im.copy(scaledRect).bits());
-            }
-        }
-    } else {
-        const QImage im = image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
-        for (const QRect &rect : damage) {
-            auto scaledRect = QRect(rect.x() * scale, rect.y() * scale, rect.width() * scale, rect.height() * scale);
-            glTexSubImage2D(m_target, 0, scaledRect.x(), scaledRect.y(), scaledRect.width(), scaledRect.height(),
-                            GL_BGRA, GL_UNSIGNED_BYTE, im.copy(scaledRect).bits());
-        }
-    }
-    q->unbind();
+    q->update(image, scaleRegion(damage, scale));
 }
 
 bool AbstractEglTexture::loadShmTexture(const QPointer< KWayland::Server::BufferInterface > &buffer)
@@ -490,7 +617,8 @@ bool AbstractEglTexture::loadShmTexture(const QPointer< KWayland::Server::Buffer
         return false;
     }
     if (GLPlatform::instance()->isGLES()) {
-        if (s_supportsARGB32 && format == GL_RGBA8) {
+        // the format has to match GLTexture::update()
+        if (s_supportsARGB32) {
             const QImage im = image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
             glTexImage2D(m_target, 0, GL_BGRA_EXT, im.width(), im.height(),
                          0, GL_BGRA_EXT, GL_UNSIGNED_BYTE, im.bits());
@@ -547,12 +675,14 @@ bool AbstractEglTexture::loadDmabufTexture(const QPointer< KWayland::Server::Buf
 
     Q_ASSERT(m_image == EGL_NO_IMAGE_KHR);
 
-    glGenTextures(1, &m_texture);
+    const auto texture = dmabuf->texture(m_backend);
+    if (!texture) {
+        q->discard();
+        return false;
+    }
+    setBufferTexture(texture);
     q->setWrapMode(GL_CLAMP_TO_EDGE);
     q->setFilter(GL_NEAREST);
-    q->bind();
-    glEGLImageTargetTexture2DOES(GL_TEXTURE_2D, (GLeglImageOES) dmabuf->images()[0]);
-    q->unbind();
 
     m_size = dmabuf->size();
     q->setYInverted(!(dmabuf->flags() & KWayland::Server::LinuxDmabufUnstableV1Interface::YInverted));
@@ -590,7 +720,8 @@ bool AbstractEglTexture::loadInternalImageObject(WindowPixmap *pixmap)
         return false;
     }
     if (GLPlatform::instance()->isGLES()) {
-        if (s_supportsARGB32 && format == GL_RGBA8) {
+        // the format has to match GLTexture::update()
+        if (s_supportsARGB32) {
             const QImage im = image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
             glTexImage2D(m_target, 0, GL_BGRA_EXT, im.width(), im.height(),
                          0, GL_BGRA_EXT, GL_UNSIGNED_BYTE, im.bits());
@@ -654,10 +785,24 @@ bool AbstractEglTexture::updateFromFBO(const QSharedPointer<QOpenGLFramebufferOb
     return true;
 }
 
-bool AbstractEglTexture::updateFromInternalImageObject(WindowPixmap *pixmap)
+void AbstractEglTexture::setBufferTexture(const QSharedPointer<DmabufTexture> &texture)
 {
-    // FIXME: Share some code with the shm fallback in updateTexture().
+    if (m_bufferTexture == texture) {
+        return;
+    }
+    if (m_texture != 0 && !m_foreign) {
+        glDeleteTextures(1, &m_texture);
+    }
+    m_bufferTexture = texture;
+    m_texture = texture->texture();
+    m_foreign = true;
+    // Filter and wrap mode are state of the texture object
+    m_filterChanged = true;
+    m_wrapModeChanged = true;
+}
 
+bool AbstractEglTexture::updateFromInternalImageObject(WindowPixmap *pixmap)
+{
     const QImage image = pixmap->internalImage();
     if (image.isNull()) {
         return false;
@@ -671,35 +816,7 @@ bool AbstractEglTexture::updateFromInternalImageObject(WindowPixmap *pixmap)
     const QRegion damage = pixmap->toplevel()->damage();
     const qreal scale = image.devicePixelRatio();
 
-    q->bind();
-
-    // TODO: this should be shared with GLTexture::update
-    if (GLPlatform::instance()->isGLES()) {
-        if (s_supportsARGB32 && (image.format() == QImage::Format_ARGB32 || image.format() == QImage::Format_ARGB32_Premultiplied)) {
-            const QImage im = image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
-            for (const QRect &rect : damage) {
-                auto scaledRect = QRect(rect.x() * scale, rect.y() * scale, rect.width() * scale, rect.height() * scale);
-                glTexSubImage2D(m_target, 0, scaledRect.x(), scaledRect.y(), scaledRect.width(), scaledRect.height(),
-                                GL_BGRA_EXT, GL_UNSIGNED_BYTE, im.copy(scaledRect).bits());
-            }
-        } else {
-            const QImage im = image.convertToFormat(QImage::Format_RGBA8888_Premultiplied);
-            for (const QRect &rect : damage) {
-                auto scaledRect = QRect(rect.x() * scale, rect.y() * scale, rect.width() * scale, rect.height() * scale);
-                glTexSubImage2D(m_target, 0, scaledRect.x(), scaledRect.y(), scaledRect.width(), scaledRect.height(),
-                                GL_RGBA, GL_UNSIGNED_BYTE, im.copy(scaledRect).bits());
-            }
-        }
-    } else {
-        const QImage im = image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
-        for (const QRect &rect : damage) {
-            auto scaledRect = QRect(rect.x() * scale, rect.y() * scale, rect.width() * scale, rect.height() * scale);
-            glTexSubImage2D(m_target, 0, scaledRect.x(), scaledRect.y(), scaledRect.width(), scaledRect.height(),
-                            GL_BGRA, GL_UNSIGNED_BYTE, im.copy(scaledRect).bits());
-        }
-    }
-
-    q->unbind();
+    q->update(image, scaleRegion(damage, scale));
 
     return true;
 }
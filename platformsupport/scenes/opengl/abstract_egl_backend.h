@@ -26,6 +26,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <epoxy/egl.h>
 #include <fixx11h.h>
 
+#include <vector>
+
 class QOpenGLFramebufferObject;
 
 namespace KWayland
@@ -39,6 +41,9 @@ class BufferInterface;
 namespace KWin
 {
 
+class DmabufTexture;
+class LinuxDmabuf;
+
 class KWIN_EXPORT AbstractEglBackend : public QObject, public OpenGLBackend
 {
     Q_OBJECT
@@ -59,6 +64,20 @@ public:
     EGLConfig config() const {
         return m_config;
     }
+    /**
+     * Whether the driver can be told which parts of the back buffer are going to be
+     * painted, see setDamageRegion().
+     */
+    bool supportsPartialUpdate() const {
+        return m_havePartialUpdate;
+    }
+    /**
+     * Whether the driver can be told which parts of the back buffer changed when
+     * presenting it, see swapBuffers().
+     */
+    bool supportsSwapBuffersWithDamage() const {
+        return m_swapBuffersWithDamage != SwapBuffersWithDamage::None;
+    }
 
 protected:
     AbstractEglBackend();
@@ -74,17 +93,48 @@ protected:
     void initWayland();
     bool hasClientExtension(const QByteArray &ext) const;
     bool isOpenGLES() const;
+    /**
+     * Announces that only @p region of the back buffer of @p surface is going to be painted in
+     * the current frame. @p geometry and @p scale describe the area of the compositor space the
+     * surface shows. Does nothing if EGL_KHR_partial_update is not supported.
+     *
+     * Must be called before anything is painted to the surface in this frame.
+     */
+    void setDamageRegion(EGLSurface surface, const QRegion &region, const QRect &geometry, qreal scale);
+    /**
+     * Posts the back buffer of @p surface. If supported the driver gets told that only
+     * @p damage changed, otherwise it's a plain eglSwapBuffers().
+     */
+    void swapBuffers(EGLSurface surface, const QRegion &damage, const QRect &geometry, qreal scale);
 
     bool createContext();
 
 private:
     void unbindWaylandDisplay();
+    /**
+     * Sets up the texture upload thread, see GLTextureUploader. It gets a context sharing
+     * the objects of the compositing context, both are only created on the first upload.
+     */
+    void initTextureUploadThread();
+    bool createUploadContext();
 
     EGLDisplay m_display = EGL_NO_DISPLAY;
     EGLSurface m_surface = EGL_NO_SURFACE;
     EGLContext m_context = EGL_NO_CONTEXT;
     EGLConfig m_config = nullptr;
+    // The attributes the compositing context got created with
+    std::vector<int> m_contextAttributes;
+    EGLContext m_uploadContext = EGL_NO_CONTEXT;
+    EGLSurface m_uploadSurface = EGL_NO_SURFACE;
+    LinuxDmabuf *m_dmaBuf = nullptr;
     QList<QByteArray> m_clientExtensions;
+    bool m_havePartialUpdate = false;
+    enum class SwapBuffersWithDamage {
+        None,
+        KHR,
+        EXT
+    };
+    SwapBuffersWithDamage m_swapBuffersWithDamage = SwapBuffersWithDamage::None;
 };
 
 class KWIN_EXPORT AbstractEglTexture : public SceneOpenGLTexturePrivate
@@ -115,9 +165,12 @@ private:
     EGLImageKHR attach(const QPointer<KWayland::Server::BufferInterface> &buffer);
     bool updateFromFBO(const QSharedPointer<QOpenGLFramebufferObject> &fbo);
     bool updateFromInternalImageObject(WindowPixmap *pixmap);
+    void setBufferTexture(const QSharedPointer<DmabufTexture> &texture);
     SceneOpenGLTexture *q;
     AbstractEglBackend *m_backend;
     EGLImageKHR m_image;
+    // The texture of the dma-buf shown, m_texture refers to it meanwhile
+    QSharedPointer<DmabufTexture> m_bufferTexture;
 };
 
 }
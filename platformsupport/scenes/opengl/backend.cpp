@@ -103,6 +103,12 @@ bool OpenGLBackend::perScreenRendering() const
     return false;
 }
 
+void OpenGLBackend::aboutToStartPainting(int screenId, const QRegion &damage)
+{
+    Q_UNUSED(screenId)
+    Q_UNUSED(damage)
+}
+
 void OpenGLBackend::copyPixels(const QRegion &region)
 {
     const int height = screens()->size().height();
@@ -91,6 +91,17 @@ public:
      */
     virtual bool perScreenRendering() const;
     virtual QRegion prepareRenderingForScreen(int screenId);
+    /**
+     * @brief Notifies about starting to paint, after all pre-paint calls are done.
+     *
+     * @p damage is the region which is going to be painted in the current frame, in
+     * compositor coordinates. Backends can hand it to the driver so that the rest of the
+     * back buffer does not need to be touched. With per screen rendering @p screenId
+     * denotes the screen which is painted, otherwise it is @c -1.
+     *
+     * Default implementation does nothing.
+     */
+    virtual void aboutToStartPainting(int screenId, const QRegion &damage);
     /**
      * @brief Compositor is going into idle mode, flushes any pending paints.
      */
@@ -25,6 +25,14 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <KWayland/Server/display.h>
 
+#include <kwinglutils.h>
+
+#include <QSocketNotifier>
+
+#include <errno.h>
+#include <linux/dma-buf.h>
+#include <poll.h>
+#include <sys/ioctl.h>
 #include <unistd.h>
 #include <EGL/eglmesaext.h>
 
@@ -61,6 +69,14 @@ eglQueryDmaBufModifiersEXT_func eglQueryDmaBufModifiersEXT = nullptr;
 #define EGL_YUV_CHROMA_SITING_0_5_EXT             0x3285
 #endif // EGL_EXT_image_dma_buf_import
 
+#ifndef DMA_BUF_IOCTL_EXPORT_SYNC_FILE
+struct dma_buf_export_sync_file {
+    __u32 flags;
+    __s32 fd;
+};
+#define DMA_BUF_IOCTL_EXPORT_SYNC_FILE _IOWR(DMA_BUF_BASE, 2, struct dma_buf_export_sync_file)
+#endif // DMA_BUF_IOCTL_EXPORT_SYNC_FILE
+
 #ifndef EGL_EXT_image_dma_buf_import_modifiers
 #define EGL_DMA_BUF_PLANE3_FD_EXT                 0x3440
 #define EGL_DMA_BUF_PLANE3_OFFSET_EXT             0x3441
@@ -201,6 +217,8 @@ DmabufBuffer::DmabufBuffer(const QVector<Plane> &planes,
 
 DmabufBuffer::~DmabufBuffer()
 {
+    stopWatchingFence();
+
     if (m_interfaceImpl) {
         m_interfaceImpl->removeBuffer(this);
         removeImages();
@@ -221,6 +239,7 @@ void DmabufBuffer::addImage(EGLImage image)
 
 void DmabufBuffer::removeImages()
 {
+    m_texture.reset();
     for (auto image : m_images) {
         eglDestroyImageKHR(m_interfaceImpl->m_backend->eglDisplay(), image);
     }
@@ -228,6 +247,126 @@ void DmabufBuffer::removeImages()
     m_interfaceImpl = nullptr;
 }
 
+void DmabufBuffer::releaseTexture()
+{
+    m_texture.reset();
+}
+
+QSharedPointer<DmabufTexture> DmabufBuffer::texture(AbstractEglBackend *backend)
+{
+    if (!m_interfaceImpl || m_images.isEmpty() || m_images.first() == EGL_NO_IMAGE_KHR) {
+        return QSharedPointer<DmabufTexture>();
+    }
+    // The buffer can outlive the compositing context, e.g. when compositing is restarted
+    if (!m_texture || m_texture->context() != backend->context()) {
+        m_texture.reset(new DmabufTexture(backend, m_images.first()));
+    }
+    return m_texture;
+}
+
+DmabufTexture::DmabufTexture(AbstractEglBackend *backend, EGLImage image)
+    : m_display(backend->eglDisplay())
+    , m_context(backend->context())
+    , m_surface(backend->surface())
+{
+    glGenTextures(1, &m_texture);
+    glBindTexture(GL_TEXTURE_2D, m_texture);
+    glEGLImageTargetTexture2DOES(GL_TEXTURE_2D, (GLeglImageOES) image);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+DmabufTexture::~DmabufTexture()
+{
+    // Clients can destroy their buffers while another context is current
+    const EGLContext previousContext = eglGetCurrentContext();
+    if (previousContext == m_context) {
+        glDeleteTextures(1, &m_texture);
+        return;
+    }
+    const EGLDisplay previousDisplay = eglGetCurrentDisplay();
+    const EGLSurface previousDrawSurface = eglGetCurrentSurface(EGL_DRAW);
+    const EGLSurface previousReadSurface = eglGetCurrentSurface(EGL_READ);
+    if (!eglMakeCurrent(m_display, m_surface, m_surface, m_context)) {
+        return;
+    }
+    glDeleteTextures(1, &m_texture);
+    if (previousContext == EGL_NO_CONTEXT) {
+        eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    } else {
+        eglMakeCurrent(previousDisplay, previousDrawSurface, previousReadSurface, previousContext);
+    }
+}
+
+// Cleared once the kernel turned out not to support exporting fences from dma-bufs
+static bool s_exportSyncFileSupported = true;
+
+static int exportSyncFile(int dmabufFd)
+{
+    // The fence of the writes, which reading has to wait for
+    dma_buf_export_sync_file request = { DMA_BUF_SYNC_READ, -1 };
+    int ret;
+    do {
+        ret = ioctl(dmabufFd, DMA_BUF_IOCTL_EXPORT_SYNC_FILE, &request);
+    } while (ret == -1 && (errno == EINTR || errno == EAGAIN));
+    if (ret == -1) {
+        if (errno == ENOTTY) {
+            s_exportSyncFileSupported = false;
+        }
+        return -1;
+    }
+    return request.fd;
+}
+
+bool DmabufBuffer::isReadable(const std::function<void()> &done)
+{
+    if (m_fenceNotifier) {
+        // still waiting for the fence of an earlier check
+        m_fenceDone = done;
+        return false;
+    }
+
+    if (!s_exportSyncFileSupported) {
+        return true;
+    }
+
+    for (const Plane &plane : qAsConst(m_planes)) {
+        const int fence = exportSyncFile(plane.fd);
+        if (fence == -1) {
+            continue;
+        }
+        pollfd pfd = { fence, POLLIN, 0 };
+        if (poll(&pfd, 1, 0) != 0) {
+            // signaled, or an error we can't wait for anyway
+            ::close(fence);
+            continue;
+        }
+
+        m_fenceDone = done;
+        m_fenceNotifier.reset(new QSocketNotifier(fence, QSocketNotifier::Read));
+        QObject::connect(m_fenceNotifier.data(), &QSocketNotifier::activated, [this] {
+            const std::function<void()> done = m_fenceDone;
+            stopWatchingFence();
+            if (done) {
+                done();
+            }
+        });
+        return false;
+    }
+    return true;
+}
+
+void DmabufBuffer::stopWatchingFence()
+{
+    if (!m_fenceNotifier) {
+        return;
+    }
+    m_fenceNotifier->setEnabled(false);
+    ::close(m_fenceNotifier->socket());
+    // the notifier might be emitting right now
+    m_fenceNotifier.take()->deleteLater();
+    m_fenceDone = nullptr;
+}
+
 using Plane = KWayland::Server::LinuxDmabufUnstableV1Interface::Plane;
 using Flags = KWayland::Server::LinuxDmabufUnstableV1Interface::Flags;
 
@@ -315,7 +454,9 @@ KWayland::Server::LinuxDmabufUnstableV1Buffer* LinuxDmabuf::importBuffer(const Q
 
     // Try first to import as a single image
     if (auto *img = createImage(planes, format, size)) {
-        return new DmabufBuffer(img, planes, format, size, flags, this);
+        auto *buf = new DmabufBuffer(img, planes, format, size, flags, this);
+        m_buffers.insert(buf);
+        return buf;
     }
 
     // TODO: to enable this we must be able to store multiple textures per window pixmap
@@ -368,6 +509,7 @@ KWayland::Server::LinuxDmabufUnstableV1Buffer* LinuxDmabuf::yuvImport(const QVec
         buf->addImage(image);
     }
     // TODO: add buf import properties
+    m_buffers.insert(buf);
     return buf;
 }
 
@@ -407,6 +549,13 @@ LinuxDmabuf::~LinuxDmabuf()
     }
 }
 
+void LinuxDmabuf::releaseTextures()
+{
+    for (auto *dmabuf : qAsConst(m_buffers)) {
+        dmabuf->releaseTexture();
+    }
+}
+
 void LinuxDmabuf::removeBuffer(DmabufBuffer *buffer)
 {
     m_buffers.remove(buffer);
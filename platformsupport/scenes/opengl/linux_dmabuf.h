@@ -24,12 +24,45 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <KWayland/Server/linuxdmabuf_v1_interface.h>
 
+#include <QScopedPointer>
+#include <QSharedPointer>
 #include <QVector>
 
+#include <functional>
+
+class QSocketNotifier;
+
 namespace KWin
 {
 class LinuxDmabuf;
 
+/**
+ * A texture bound to the image of a dma-buf. It's shared by the buffer and the window
+ * textures showing it, so those keep their contents when the client destroys the buffer.
+ *
+ * The texture belongs to the context of the backend which created it. All of them are
+ * dropped before that context is destroyed, see LinuxDmabuf::releaseTextures().
+ */
+class DmabufTexture
+{
+public:
+    DmabufTexture(AbstractEglBackend *backend, EGLImage image);
+    ~DmabufTexture();
+
+    GLuint texture() const {
+        return m_texture;
+    }
+    EGLContext context() const {
+        return m_context;
+    }
+
+private:
+    EGLDisplay m_display;
+    EGLContext m_context;
+    EGLSurface m_surface;
+    GLuint m_texture = 0;
+};
+
 class DmabufBuffer : public KWayland::Server::LinuxDmabufUnstableV1Buffer
 {
 public:
@@ -58,17 +91,40 @@ public:
 
     void addImage(EGLImage image);
     void removeImages();
+    void releaseTexture();
 
     QVector<EGLImage> images() const { return m_images; }
     Flags flags() const { return m_flags; }
     const QVector<Plane> &planes() const { return m_planes; }
 
+    /**
+     * Returns @c false if the GPU is still writing to the buffer. The fence of the pending
+     * writes is watched then and @p done gets called once they have finished.
+     *
+     * The fence is exported as a sync_file from the dma-buf. If the kernel doesn't support
+     * that, the buffer is always considered readable and sampling from it waits implicitly.
+     */
+    bool isReadable(const std::function<void()> &done);
+
+    /**
+     * Returns the texture bound to the image of the buffer in the context of @p backend,
+     * or @c null if there is no valid image. The texture is created on first use and kept
+     * for the lifetime of the buffer, so switching between the buffers a client cycles
+     * through needs no import.
+     */
+    QSharedPointer<DmabufTexture> texture(AbstractEglBackend *backend);
+
 private:
+    void stopWatchingFence();
+
     QVector<EGLImage> m_images;
     QVector<Plane> m_planes;
     Flags m_flags;
     LinuxDmabuf *m_interfaceImpl;
     ImportType m_importType;
+    QScopedPointer<QSocketNotifier> m_fenceNotifier;
+    std::function<void()> m_fenceDone;
+    QSharedPointer<DmabufTexture> m_texture;
 };
 
 class LinuxDmabuf : public KWayland::Server::LinuxDmabufUnstableV1Interface::Impl
@@ -87,6 +143,12 @@ public:
                                                                 const QSize &size,
                                                                 Flags flags) override;
 
+    /**
+     * Drops the textures of all buffers. Has to be called with the context of the backend
+     * current, before it gets destroyed.
+     */
+    void releaseTextures();
+
 private:
     EGLImage createImage(const QVector<Plane> &planes,
                          uint32_t format,
@@ -232,12 +232,10 @@ void DrmBackend::deactivate()
 void DrmBackend::pageFlipHandler(int fd, unsigned int frame, unsigned int sec, unsigned int usec, void *data)
 {
     Q_UNUSED(fd)
-    Q_UNUSED(frame)
-    Q_UNUSED(sec)
-    Q_UNUSED(usec)
     auto output = reinterpret_cast<DrmOutput*>(data);
 
-    output->pageFlipped();
+    // the kernel reports CLOCK_MONOTONIC timestamps, see DRM_CAP_TIMESTAMP_MONOTONIC
+    output->pageFlipped(std::chrono::seconds(sec) + std::chrono::microseconds(usec), frame);
     output->m_backend->m_pageFlipsPending--;
     if (output->m_backend->m_pageFlipsPending == 0) {
         // TODO: improve, this currently means we wait for all page flips or all outputs.
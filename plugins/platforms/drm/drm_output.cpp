@@ -41,6 +41,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <QCryptographicHash>
 #include <QPainter>
 // c++
+#include <algorithm>
 #include <cerrno>
 // drm
 #include <xf86drm.h>
@@ -50,6 +51,10 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 namespace KWin
 {
 
+// number of transformed cursor images kept per output, enough for the frames of the
+// usual animated cursors
+static const int s_maxCursorBuffers = 8;
+
 DrmOutput::DrmOutput(DrmBackend *backend)
     : AbstractWaylandOutput(backend)
     , m_backend(backend)
@@ -84,8 +89,11 @@ void DrmOutput::teardown()
     m_crtc->setOutput(nullptr);
     m_conn->setOutput(nullptr);
 
-    delete m_cursor[0];
-    delete m_cursor[1];
+    for (const CursorBuffer &cursor : qAsConst(m_cursorBuffers)) {
+        delete cursor.buffer;
+    }
+    m_cursorBuffers.clear();
+    m_cursorBuffer = nullptr;
     if (!m_pageFlipPending) {
         deleteLater();
     } //else will be deleted in the page flip handler
@@ -104,6 +112,8 @@ void DrmOutput::releaseGbm()
 
 bool DrmOutput::hideCursor()
 {
+    m_shownCursorBuffer = nullptr;
+    m_cursorPosValid = false;
     return drmModeSetCursor(m_backend->fd(), m_crtc->id(), 0, 0, 0) == 0;
 }
 
@@ -115,16 +125,20 @@ bool DrmOutput::showCursor(DrmDumbBuffer *c)
 
 bool DrmOutput::showCursor()
 {
-    const bool ret = showCursor(m_cursor[m_cursorIndex]);
-    if (!ret) {
-        return ret;
+    if (!m_cursorBuffer) {
+        updateCursor();
+        if (!m_cursorBuffer) {
+            // no cursor image yet, nothing to show
+            return true;
+        }
     }
-
-    if (m_hasNewCursor) {
-        m_cursorIndex = (m_cursorIndex + 1) % 2;
-        m_hasNewCursor = false;
+    if (m_shownCursorBuffer == m_cursorBuffer) {
+        return true;
+    }
+    const bool ret = showCursor(m_cursorBuffer);
+    if (ret) {
+        m_shownCursorBuffer = m_cursorBuffer;
     }
-
     return ret;
 }
 
@@ -166,20 +180,57 @@ void DrmOutput::updateCursor()
     if (cursorImage.isNull()) {
         return;
     }
-    m_hasNewCursor = true;
-    QImage *c = m_cursor[m_cursorIndex]->image();
-    c->fill(Qt::transparent);
+    m_cursorHotspot = matrixDisplay(cursorImage.size()).map(m_backend->softwareCursorHotspot());
 
-    QPainter p;
-    p.begin(c);
-    p.setWorldTransform(matrixDisplay(QSize(cursorImage.width(), cursorImage.height())).toTransform());
-    p.drawImage(QPoint(0, 0), cursorImage);
-    p.end();
+    auto it = std::find_if(m_cursorBuffers.begin(), m_cursorBuffers.end(),
+        [this, &cursorImage] (const CursorBuffer &cursor) {
+            return cursor.imageKey == cursorImage.cacheKey() && cursor.orientation == orientation() &&
+                   cursor.scale == scale();
+        }
+    );
+    CursorBuffer cursor;
+    if (it != m_cursorBuffers.end()) {
+        // e.g. the next frame of an animated cursor, the buffer is ready to be shown
+        cursor = *it;
+        m_cursorBuffers.erase(it);
+    } else {
+        // Reuse the least recently used buffer. It can't be the one on screen, so it can
+        // be painted without tearing.
+        if (!m_cursorBuffers.isEmpty() &&
+                (m_cursorBuffers.first().imageKey == 0 || m_cursorBuffers.count() >= s_maxCursorBuffers)) {
+            cursor = m_cursorBuffers.takeFirst();
+        } else {
+            cursor.buffer = m_backend->createBuffer(m_cursorSize);
+            if (!cursor.buffer->map(QImage::Format_ARGB32_Premultiplied)) {
+                delete cursor.buffer;
+                return;
+            }
+        }
+        cursor.imageKey = cursorImage.cacheKey();
+        cursor.orientation = orientation();
+        cursor.scale = scale();
+
+        QImage *c = cursor.buffer->image();
+        c->fill(Qt::transparent);
+
+        QPainter p;
+        p.begin(c);
+        p.setWorldTransform(matrixDisplay(QSize(cursorImage.width(), cursorImage.height())).toTransform());
+        p.drawImage(QPoint(0, 0), cursorImage);
+        p.end();
+    }
+    m_cursorBuffers.append(cursor);
+    m_cursorBuffer = cursor.buffer;
 }
 
 void DrmOutput::moveCursor(const QPoint &globalPos)
 {
-    const QMatrix4x4 hotspotMatrix = matrixDisplay(m_backend->softwareCursor().size());
+    if (m_cursorBuffer &&
+            (m_cursorBuffers.last().orientation != orientation() || m_cursorBuffers.last().scale != scale())) {
+        // the output changed since the cursor buffer was selected
+        updateCursor();
+        showCursor();
+    }
 
     QPoint p = globalPos - AbstractWaylandOutput::globalPos();
     switch (orientation()) {
@@ -197,8 +248,14 @@ void DrmOutput::moveCursor(const QPoint &globalPos)
         break;
     }
     p *= scale();
-    p -= hotspotMatrix.map(m_backend->softwareCursorHotspot());
-    drmModeMoveCursor(m_backend->fd(), m_crtc->id(), p.x(), p.y());
+    p -= m_cursorHotspot;
+    if (m_cursorPosValid && p == m_cursorPos) {
+        return;
+    }
+    if (drmModeMoveCursor(m_backend->fd(), m_crtc->id(), p.x(), p.y()) == 0) {
+        m_cursorPos = p;
+        m_cursorPosValid = true;
+    }
 }
 
 static QHash<int, QByteArray> s_connectorNames = {
@@ -444,16 +501,15 @@ bool DrmOutput::initCursorPlane()       // TODO: Add call in init (but needs lay
 
 bool DrmOutput::initCursor(const QSize &cursorSize)
 {
-    auto createCursor = [this, cursorSize] (int index) {
-        m_cursor[index] = m_backend->createBuffer(cursorSize);
-        if (!m_cursor[index]->map(QImage::Format_ARGB32_Premultiplied)) {
-            return false;
-        }
-        return true;
-    };
-    if (!createCursor(0) || !createCursor(1)) {
+    m_cursorSize = cursorSize;
+    // make sure cursor buffers can be created, the first one is used by the first cursor image
+    CursorBuffer cursor;
+    cursor.buffer = m_backend->createBuffer(cursorSize);
+    if (!cursor.buffer->map(QImage::Format_ARGB32_Premultiplied)) {
+        delete cursor.buffer;
         return false;
     }
+    m_cursorBuffers.append(cursor);
     return true;
 }
 
@@ -735,7 +791,7 @@ void DrmOutput::setWaylandMode()
                                           refreshRateForMode(&m_mode));
 }
 
-void DrmOutput::pageFlipped()
+void DrmOutput::pageFlipped(std::chrono::nanoseconds timestamp, quint32 sequence)
 {
     Q_ASSERT(m_pageFlipPending);
     m_pageFlipPending = false;
@@ -743,6 +799,7 @@ void DrmOutput::pageFlipped()
         deleteLater();
         return;
     }
+    notifyFramePresented(timestamp, sequence);
 
     if (!m_crtc) {
         return;
@@ -58,7 +58,7 @@ public:
     void moveCursor(const QPoint &globalPos);
     bool init(drmModeConnector *connector);
     bool present(DrmBuffer *buffer);
-    void pageFlipped();
+    void pageFlipped(std::chrono::nanoseconds timestamp, quint32 sequence);
 
     // These values are defined by the kernel
     enum class DpmsMode {
@@ -156,9 +156,28 @@ private:
         QPoint globalPos;
         bool valid = false;
     } m_lastWorkingState;
-    DrmDumbBuffer *m_cursor[2] = {nullptr, nullptr};
-    int m_cursorIndex = 0;
-    bool m_hasNewCursor = false;
+
+    /**
+     * A cursor image painted with the output transformation. Animated cursors cycle
+     * through their frames, so the images are kept instead of being repainted.
+     */
+    struct CursorBuffer {
+        DrmDumbBuffer *buffer = nullptr;
+        // QImage::cacheKey() of the cursor image, 0 for a buffer which is not used yet
+        qint64 imageKey = 0;
+        Qt::ScreenOrientation orientation = Qt::PrimaryOrientation;
+        qreal scale = 1;
+    };
+    // the most recently used cursor buffer is the last one
+    QVector<CursorBuffer> m_cursorBuffers;
+    QSize m_cursorSize;
+    DrmDumbBuffer *m_cursorBuffer = nullptr;
+    DrmDumbBuffer *m_shownCursorBuffer = nullptr;
+    // hotspot of the cursor buffer in device coordinates
+    QPoint m_cursorHotspot;
+    // the position last passed to the kernel
+    QPoint m_cursorPos;
+    bool m_cursorPosValid = false;
     bool m_deleted = false;
 };
 
@@ -62,6 +62,8 @@ EglGbmBackend::EglGbmBackend(DrmBackend *b)
 
 EglGbmBackend::~EglGbmBackend()
 {
+    // the capture buffers of remote access need the context
+    m_remoteaccessManager.reset();
     cleanup();
 }
 
@@ -162,7 +164,7 @@ void EglGbmBackend::initRemotePresent()
     }
 
     qCDebug(KWIN_DRM) << "Support for remote access enabled";
-    m_remoteaccessManager.reset(new RemoteAccessManager);
+    m_remoteaccessManager.reset(new RemoteAccessManager(this, m_backend));
 }
 
 bool EglGbmBackend::resetOutput(Output &o, DrmOutput *drmOutput)
@@ -299,18 +301,22 @@ void EglGbmBackend::present()
 {
     for (auto &o: m_outputs) {
         makeContextCurrent(o);
-        presentOnOutput(o);
+        presentOnOutput(o, o.output->geometry());
     }
 }
 
-void EglGbmBackend::presentOnOutput(EglGbmBackend::Output &o)
+void EglGbmBackend::presentOnOutput(EglGbmBackend::Output &o, const QRegion &damage)
 {
-    eglSwapBuffers(eglDisplay(), o.eglSurface);
+    if (m_remoteaccessManager) {
+        // the back buffer still holds the new frame
+        m_remoteaccessManager->captureFrame(o.output);
+    }
+    swapBuffers(o.eglSurface, damage, o.output->geometry(), o.output->scale());
     o.buffer = m_backend->createBuffer(o.gbmSurface);
     if(m_remoteaccessManager && gbm_surface_has_free_buffers(o.gbmSurface->surface())) {
         // GBM surface is released on page flip so
         // we should pass the buffer before it's presented
-        m_remoteaccessManager->passBuffer(o.output, o.buffer);
+        m_remoteaccessManager->passBuffer(o.output, o.buffer, damage);
     }
     m_backend->present(o.buffer, o.output);
 
@@ -357,6 +363,15 @@ QRegion EglGbmBackend::prepareRenderingForScreen(int screenId)
     return QRegion();
 }
 
+void EglGbmBackend::aboutToStartPainting(int screenId, const QRegion &damage)
+{
+    if (screenId < 0 || screenId >= m_outputs.count()) {
+        return;
+    }
+    const Output &o = m_outputs.at(screenId);
+    setDamageRegion(o.eglSurface, damage, o.output->geometry(), o.output->scale());
+}
+
 void EglGbmBackend::endRenderingFrame(const QRegion &renderedRegion, const QRegion &damagedRegion)
 {
     Q_UNUSED(renderedRegion)
@@ -366,7 +381,10 @@ void EglGbmBackend::endRenderingFrame(const QRegion &renderedRegion, const QRegi
 void EglGbmBackend::endRenderingFrameForScreen(int screenId, const QRegion &renderedRegion, const QRegion &damagedRegion)
 {
     Output &o = m_outputs[screenId];
-    if (damagedRegion.intersected(o.output->geometry()).isEmpty() && screenId == 0) {
+    // With partial updates the damage region of the repaired back buffer has already been
+    // set for this frame, it can't be set again before the buffer is swapped.
+    const bool mustSwap = supportsPartialUpdate() && renderedRegion.intersects(o.output->geometry());
+    if (!mustSwap && damagedRegion.intersected(o.output->geometry()).isEmpty()) {
 
         // If the damaged region of a window is fully occluded, the only
         // rendering done, if any, will have been to repair a reused back
@@ -378,22 +396,13 @@ void EglGbmBackend::endRenderingFrameForScreen(int screenId, const QRegion &rend
         if (!renderedRegion.intersected(o.output->geometry()).isEmpty())
             glFlush();
 
-        for (auto &o: m_outputs) {
-            o.bufferAge = 1;
-        }
+        o.bufferAge = 1;
         return;
     }
-    presentOnOutput(o);
+    presentOnOutput(o, damagedRegion.intersected(o.output->geometry()));
 
     // Save the damaged region to history
-    // Note: damage history is only collected for the first screen. For any other screen full repaints
-    // are triggered. This is due to a limitation in Scene::paintGenericScreen which resets the Toplevel's
-    // repaint. So multiple calls to Scene::paintScreen as it's done in multi-output rendering only
-    // have correct damage information for the first screen. If we try to track damage nevertheless,
-    // it creates artifacts. So for the time being we work around the problem by only supporting buffer
-    // age on the first output. To properly support buffer age on all outputs the rendering needs to
-    // be refactored in general.
-    if (supportsBufferAge() && screenId == 0) {
+    if (supportsBufferAge()) {
         if (o.damageHistory.count() > 10) {
             o.damageHistory.removeLast();
         }
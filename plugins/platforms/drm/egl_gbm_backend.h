@@ -50,6 +50,7 @@ public:
     bool usesOverlayWindow() const override;
     bool perScreenRendering() const override;
     QRegion prepareRenderingForScreen(int screenId) override;
+    void aboutToStartPainting(int screenId, const QRegion &damage) override;
     void init() override;
 
 protected:
@@ -74,7 +75,7 @@ private:
     };
     bool resetOutput(Output &output, DrmOutput *drmOutput);
     bool makeContextCurrent(const Output &output);
-    void presentOnOutput(Output &output);
+    void presentOnOutput(Output &output, const QRegion &damage);
     void cleanupOutput(const Output &output);
     void createOutput(DrmOutput *output);
     DrmBackend *m_backend;
@@ -22,8 +22,19 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "remoteaccess_manager.h"
 #include "logging.h"
 #include "drm_backend.h"
+#include "egl_gbm_backend.h"
+#include "../../../composite.h"
+#include "../../../toplevel.h"
 #include "../../../wayland_server.h"
+#include "../../../workspace.h"
 
+#include <kwinglutils.h>
+
+// Qt
+#include <QDBusConnection>
+#include <QDBusMetaType>
+#include <QTimer>
+#include <QUuid>
 // system
 #include <KWayland/Server/output_interface.h>
 #include <unistd.h>
@@ -34,8 +45,97 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 namespace KWin
 {
 
-RemoteAccessManager::RemoteAccessManager(QObject *parent)
+// number of capture buffers which are filled at the same time
+static const int s_maxCaptureBuffers = 4;
+
+/**
+ * A linear gbm buffer which can be rendered to and exported as a dmabuf.
+ */
+class RemoteAccessBuffer
+{
+public:
+    RemoteAccessBuffer(EglGbmBackend *backend, gbm_device *device, const QSize &size);
+    ~RemoteAccessBuffer();
+
+    bool isValid() const {
+        return m_target && m_target->valid();
+    }
+    QSize size() const {
+        return m_size;
+    }
+    gbm_bo *bo() const {
+        return m_bo;
+    }
+    GLRenderTarget *renderTarget() const {
+        return m_target.data();
+    }
+
+private:
+    EglGbmBackend *m_backend;
+    QSize m_size;
+    gbm_bo *m_bo = nullptr;
+    EGLImageKHR m_image = EGL_NO_IMAGE_KHR;
+    GLuint m_texture = 0;
+    QScopedPointer<GLRenderTarget> m_target;
+};
+
+RemoteAccessBuffer::RemoteAccessBuffer(EglGbmBackend *backend, gbm_device *device, const QSize &size)
+    : m_backend(backend)
+    , m_size(size)
+{
+    m_bo = gbm_bo_create(device, size.width(), size.height(), GBM_FORMAT_ARGB8888,
+                         GBM_BO_USE_RENDERING | GBM_BO_USE_LINEAR);
+    if (!m_bo) {
+        qCWarning(KWIN_DRM) << "Couldn't create gbm buffer for remote access capture";
+        return;
+    }
+    const int fd = gbm_bo_get_fd(m_bo);
+    if (fd < 0) {
+        qCWarning(KWIN_DRM) << "Couldn't export gbm buffer for remote access capture";
+        return;
+    }
+    const EGLint attribs[] = {
+        EGL_WIDTH,                      EGLint(size.width()),
+        EGL_HEIGHT,                     EGLint(size.height()),
+        EGL_LINUX_DRM_FOURCC_EXT,       EGLint(gbm_bo_get_format(m_bo)),
+        EGL_DMA_BUF_PLANE0_FD_EXT,      fd,
+        EGL_DMA_BUF_PLANE0_OFFSET_EXT,  0,
+        EGL_DMA_BUF_PLANE0_PITCH_EXT,   EGLint(gbm_bo_get_stride(m_bo)),
+        EGL_NONE
+    };
+    m_image = eglCreateImageKHR(m_backend->eglDisplay(), EGL_NO_CONTEXT, EGL_LINUX_DMA_BUF_EXT,
+                                (EGLClientBuffer) nullptr, attribs);
+    // the image holds its own reference to the buffer
+    close(fd);
+    if (m_image == EGL_NO_IMAGE_KHR) {
+        qCWarning(KWIN_DRM) << "Couldn't import gbm buffer for remote access capture";
+        return;
+    }
+    glGenTextures(1, &m_texture);
+    glBindTexture(GL_TEXTURE_2D, m_texture);
+    glEGLImageTargetTexture2DOES(GL_TEXTURE_2D, (GLeglImageOES) m_image);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    m_target.reset(new GLRenderTarget(GLTexture(m_texture, GL_RGBA8, size)));
+}
+
+RemoteAccessBuffer::~RemoteAccessBuffer()
+{
+    m_target.reset();
+    if (m_texture) {
+        glDeleteTextures(1, &m_texture);
+    }
+    if (m_image != EGL_NO_IMAGE_KHR) {
+        eglDestroyImageKHR(m_backend->eglDisplay(), m_image);
+    }
+    if (m_bo) {
+        gbm_bo_destroy(m_bo);
+    }
+}
+
+RemoteAccessManager::RemoteAccessManager(EglGbmBackend *backend, DrmBackend *drmBackend, QObject *parent)
     : QObject(parent)
+    , m_backend(backend)
+    , m_drmBackend(drmBackend)
 {
     if (waylandServer()) {
         m_interface = waylandServer()->display()->createRemoteAccessManager(this);
@@ -44,10 +144,24 @@ RemoteAccessManager::RemoteAccessManager(QObject *parent)
         connect(m_interface, &RemoteAccessManagerInterface::bufferReleased,
                 this, &RemoteAccessManager::releaseBuffer);
     }
+    qDBusRegisterMetaType<QList<QRect>>();
+    QDBusConnection::sessionBus().registerObject(QStringLiteral("/RemoteAccess"), this,
+                                                 QDBusConnection::ExportScriptableContents);
 }
 
 RemoteAccessManager::~RemoteAccessManager()
 {
+    QDBusConnection::sessionBus().unregisterObject(QStringLiteral("/RemoteAccess"));
+    for (Capture *capture : qAsConst(m_captures)) {
+        QDBusConnection::sessionBus().send(capture->replyMessage.createErrorReply(
+            QDBusError::Failed, QStringLiteral("Remote access got shut down")));
+    }
+    qDeleteAll(m_captures);
+    if (!m_buffers.isEmpty()) {
+        // the buffers hold textures and images of the compositing context
+        m_backend->makeCurrent();
+        qDeleteAll(m_buffers);
+    }
     if (m_interface) {
         m_interface->destroy();
     }
@@ -62,12 +176,18 @@ void RemoteAccessManager::releaseBuffer(const BufferHandle *buf)
     delete buf;
 }
 
-void RemoteAccessManager::passBuffer(DrmOutput *output, DrmBuffer *buffer)
+void RemoteAccessManager::setMaximumFrameRate(uint framesPerSecond)
+{
+    m_frameInterval = framesPerSecond ? 1000 / framesPerSecond : 0;
+}
+
+void RemoteAccessManager::passBuffer(DrmOutput *output, DrmBuffer *buffer, const QRegion &damage)
 {
     DrmSurfaceBuffer* gbmbuf = static_cast<DrmSurfaceBuffer *>(buffer);
 
     // no connected RemoteAccess instance
     if (!m_interface || !m_interface->isBound()) {
+        m_outputs.clear();
         return;
     }
 
@@ -76,6 +196,51 @@ void RemoteAccessManager::passBuffer(DrmOutput *output, DrmBuffer *buffer)
         return;
     }
 
+    auto it = m_outputs.find(output);
+    if (it == m_outputs.end()) {
+        it = m_outputs.insert(output, OutputState());
+        // the first buffer is complete
+        it->damage = output->geometry();
+        // the state is dropped when the clients go away, don't connect again then
+        connect(output, &QObject::destroyed, this, &RemoteAccessManager::removeOutput, Qt::UniqueConnection);
+    }
+    OutputState &state = *it;
+    state.damage += damage;
+    if (state.damage.isEmpty()) {
+        // the client still has the same content
+        return;
+    }
+    if (m_frameInterval && state.lastFrame.isValid() && state.lastFrame.elapsed() < m_frameInterval) {
+        // make sure the accumulated damage arrives even if nothing else changes
+        if (!state.repaintScheduled) {
+            state.repaintScheduled = true;
+            QTimer::singleShot(m_frameInterval - state.lastFrame.elapsed(), this,
+                [this, output] {
+                    auto it = m_outputs.find(output);
+                    if (it == m_outputs.end()) {
+                        return;
+                    }
+                    it->repaintScheduled = false;
+                    // A frame is only rendered for damage, repainting what the skipped
+                    // frames changed keeps it limited to the area the clients get told about
+                    if (Compositor::self() && !it->damage.isEmpty()) {
+                        Compositor::self()->addRepaint(it->damage);
+                    }
+                }
+            );
+        }
+        return;
+    }
+
+    const QRect geometry = output->geometry();
+    QList<QRect> rects;
+    for (const QRect &rect : state.damage.intersected(geometry)) {
+        rects << rect.translated(-geometry.topLeft());
+    }
+    emit frameDamaged(output->name(), state.sequence++, rects);
+    state.damage = QRegion();
+    state.lastFrame.start();
+
     auto buf = new BufferHandle;
     auto bo = gbmbuf->getBo();
     buf->setFd(gbm_bo_get_fd(bo));
@@ -86,4 +251,173 @@ void RemoteAccessManager::passBuffer(DrmOutput *output, DrmBuffer *buffer)
     m_interface->sendBufferReady(output->waylandOutput().data(), buf);
 }
 
+QDBusUnixFileDescriptor RemoteAccessManager::captureRegion(int x, int y, int width, int height, int &stride, uint &format)
+{
+    // the values are delivered with the delayed reply
+    stride = 0;
+    format = 0;
+    const QRect geometry(x, y, width, height);
+    if (geometry.isEmpty()) {
+        sendErrorReply(QDBusError::InvalidArgs, QStringLiteral("Invalid area requested"));
+        return QDBusUnixFileDescriptor();
+    }
+    scheduleCapture(geometry, false);
+    return QDBusUnixFileDescriptor();
+}
+
+QDBusUnixFileDescriptor RemoteAccessManager::captureWindow(const QString &uuid, int &width, int &height,
+                                                           int &stride, uint &format)
+{
+    width = height = stride = 0;
+    format = 0;
+    const QUuid id(uuid);
+    Toplevel *window = nullptr;
+    if (workspace() && !id.isNull()) {
+        window = workspace()->findToplevel(
+            [id] (const Toplevel *t) {
+                return t->internalId() == id;
+            }
+        );
+    }
+    if (!window || window->frameGeometry().isEmpty()) {
+        sendErrorReply(QDBusError::InvalidArgs, QStringLiteral("Invalid window requested"));
+        return QDBusUnixFileDescriptor();
+    }
+    scheduleCapture(window->frameGeometry(), true);
+    return QDBusUnixFileDescriptor();
+}
+
+void RemoteAccessManager::scheduleCapture(const QRect &geometry, bool replyWithSize)
+{
+    QRegion outputs;
+    for (DrmOutput *output : m_drmBackend->drmOutputs()) {
+        outputs += output->geometry();
+    }
+    if (!outputs.intersects(geometry)) {
+        sendErrorReply(QDBusError::InvalidArgs, QStringLiteral("The requested area is not on any output"));
+        return;
+    }
+    auto capture = new Capture;
+    capture->replyMessage = message();
+    capture->replyWithSize = replyWithSize;
+    capture->geometry = geometry;
+    capture->missing = outputs & geometry;
+    setDelayedReply(true);
+    m_captures << capture;
+    if (Compositor::self()) {
+        Compositor::self()->addRepaint(geometry);
+    }
+}
+
+void RemoteAccessManager::removeOutput(QObject *output)
+{
+    m_outputs.remove(static_cast<DrmOutput *>(output));
+}
+
+bool RemoteAccessManager::hasFreeBuffer() const
+{
+    return m_buffers.count() < s_maxCaptureBuffers;
+}
+
+RemoteAccessBuffer *RemoteAccessManager::acquireBuffer(const QSize &size)
+{
+    Q_ASSERT(hasFreeBuffer());
+    // Every capture gets a new buffer. There's no telling when a client is done reading
+    // a delivered one, so it's never written to again.
+    auto buffer = new RemoteAccessBuffer(m_backend, m_drmBackend->gbmDevice(), size);
+    if (!buffer->isValid()) {
+        delete buffer;
+        return nullptr;
+    }
+    m_buffers << buffer;
+    return buffer;
+}
+
+void RemoteAccessManager::dropBuffer(RemoteAccessBuffer *buffer)
+{
+    // the dmabuf stays alive as long as the client keeps its file descriptor
+    m_buffers.removeOne(buffer);
+    delete buffer;
+}
+
+void RemoteAccessManager::captureFrame(DrmOutput *output)
+{
+    const QRect outputGeometry = output->geometry();
+    const qreal scale = output->scale();
+    const int surfaceHeight = outputGeometry.height() * scale;
+    QRegion waiting;
+    auto it = m_captures.begin();
+    while (it != m_captures.end()) {
+        Capture *capture = *it;
+        const QRect source = capture->geometry & outputGeometry;
+        if (source.isEmpty()) {
+            ++it;
+            continue;
+        }
+        if (!capture->buffer) {
+            if (!hasFreeBuffer()) {
+                // all buffers are still being filled, try again with the next frame
+                waiting += source;
+                ++it;
+                continue;
+            }
+            capture->buffer = acquireBuffer(capture->geometry.size());
+            if (!capture->buffer) {
+                QDBusConnection::sessionBus().send(capture->replyMessage.createErrorReply(
+                    QDBusError::Failed, QStringLiteral("Couldn't allocate a buffer")));
+                delete capture;
+                it = m_captures.erase(it);
+                continue;
+            }
+        }
+        // the dmabuf is read top-down, so flip while blitting from the bottom-up framebuffer
+        const QRect local = source.translated(-outputGeometry.topLeft());
+        const QRect destination = source.translated(-capture->geometry.topLeft());
+        GLRenderTarget::pushRenderTarget(capture->buffer->renderTarget());
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+        glBlitFramebuffer(local.x() * scale, surfaceHeight - (local.y() + local.height()) * scale,
+                          (local.x() + local.width()) * scale, surfaceHeight - local.y() * scale,
+                          destination.x(), destination.y() + destination.height(),
+                          destination.x() + destination.width(), destination.y(),
+                          GL_COLOR_BUFFER_BIT, GL_LINEAR);
+        GLRenderTarget::popRenderTarget();
+
+        capture->missing -= source;
+        if (capture->missing.isEmpty()) {
+            sendCapture(capture);
+            it = m_captures.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    if (!waiting.isEmpty() && Compositor::self()) {
+        Compositor::self()->addRepaint(waiting);
+    }
+}
+
+void RemoteAccessManager::sendCapture(Capture *capture)
+{
+    // the buffer is shared with the client through implicit synchronization, flushing
+    // is enough to make the client wait for the copy
+    glFlush();
+    gbm_bo *bo = capture->buffer->bo();
+    const int fd = gbm_bo_get_fd(bo);
+    if (fd < 0) {
+        QDBusConnection::sessionBus().send(capture->replyMessage.createErrorReply(
+            QDBusError::Failed, QStringLiteral("Couldn't export the buffer")));
+        dropBuffer(capture->buffer);
+        delete capture;
+        return;
+    }
+    QVariantList arguments{QVariant::fromValue(QDBusUnixFileDescriptor(fd))};
+    if (capture->replyWithSize) {
+        arguments << capture->geometry.width() << capture->geometry.height();
+    }
+    arguments << int(gbm_bo_get_stride(bo)) << uint(gbm_bo_get_format(bo));
+    QDBusConnection::sessionBus().send(capture->replyMessage.createReply(arguments));
+    close(fd);
+    dropBuffer(capture->buffer);
+    delete capture;
+}
+
 } // KWin namespace
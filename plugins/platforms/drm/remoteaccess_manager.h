@@ -24,7 +24,13 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <KWayland/Server/display.h>
 #include <KWayland/Server/remote_access_interface.h>
 // Qt
+#include <QDBusContext>
+#include <QDBusMessage>
+#include <QDBusUnixFileDescriptor>
+#include <QElapsedTimer>
+#include <QHash>
 #include <QObject>
+#include <QRegion>
 
 struct gbm_bo;
 struct gbm_surface;
@@ -32,28 +38,103 @@ struct gbm_surface;
 namespace KWin
 {
 
+class DrmBackend;
 class DrmOutput;
 class DrmBuffer;
+class EglGbmBackend;
+class RemoteAccessBuffer;
 
 using KWayland::Server::RemoteAccessManagerInterface;
 using KWayland::Server::BufferHandle;
 
-class RemoteAccessManager : public QObject
+/**
+ * Hands out the rendered frames to remote access clients.
+ *
+ * Besides the full output buffers which are passed through the Wayland interface, the
+ * @c org.kde.kwin.RemoteAccess D-Bus interface allows consumers to learn which parts of
+ * a frame changed, to limit the rate of frames and to capture single windows or regions
+ * into dmabufs.
+ */
+class RemoteAccessManager : public QObject, protected QDBusContext
 {
     Q_OBJECT
+    Q_CLASSINFO("D-Bus Interface", "org.kde.kwin.RemoteAccess")
 public:
-    explicit RemoteAccessManager(QObject *parent = nullptr);
+    explicit RemoteAccessManager(EglGbmBackend *backend, DrmBackend *drmBackend, QObject *parent = nullptr);
     ~RemoteAccessManager() override;
 
-    void passBuffer(DrmOutput *output, DrmBuffer *buffer);
-
-signals:
+    /**
+     * Passes @p buffer of @p output to the remote access clients. @p damage is the area,
+     * in global coordinates, which changed since the previous frame of the output.
+     */
+    void passBuffer(DrmOutput *output, DrmBuffer *buffer, const QRegion &damage);
+    /**
+     * Copies the requested captures from the rendered, but not yet presented frame of
+     * @p output. The OpenGL context of the output has to be current.
+     */
+    void captureFrame(DrmOutput *output);
+
+    /**
+     * Limits the rate at which buffers are passed to the clients, @c 0 removes the limit.
+     * Damage of skipped frames is delivered with the next passed buffer.
+     */
+    Q_SCRIPTABLE void setMaximumFrameRate(uint framesPerSecond);
+    /**
+     * Copies @p width x @p height pixels at @p x, @p y in global coordinates into a dmabuf
+     * with the next frame. The returned buffer is linear and has @p stride bytes per line
+     * and the DRM fourcc @p format.
+     *
+     * Every capture is delivered in a new buffer, which is not written to afterwards.
+     */
+    Q_SCRIPTABLE QDBusUnixFileDescriptor captureRegion(int x, int y, int width, int height, int &stride, uint &format);
+    /**
+     * Like captureRegion for the frame geometry of the window with the internal id @p uuid.
+     * The window is copied from the screen, windows stacked above it are included.
+     */
+    Q_SCRIPTABLE QDBusUnixFileDescriptor captureWindow(const QString &uuid, int &width, int &height,
+                                                       int &stride, uint &format);
+
+Q_SIGNALS:
     void bufferNoLongerNeeded(qint32 gbm_handle);
+    /**
+     * Emitted before the @p sequence th buffer of the output called @p output gets passed
+     * to the clients, @p damage is the area which changed since the previously passed
+     * buffer in output local coordinates.
+     */
+    Q_SCRIPTABLE void frameDamaged(const QString &output, uint sequence, const QList<QRect> &damage);
 
 private:
+    struct OutputState {
+        QRegion damage;
+        QElapsedTimer lastFrame;
+        uint sequence = 0;
+        bool repaintScheduled = false;
+    };
+    struct Capture {
+        QDBusMessage replyMessage;
+        // whether the reply carries the size, it's implied by the request for regions
+        bool replyWithSize = false;
+        QRect geometry;
+        // the parts which were not copied from an output yet
+        QRegion missing;
+        RemoteAccessBuffer *buffer = nullptr;
+    };
     void releaseBuffer(const BufferHandle *buf);
+    void removeOutput(QObject *output);
+    void scheduleCapture(const QRect &geometry, bool replyWithSize);
+    bool hasFreeBuffer() const;
+    RemoteAccessBuffer *acquireBuffer(const QSize &size);
+    void dropBuffer(RemoteAccessBuffer *buffer);
+    void sendCapture(Capture *capture);
 
     RemoteAccessManagerInterface *m_interface = nullptr;
+    EglGbmBackend *m_backend;
+    DrmBackend *m_drmBackend;
+    QHash<DrmOutput*, OutputState> m_outputs;
+    qint64 m_frameInterval = 0;
+    QList<Capture*> m_captures;
+    // the buffers of the captures which are still being filled
+    QList<RemoteAccessBuffer*> m_buffers;
 };
 
 } // KWin namespace
@@ -48,7 +48,7 @@ QImage *VirtualQPainterBackend::bufferForScreen(int screen)
 
 bool VirtualQPainterBackend::needsFullRepaint() const
 {
-    return true;
+    return m_needsFullRepaint;
 }
 
 void VirtualQPainterBackend::prepareRenderingFrame()
@@ -63,12 +63,15 @@ void VirtualQPainterBackend::createOutputs()
         buffer.fill(Qt::black);
         m_backBuffers << buffer;
     }
+    m_needsFullRepaint = true;
 }
 
 void VirtualQPainterBackend::present(int mask, const QRegion &damage)
 {
     Q_UNUSED(mask)
     Q_UNUSED(damage)
+    // the back buffers are kept between frames, only the damaged areas need to be updated
+    m_needsFullRepaint = false;
     if (m_backend->saveFrames()) {
         for (int i=0; i < m_backBuffers.size() ; i++) {
             m_backBuffers[i].save(QStringLiteral("%1/screen%2-%3.png").arg(m_backend->screenshotDirPath(), QString::number(i), QString::number(m_frameCounter++)));
@@ -51,6 +51,7 @@ private:
     QVector<QImage> m_backBuffers;
     VirtualBackend *m_backend;
     int m_frameCounter = 0;
+    bool m_needsFullRepaint = true;
 };
 
 }
@@ -282,11 +282,11 @@ void EglWaylandBackend::present()
 {
     for (auto *output: qAsConst(m_outputs)) {
         makeContextCurrent(output);
-        presentOnSurface(output);
+        presentOnSurface(output, output->m_waylandOutput->geometry());
     }
 }
 
-void EglWaylandBackend::presentOnSurface(EglWaylandOutput *output)
+void EglWaylandBackend::presentOnSurface(EglWaylandOutput *output, const QRegion &damage)
 {
     output->m_waylandOutput->surface()->setupFrameCallback();
     if (!m_swapping) {
@@ -294,11 +294,9 @@ void EglWaylandBackend::presentOnSurface(EglWaylandOutput *output)
         Compositor::self()->aboutToSwapBuffers();
     }
 
+    swapBuffers(output->m_eglSurface, damage, output->m_waylandOutput->geometry(), output->m_waylandOutput->scale());
     if (supportsBufferAge()) {
-        eglSwapBuffers(eglDisplay(), output->m_eglSurface);
         eglQuerySurface(eglDisplay(), output->m_eglSurface, EGL_BUFFER_AGE_EXT, &output->m_bufferAge);
-    } else {
-        eglSwapBuffers(eglDisplay(), output->m_eglSurface);
     }
 
 }
@@ -348,6 +346,15 @@ QRegion EglWaylandBackend::prepareRenderingForScreen(int screenId)
     return QRegion();
 }
 
+void EglWaylandBackend::aboutToStartPainting(int screenId, const QRegion &damage)
+{
+    if (screenId < 0 || screenId >= m_outputs.count()) {
+        return;
+    }
+    const EglWaylandOutput *output = m_outputs.at(screenId);
+    setDamageRegion(output->m_eglSurface, damage, output->m_waylandOutput->geometry(), output->m_waylandOutput->scale());
+}
+
 void EglWaylandBackend::endRenderingFrame(const QRegion &renderedRegion, const QRegion &damagedRegion)
 {
     Q_UNUSED(renderedRegion)
@@ -357,7 +364,10 @@ void EglWaylandBackend::endRenderingFrame(const QRegion &renderedRegion, const Q
 void EglWaylandBackend::endRenderingFrameForScreen(int screenId, const QRegion &renderedRegion, const QRegion &damagedRegion)
 {
     EglWaylandOutput *output = m_outputs[screenId];
-    if (damagedRegion.intersected(output->m_waylandOutput->geometry()).isEmpty() && screenId == 0) {
+    // With partial updates the damage region of the repaired back buffer has already been
+    // set for this frame, it can't be set again before the buffer is swapped.
+    const bool mustSwap = supportsPartialUpdate() && renderedRegion.intersects(output->m_waylandOutput->geometry());
+    if (!mustSwap && damagedRegion.intersected(output->m_waylandOutput->geometry()).isEmpty()) {
 
         // If the damaged region of a window is fully occluded, the only
         // rendering done, if any, will have been to repair a reused back
@@ -370,17 +380,13 @@ void EglWaylandBackend::endRenderingFrameForScreen(int screenId, const QRegion &
             glFlush();
         }
 
-        for (auto *o : qAsConst(m_outputs)) {
-            o->m_bufferAge = 1;
-        }
+        output->m_bufferAge = 1;
         return;
     }
-    presentOnSurface(output);
+    presentOnSurface(output, damagedRegion.intersected(output->m_waylandOutput->geometry()));
 
     // Save the damaged region to history
-    // Note: damage history is only collected for the first screen. See EglGbmBackend
-    // for mor information regarding this limitation.
-    if (supportsBufferAge() && screenId == 0) {
+    if (supportsBufferAge()) {
         if (output->m_damageHistory.count() > 10) {
             output->m_damageHistory.removeLast();
         }
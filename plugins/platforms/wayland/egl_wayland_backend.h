@@ -82,6 +82,7 @@ public:
     SceneOpenGLTexturePrivate *createBackendTexture(SceneOpenGLTexture *texture) override;
     QRegion prepareRenderingFrame() override;
     QRegion prepareRenderingForScreen(int screenId) override;
+    void aboutToStartPainting(int screenId, const QRegion &damage) override;
     void endRenderingFrame(const QRegion &renderedRegion, const QRegion &damagedRegion) override;
     void endRenderingFrameForScreen(int screenId, const QRegion &damage, const QRegion &damagedRegion) override;
     bool usesOverlayWindow() const override;
@@ -104,7 +105,7 @@ private:
 
     bool makeContextCurrent(EglWaylandOutput *output);
     void present() override;
-    void presentOnSurface(EglWaylandOutput *output);
+    void presentOnSurface(EglWaylandOutput *output, const QRegion &damage);
 
     WaylandBackend *m_backend;
     QVector<EglWaylandOutput*> m_outputs;
@@ -348,7 +348,7 @@ void EglOnXBackend::presentSurface(EGLSurface surface, const QRegion &damage, co
             m_swapProfiler.begin();
         }
         // the entire screen changed, or we cannot do partial updates (which implies we enabled surface preservation)
-        eglSwapBuffers(eglDisplay(), surface);
+        swapBuffers(surface, damage, screenGeometry, 1.0);
         if (gs_tripleBufferNeedsDetection) {
             eglWaitGL();
             if (char result = m_swapProfiler.end()) {
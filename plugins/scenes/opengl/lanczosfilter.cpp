@@ -20,11 +20,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 *********************************************************************/
 
 #include "lanczosfilter.h"
-#include "x11client.h"
-#include "deleted.h"
 #include "effects.h"
 #include "screens.h"
-#include "unmanaged.h"
 #include "options.h"
 #include "workspace.h"
 
@@ -38,26 +35,35 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <QFile>
 #include <QtMath>
 
+#include <algorithm>
 #include <cmath>
 
 namespace KWin
 {
 
+// in ms: live thumbnails are rendered again at most 30 times per second
+static const int s_thumbnailUpdateInterval = 1000 / 30;
+
 LanczosFilter::LanczosFilter(QObject* parent)
     : QObject(parent)
     , m_offscreenTex(nullptr)
     , m_offscreenTarget(nullptr)
     , m_inited(false)
+    , m_mipmaps(false)
     , m_shader(nullptr)
     , m_uOffsets(0)
     , m_uKernel(0)
 {
+    m_clock.start();
+    connect(effects, &EffectsHandler::windowDamaged, this, &LanczosFilter::windowDamaged);
+    connect(effects, &EffectsHandler::windowDeleted, this, &LanczosFilter::windowDeleted);
 }
 
 LanczosFilter::~LanczosFilter()
 {
     delete m_offscreenTarget;
     delete m_offscreenTex;
+    discardCacheTextures();
 }
 
 void LanczosFilter::init()
@@ -70,12 +76,16 @@ void LanczosFilter::init()
         qCWarning(KWIN_OPENGL) << "Lanczos Filter forced on by environment variable";
     }
 
-    if (!force && options->glSmoothScale() != 2)
-        return; // disabled by config
     if (!GLRenderTarget::supported())
         return;
 
     GLPlatform *gl = GLPlatform::instance();
+    // without the lanczos filter the cached textures are produced from mipmaps,
+    // OpenGL ES 2 doesn't support mipmaps of arbitrary sizes
+    m_mipmaps = options->glSmoothScale() != 0 && (!gl->isGLES() || hasGLVersion(3, 0));
+
+    if (!force && options->glSmoothScale() != 2)
+        return; // disabled by config
     if (!force) {
         // The lanczos filter is reported to be broken with the Intel driver prior SandyBridge
         if (gl->driver() == Driver_Intel && gl->chipClass() < SandyBridge)
@@ -189,7 +199,7 @@ void LanczosFilter::performPaint(EffectWindowImpl* w, int mask, QRegion region,
         const QRect screenRect = Workspace::self()->clientArea(ScreenArea, w->screen(), w->desktop());
         // window geometry may not be bigger than screen geometry to fit into the FBO
         QRect winGeo(w->expandedGeometry());
-        if (m_shader && winGeo.width() <= screenRect.width() && winGeo.height() <= screenRect.height()) {
+        if ((m_shader || m_mipmaps) && winGeo.width() <= screenRect.width() && winGeo.height() <= screenRect.height()) {
             winGeo.translate(-w->geometry().topLeft());
             double left = winGeo.left();
             double top = winGeo.top();
@@ -206,43 +216,21 @@ void LanczosFilter::performPaint(EffectWindowImpl* w, int mask, QRegion region,
             int sw = width;
             int sh = height;
 
-            GLTexture *cachedTexture = static_cast< GLTexture*>(w->data(LanczosCacheRole).value<void*>());
-            if (cachedTexture) {
-                if (cachedTexture->width() == tw && cachedTexture->height() == th) {
-                    cachedTexture->bind();
-                    if (hardwareClipping) {
-                        glEnable(GL_SCISSOR_TEST);
-                    }
-
-                    glEnable(GL_BLEND);
-                    glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
-
-                    const qreal rgb = data.brightness() * data.opacity();
-                    const qreal a = data.opacity();
-
-                    ShaderBinder binder(ShaderTrait::MapTexture | ShaderTrait::Modulate | ShaderTrait::AdjustSaturation);
-                    GLShader *shader = binder.shader();
-                    QMatrix4x4 mvp = data.screenProjectionMatrix();
-                    mvp.translate(textureRect.x(), textureRect.y());
-                    shader->setUniform(GLShader::ModelViewProjectionMatrix, mvp);
-                    shader->setUniform(GLShader::ModulationConstant, QVector4D(rgb, rgb, rgb, a));
-                    shader->setUniform(GLShader::Saturation, data.saturation());
-
-                    cachedTexture->render(region, textureRect, hardwareClipping);
-
-                    glDisable(GL_BLEND);
-                    if (hardwareClipping) {
-                        glDisable(GL_SCISSOR_TEST);
+            auto it = m_cache.find(w);
+            if (it != m_cache.end()) {
+                if (it->texture->width() == tw && it->texture->height() == th &&
+                        (!it->dirty || m_clock.elapsed() - it->updateTime < s_thumbnailUpdateInterval)) {
+                    if (it->dirty) {
+                        // keep showing the previous content, the update follows in a later frame
+                        effects->addRepaint(textureRect);
                     }
-                    cachedTexture->unbind();
+                    paintCachedTexture(it->texture, textureRect, region, hardwareClipping, data);
                     m_timer.start(5000, this);
                     return;
-                } else {
-                    // offscreen texture not matching - delete
-                    delete cachedTexture;
-                    cachedTexture = nullptr;
-                    w->setData(LanczosCacheRole, QVariant());
                 }
+                // offscreen texture not matching or outdated - delete
+                delete it->texture;
+                m_cache.erase(it);
             }
 
             WindowPaintData thumbData = data;
@@ -266,78 +254,12 @@ void LanczosFilter::performPaint(EffectWindowImpl* w, int mask, QRegion region,
             glClear(GL_COLOR_BUFFER_BIT);
             w->sceneWindow()->performPaint(mask, infiniteRegion(), thumbData);
 
-            // Create a scratch texture and copy the rendered window into it
-            GLTexture tex(GL_RGBA8, sw, sh);
-            tex.setFilter(GL_LINEAR);
-            tex.setWrapMode(GL_CLAMP_TO_EDGE);
-            tex.bind();
-
-            glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, m_offscreenTex->height() - sh, sw, sh);
-
-            // Set up the shader for horizontal scaling
-            float dx = sw / float(tw);
-            int kernelSize;
-            createKernel(dx, &kernelSize);
-            createOffsets(kernelSize, sw, Qt::Horizontal);
-
-            ShaderManager::instance()->pushShader(m_shader.data());
-            m_shader->setUniform(GLShader::ModelViewProjectionMatrix, modelViewProjectionMatrix);
-            setUniforms();
-
-            // Draw the window back into the FBO, this time scaled horizontally
-            glClear(GL_COLOR_BUFFER_BIT);
-            QVector<float> verts;
-            QVector<float> texCoords;
-            verts.reserve(12);
-            texCoords.reserve(12);
-
-            texCoords << 1.0 << 0.0; verts << tw  << 0.0; // Top right
-            texCoords << 0.0 << 0.0; verts << 0.0 << 0.0; // Top left
-            texCoords << 0.0 << 1.0; verts << 0.0 << sh;  // Bottom left
-            texCoords << 0.0 << 1.0; verts << 0.0 << sh;  // Bottom left
-            texCoords << 1.0 << 1.0; verts << tw  << sh;  // Bottom right
-            texCoords << 1.0 << 0.0; verts << tw  << 0.0; // Top right
-            GLVertexBuffer *vbo = GLVertexBuffer::streamingBuffer();
-            vbo->reset();
-            vbo->setData(6, 2, verts.constData(), texCoords.constData());
-            vbo->render(GL_TRIANGLES);
-
-            // At this point we don't need the scratch texture anymore
-            tex.unbind();
-            tex.discard();
-
-            // create scratch texture for second rendering pass
-            GLTexture tex2(GL_RGBA8, tw, sh);
-            tex2.setFilter(GL_LINEAR);
-            tex2.setWrapMode(GL_CLAMP_TO_EDGE);
-            tex2.bind();
-
-            glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, m_offscreenTex->height() - sh, tw, sh);
-
-            // Set up the shader for vertical scaling
-            float dy = sh / float(th);
-            createKernel(dy, &kernelSize);
-            createOffsets(kernelSize, m_offscreenTex->height(), Qt::Vertical);
-            setUniforms();
-
-            // Now draw the horizontally scaled window in the FBO at the right
-            // coordinates on the screen, while scaling it vertically and blending it.
-            glClear(GL_COLOR_BUFFER_BIT);
-
-            verts.clear();
-
-            verts << tw  << 0.0; // Top right
-            verts << 0.0 << 0.0; // Top left
-            verts << 0.0 << th;  // Bottom left
-            verts << 0.0 << th;  // Bottom left
-            verts << tw  << th;  // Bottom right
-            verts << tw  << 0.0; // Top right
-            vbo->setData(6, 2, verts.constData(), texCoords.constData());
-            vbo->render(GL_TRIANGLES);
-
-            tex2.unbind();
-            tex2.discard();
-            ShaderManager::instance()->popShader();
+            // Draw the window back into the FBO scaled to the thumbnail size
+            if (m_shader) {
+                scaleLanczos(sw, sh, tw, th, modelViewProjectionMatrix);
+            } else {
+                scaleMipmapped(sw, sh, tw, th, modelViewProjectionMatrix);
+            }
 
             // create cache texture
             GLTexture *cache = new GLTexture(GL_RGBA8, tw, th);
@@ -346,36 +268,15 @@ void LanczosFilter::performPaint(EffectWindowImpl* w, int mask, QRegion region,
             cache->setWrapMode(GL_CLAMP_TO_EDGE);
             cache->bind();
             glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, m_offscreenTex->height() - th, tw, th);
+            cache->unbind();
             GLRenderTarget::popRenderTarget();
 
-            if (hardwareClipping) {
-                glEnable(GL_SCISSOR_TEST);
-            }
-
-            glEnable(GL_BLEND);
-            glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
-
-            const qreal rgb = data.brightness() * data.opacity();
-            const qreal a = data.opacity();
-
-            ShaderBinder binder(ShaderTrait::MapTexture | ShaderTrait::Modulate | ShaderTrait::AdjustSaturation);
-            GLShader *shader = binder.shader();
-            QMatrix4x4 mvp = data.screenProjectionMatrix();
-            mvp.translate(textureRect.x(), textureRect.y());
-            shader->setUniform(GLShader::ModelViewProjectionMatrix, mvp);
-            shader->setUniform(GLShader::ModulationConstant, QVector4D(rgb, rgb, rgb, a));
-            shader->setUniform(GLShader::Saturation, data.saturation());
-
-            cache->render(region, textureRect, hardwareClipping);
+            paintCachedTexture(cache, textureRect, region, hardwareClipping, data);
 
-            glDisable(GL_BLEND);
-
-            if (hardwareClipping) {
-                glDisable(GL_SCISSOR_TEST);
-            }
-
-            cache->unbind();
-            w->setData(LanczosCacheRole, QVariant::fromValue(static_cast<void*>(cache)));
+            CachedTexture cached;
+            cached.texture = cache;
+            cached.updateTime = m_clock.elapsed();
+            m_cache.insert(w, cached);
 
             // Delete the offscreen surface after 5 seconds
             m_timer.start(5000, this);
@@ -385,6 +286,153 @@ void LanczosFilter::performPaint(EffectWindowImpl* w, int mask, QRegion region,
     w->sceneWindow()->performPaint(mask, region, data);
 } // End of function
 
+void LanczosFilter::scaleLanczos(int sw, int sh, int tw, int th, const QMatrix4x4 &projection)
+{
+    // Create a scratch texture and copy the rendered window into it
+    GLTexture tex(GL_RGBA8, sw, sh);
+    tex.setFilter(GL_LINEAR);
+    tex.setWrapMode(GL_CLAMP_TO_EDGE);
+    tex.bind();
+
+    glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, m_offscreenTex->height() - sh, sw, sh);
+
+    // Set up the shader for horizontal scaling
+    float dx = sw / float(tw);
+    int kernelSize;
+    createKernel(dx, &kernelSize);
+    createOffsets(kernelSize, sw, Qt::Horizontal);
+
+    ShaderManager::instance()->pushShader(m_shader.data());
+    m_shader->setUniform(GLShader::ModelViewProjectionMatrix, projection);
+    setUniforms();
+
+    // Draw the window back into the FBO, this time scaled horizontally
+    glClear(GL_COLOR_BUFFER_BIT);
+    QVector<float> verts;
+    QVector<float> texCoords;
+    verts.reserve(12);
+    texCoords.reserve(12);
+
+    texCoords << 1.0 << 0.0; verts << tw  << 0.0; // Top right
+    texCoords << 0.0 << 0.0; verts << 0.0 << 0.0; // Top left
+    texCoords << 0.0 << 1.0; verts << 0.0 << sh;  // Bottom left
+    texCoords << 0.0 << 1.0; verts << 0.0 << sh;  // Bottom left
+    texCoords << 1.0 << 1.0; verts << tw  << sh;  // Bottom right
+    texCoords << 1.0 << 0.0; verts << tw  << 0.0; // Top right
+    GLVertexBuffer *vbo = GLVertexBuffer::streamingBuffer();
+    vbo->reset();
+    vbo->setData(6, 2, verts.constData(), texCoords.constData());
+    vbo->render(GL_TRIANGLES);
+
+    // At this point we don't need the scratch texture anymore
+    tex.unbind();
+    tex.discard();
+
+    // create scratch texture for second rendering pass
+    GLTexture tex2(GL_RGBA8, tw, sh);
+    tex2.setFilter(GL_LINEAR);
+    tex2.setWrapMode(GL_CLAMP_TO_EDGE);
+    tex2.bind();
+
+    glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, m_offscreenTex->height() - sh, tw, sh);
+
+    // Set up the shader for vertical scaling
+    float dy = sh / float(th);
+    createKernel(dy, &kernelSize);
+    createOffsets(kernelSize, m_offscreenTex->height(), Qt::Vertical);
+    setUniforms();
+
+    // Now draw the horizontally scaled window in the FBO at the right
+    // coordinates on the screen, while scaling it vertically and blending it.
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    verts.clear();
+
+    verts << tw  << 0.0; // Top right
+    verts << 0.0 << 0.0; // Top left
+    verts << 0.0 << th;  // Bottom left
+    verts << 0.0 << th;  // Bottom left
+    verts << tw  << th;  // Bottom right
+    verts << tw  << 0.0; // Top right
+    vbo->setData(6, 2, verts.constData(), texCoords.constData());
+    vbo->render(GL_TRIANGLES);
+
+    tex2.unbind();
+    tex2.discard();
+    ShaderManager::instance()->popShader();
+}
+
+void LanczosFilter::scaleMipmapped(int sw, int sh, int tw, int th, const QMatrix4x4 &projection)
+{
+    // Copy the rendered window into a mipmapped texture, sampling it with trilinear
+    // filtering avoids the aliasing of plain bilinear downscaling
+    const int levels = std::floor(std::log2(std::max(sw, sh))) + 1;
+    GLTexture tex(GL_RGBA8, sw, sh, levels);
+    tex.setFilter(GL_LINEAR_MIPMAP_LINEAR);
+    tex.setWrapMode(GL_CLAMP_TO_EDGE);
+    tex.bind();
+
+    glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, m_offscreenTex->height() - sh, sw, sh);
+    tex.generateMipmaps();
+
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    ShaderBinder binder(ShaderTrait::MapTexture);
+    binder.shader()->setUniform(GLShader::ModelViewProjectionMatrix, projection);
+    tex.render(infiniteRegion(), QRect(0, 0, tw, th));
+
+    tex.unbind();
+    tex.discard();
+}
+
+void LanczosFilter::paintCachedTexture(GLTexture *texture, const QRect &textureRect, const QRegion &region,
+                                       bool hardwareClipping, const WindowPaintData &data)
+{
+    texture->bind();
+    if (hardwareClipping) {
+        glEnable(GL_SCISSOR_TEST);
+    }
+
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+
+    const qreal rgb = data.brightness() * data.opacity();
+    const qreal a = data.opacity();
+
+    ShaderBinder binder(ShaderTrait::MapTexture | ShaderTrait::Modulate | ShaderTrait::AdjustSaturation);
+    GLShader *shader = binder.shader();
+    QMatrix4x4 mvp = data.screenProjectionMatrix();
+    mvp.translate(textureRect.x(), textureRect.y());
+    shader->setUniform(GLShader::ModelViewProjectionMatrix, mvp);
+    shader->setUniform(GLShader::ModulationConstant, QVector4D(rgb, rgb, rgb, a));
+    shader->setUniform(GLShader::Saturation, data.saturation());
+
+    texture->render(region, textureRect, hardwareClipping);
+
+    glDisable(GL_BLEND);
+    if (hardwareClipping) {
+        glDisable(GL_SCISSOR_TEST);
+    }
+    texture->unbind();
+}
+
+void LanczosFilter::windowDamaged(EffectWindow *w)
+{
+    auto it = m_cache.find(w);
+    if (it != m_cache.end()) {
+        it->dirty = true;
+    }
+}
+
+void LanczosFilter::windowDeleted(EffectWindow *w)
+{
+    auto it = m_cache.find(w);
+    if (it != m_cache.end()) {
+        delete it->texture;
+        m_cache.erase(it);
+    }
+}
+
 void LanczosFilter::timerEvent(QTimerEvent *event)
 {
     if (event->timerId() == m_timer.timerId()) {
@@ -394,28 +442,16 @@ void LanczosFilter::timerEvent(QTimerEvent *event)
         delete m_offscreenTex;
         m_offscreenTarget = nullptr;
         m_offscreenTex = nullptr;
-        foreach (X11Client *c, Workspace::self()->clientList()) {
-            discardCacheTexture(c->effectWindow());
-        }
-        foreach (X11Client *c, Workspace::self()->desktopList()) {
-            discardCacheTexture(c->effectWindow());
-        }
-        foreach (Unmanaged *u, Workspace::self()->unmanagedList()) {
-            discardCacheTexture(u->effectWindow());
-        }
-        foreach (Deleted *d, Workspace::self()->deletedList()) {
-            discardCacheTexture(d->effectWindow());
-        }
+        discardCacheTextures();
     }
 }
 
-void LanczosFilter::discardCacheTexture(EffectWindow *w)
+void LanczosFilter::discardCacheTextures()
 {
-    QVariant cachedTextureVariant = w->data(LanczosCacheRole);
-    if (cachedTextureVariant.isValid()) {
-        delete static_cast< GLTexture*>(cachedTextureVariant.value<void*>());
-        w->setData(LanczosCacheRole, QVariant());
+    for (const CachedTexture &cached : qAsConst(m_cache)) {
+        delete cached.texture;
     }
+    m_cache.clear();
 }
 
 void LanczosFilter::setUniforms()
@@ -24,6 +24,9 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <QObject>
 #include <QBasicTimer>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMatrix4x4>
 #include <QVector>
 #include <QVector2D>
 #include <QVector4D>
@@ -38,6 +41,13 @@ class GLTexture;
 class GLRenderTarget;
 class GLShader;
 
+/**
+ * Paints downscaled windows, e.g. thumbnails, from a cached texture of the scaled size.
+ *
+ * The texture is produced with the lanczos filter if it's enabled and works on the
+ * hardware, otherwise from a mipmapped copy of the window. Once the window is damaged
+ * the texture is rendered again, but at most 30 times per second.
+ */
 class LanczosFilter : public QObject
 {
     Q_OBJECT
@@ -53,7 +63,13 @@ private:
     void init();
     void updateOffscreenSurfaces();
     void setUniforms();
-    void discardCacheTexture(EffectWindow *w);
+    void scaleLanczos(int sw, int sh, int tw, int th, const QMatrix4x4 &projection);
+    void scaleMipmapped(int sw, int sh, int tw, int th, const QMatrix4x4 &projection);
+    void paintCachedTexture(GLTexture *texture, const QRect &textureRect, const QRegion &region,
+                            bool hardwareClipping, const WindowPaintData &data);
+    void windowDamaged(EffectWindow *w);
+    void windowDeleted(EffectWindow *w);
+    void discardCacheTextures();
 
     void createKernel(float delta, int *kernelSize);
     void createOffsets(int count, float width, Qt::Orientation direction);
@@ -61,11 +77,22 @@ private:
     GLRenderTarget *m_offscreenTarget;
     QBasicTimer m_timer;
     bool m_inited;
+    bool m_mipmaps;
     QScopedPointer<GLShader> m_shader;
     int m_uOffsets;
     int m_uKernel;
     QVector2D m_offsets[16];
     QVector4D m_kernel[16];
+
+    struct CachedTexture {
+        GLTexture *texture = nullptr;
+        // when the texture was rendered, limits the update rate of live thumbnails
+        qint64 updateTime = 0;
+        // the window has been damaged since then
+        bool dirty = false;
+    };
+    QHash<EffectWindow *, CachedTexture> m_cache;
+    QElapsedTimer m_clock;
 };
 
 } // namespace
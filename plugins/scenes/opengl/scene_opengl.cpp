@@ -30,6 +30,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include "platform.h"
 #include "wayland_server.h"
+#include "platformsupport/scenes/opengl/linux_dmabuf.h"
 #include "platformsupport/scenes/opengl/texture.h"
 
 #include <kwinglplatform.h>
@@ -52,6 +53,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <KWayland/Server/subcompositor_interface.h>
 #include <KWayland/Server/surface_interface.h>
 
+#include <algorithm>
 #include <array>
 #include <cmath>
 #include <cstddef>
@@ -63,6 +65,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <QGraphicsScale>
 #include <QPainter>
 #include <QStringList>
+#include <QTimer>
 #include <QVector2D>
 #include <QVector4D>
 #include <QMatrix4x4>
@@ -680,7 +683,9 @@ qint64 SceneOpenGL::paint(QRegion damage, ToplevelList toplevels)
 
             int mask = 0;
             updateProjectionMatrix();
+            m_currentScreen = i;
             paintScreen(&mask, damage.intersected(geo), repaint, &update, &valid, projectionMatrix(), geo);   // call generic implementation
+            m_currentScreen = -1;
             paintCursor();
 
             GLVertexBuffer::streamingBuffer()->endOfFrame();
@@ -818,6 +823,11 @@ void SceneOpenGL::extendPaintRegion(QRegion &region, bool opaqueFullscreen)
     }
 }
 
+void SceneOpenGL::aboutToStartPainting(const QRegion &damage)
+{
+    m_backend->aboutToStartPainting(m_currentScreen, damage);
+}
+
 SceneOpenGLTexture *SceneOpenGL::createTexture()
 {
     return new SceneOpenGLTexture(m_backend);
@@ -985,6 +995,28 @@ SceneOpenGL2::SceneOpenGL2(OpenGLBackend *backend, QObject *parent)
 
     qCDebug(KWIN_OPENGL) << "OpenGL 2 compositing successfully initialized";
     init_ok = true;
+
+    QTimer::singleShot(0, this, &SceneOpenGL2::warmUpShaders);
+}
+
+void SceneOpenGL2::warmUpShaders()
+{
+    // The shaders used for painting windows, built one per event loop iteration so that
+    // the first window which needs one doesn't stall the frame
+    static const ShaderTraits traits[] = {
+        ShaderTrait::MapTexture | ShaderTrait::Modulate,
+        ShaderTrait::MapTexture | ShaderTrait::AdjustSaturation,
+        ShaderTrait::MapTexture | ShaderTrait::Modulate | ShaderTrait::AdjustSaturation,
+        ShaderTrait::UniformColor,
+    };
+    if (m_warmedUpShaders >= int(sizeof(traits) / sizeof(traits[0]))) {
+        return;
+    }
+    if (!makeOpenGLContextCurrent()) {
+        return;
+    }
+    ShaderManager::instance()->shader(traits[m_warmedUpShaders++]);
+    QTimer::singleShot(0, this, &SceneOpenGL2::warmUpShaders);
 }
 
 SceneOpenGL2::~SceneOpenGL2()
@@ -1074,6 +1106,7 @@ void SceneOpenGL2::finalDrawWindow(EffectWindowImpl* w, int mask, QRegion region
     if (waylandServer() && waylandServer()->isScreenLocked() && !w->window()->isLockScreen() && !w->window()->isInputMethod()) {
         return;
     }
+    markWindowVisible(w->window());
     performPaintWindow(w, mask, region, data);
 }
 
@@ -1362,13 +1395,31 @@ void SceneOpenGL2Window::renderSubSurface(GLShader *shader, const QMatrix4x4 &mv
     }
 
     if (!pixmap->texture()->isNull()) {
-        setBlendEnabled(pixmap->buffer() && pixmap->buffer()->hasAlphaChannel());
-        // render this texture
-        shader->setUniform(GLShader::ModelViewProjectionMatrix, mvp * newWindowMatrix);
         auto texture = pixmap->texture();
-        texture->bind();
-        texture->render(region, QRect(0, 0, texture->width() / scale, texture->height() / scale), hardwareClipping);
-        texture->unbind();
+        const QRect rect(0, 0, texture->width() / scale, texture->height() / scale);
+        QRegion visibleRegion = region;
+        bool scissored = false;
+        if (!hardwareClipping && region != infiniteRegion()) {
+            // the window is not transformed, so the sub-surface can be clipped
+            // against the region which is not occluded by windows above
+            const QRect geometry = newWindowMatrix.mapRect(rect);
+            visibleRegion &= geometry;
+            scissored = !visibleRegion.isEmpty() && visibleRegion != QRegion(geometry);
+        }
+        if (!visibleRegion.isEmpty()) {
+            setBlendEnabled(pixmap->buffer() && pixmap->buffer()->hasAlphaChannel());
+            // render this texture
+            shader->setUniform(GLShader::ModelViewProjectionMatrix, mvp * newWindowMatrix);
+            if (scissored) {
+                glEnable(GL_SCISSOR_TEST);
+            }
+            texture->bind();
+            texture->render(visibleRegion, rect, hardwareClipping || scissored);
+            texture->unbind();
+            if (scissored) {
+                glDisable(GL_SCISSOR_TEST);
+            }
+        }
     }
 
     const auto &children = pixmap->children();
@@ -1565,6 +1616,10 @@ static bool needsPixmapUpdate(const OpenGLWindowPixmap *pixmap)
 {
     // That's a regular Wayland client.
     if (pixmap->surface()) {
+        // The damage belongs to a buffer the client is still rendering to.
+        if (pixmap->isBufferPending()) {
+            return false;
+        }
         return !pixmap->surface()->trackedDamage().isEmpty();
     }
 
@@ -1582,6 +1637,15 @@ static bool needsPixmapUpdate(const OpenGLWindowPixmap *pixmap)
     return false;
 }
 
+static bool hasPendingBuffers(const WindowPixmap *pixmap)
+{
+    if (pixmap->isBufferPending()) {
+        return true;
+    }
+    const auto children = pixmap->children();
+    return std::any_of(children.constBegin(), children.constEnd(), hasPendingBuffers);
+}
+
 bool OpenGLWindowPixmap::bind()
 {
     if (!m_texture->isNull()) {
@@ -1594,7 +1658,9 @@ bool OpenGLWindowPixmap::bind()
             // mipmaps need to be updated
             m_texture->setDirty();
         }
-        if (subSurface().isNull()) {
+        // keep the damage of buffers which are not used yet, so that they get picked up
+        // by the repaint once the client has finished rendering
+        if (subSurface().isNull() && !hasPendingBuffers(this)) {
             toplevel()->resetDamage();
         }
         // also bind all children
@@ -1631,6 +1697,22 @@ WindowPixmap *OpenGLWindowPixmap::createChild(const QPointer<KWayland::Server::S
     return new OpenGLWindowPixmap(subSurface, this, m_scene);
 }
 
+bool OpenGLWindowPixmap::isBufferReady(KWayland::Server::BufferInterface *buffer)
+{
+    // A dma-buf the client's GPU is still rendering to would stall painting the whole
+    // frame, wait for its fence instead and keep showing the previous buffer meanwhile.
+    auto dmabuf = static_cast<DmabufBuffer *>(buffer->linuxDmabufBuffer());
+    if (!dmabuf) {
+        return true;
+    }
+    QPointer<Toplevel> window = toplevel();
+    return dmabuf->isReadable([window] {
+        if (window) {
+            window->addRepaint(window->damage());
+        }
+    });
+}
+
 bool OpenGLWindowPixmap::isValid() const
 {
     if (!m_texture->isNull()) {
@@ -1652,6 +1734,7 @@ SceneOpenGL::EffectFrame::EffectFrame(EffectFrameImpl* frame, SceneOpenGL *scene
     , m_textTexture(nullptr)
     , m_oldTextTexture(nullptr)
     , m_textPixmap(nullptr)
+    , m_textDirty(false)
     , m_iconTexture(nullptr)
     , m_oldIconTexture(nullptr)
     , m_selectionTexture(nullptr)
@@ -1704,10 +1787,8 @@ void SceneOpenGL::EffectFrame::freeIconFrame()
 
 void SceneOpenGL::EffectFrame::freeTextFrame()
 {
-    delete m_textTexture;
-    m_textTexture = nullptr;
-    delete m_textPixmap;
-    m_textPixmap = nullptr;
+    // the geometry didn't change, the texture gets updated where the text is painted
+    m_textDirty = true;
 }
 
 void SceneOpenGL::EffectFrame::freeSelection()
@@ -1979,7 +2060,7 @@ void SceneOpenGL::EffectFrame::render(QRegion region, double opacity, double fra
                 shader->setUniform(GLShader::ModulationConstant, constant);
             }
         }
-        if (!m_textTexture)   // Lazy creation
+        if (!m_textTexture || m_textDirty)   // Lazy creation
             updateTextTexture();
 
         if (m_textTexture) {
@@ -2007,13 +2088,15 @@ void SceneOpenGL::EffectFrame::updateTexture()
 
 void SceneOpenGL::EffectFrame::updateTextTexture()
 {
-    delete m_textTexture;
-    m_textTexture = nullptr;
+    m_textDirty = false;
     delete m_textPixmap;
     m_textPixmap = nullptr;
 
-    if (m_effectFrame->text().isEmpty())
+    if (m_effectFrame->text().isEmpty()) {
+        delete m_textTexture;
+        m_textTexture = nullptr;
         return;
+    }
 
     // Determine position on texture to paint text
     QRect rect(QPoint(0, 0), m_effectFrame->geometry().size());
@@ -2035,9 +2118,19 @@ void SceneOpenGL::EffectFrame::updateTextTexture()
         p.setPen(m_effectFrame->styledTextColor());
     else // TODO: What about no frame? Custom color setting required
         p.setPen(Qt::white);
-    p.drawText(rect, m_effectFrame->alignment(), text);
+    QRect textRect;
+    p.drawText(rect, m_effectFrame->alignment(), text, &textRect);
     p.end();
-    m_textTexture = new GLTexture(*m_textPixmap);
+    // glyphs may reach a little beyond the reported bounds
+    textRect.adjust(-2, -2, 2, 2);
+    if (m_textTexture && m_textTexture->size() == m_textPixmap->size()) {
+        // everything but the old and the new text is transparent in both
+        m_textTexture->update(m_textPixmap->toImage(), QRegion(textRect) | m_textRect);
+    } else {
+        delete m_textTexture;
+        m_textTexture = new GLTexture(*m_textPixmap);
+    }
+    m_textRect = textRect;
 }
 
 void SceneOpenGL::EffectFrame::updateUnstyledTexture()
@@ -2533,6 +2626,23 @@ static QImage rotate(const QImage &srcImage, const QRect &srcRect)
     return image;
 }
 
+// Maps @p region in logical coordinates of a rendered part to the pixels of its image,
+// which is transposed for the rotated parts
+static QRegion imageRegion(const QRegion &region, qreal dpr, bool rotated)
+{
+    if (dpr != qRound(dpr)) {
+        // the scaled rects wouldn't line up, upload the whole image
+        const QSize size = region.boundingRect().size() * dpr;
+        return QRect(QPoint(0, 0), rotated ? size.transposed() : size);
+    }
+    QRegion result;
+    for (const QRect &rect : region) {
+        const QRect scaled(rect.topLeft() * dpr, rect.size() * dpr);
+        result += rotated ? QRect(scaled.y(), scaled.x(), scaled.height(), scaled.width()) : scaled;
+    }
+    return result;
+}
+
 void SceneOpenGLDecorationRenderer::render()
 {
     const QRegion scheduled = getScheduled();
@@ -2553,23 +2663,26 @@ void SceneOpenGLDecorationRenderer::render()
     QRect left, top, right, bottom;
     client()->client()->layoutDecorationRects(left, top, right, bottom);
 
-    const QRect geometry = dirty ? QRect(QPoint(0, 0), client()->client()->size()) : scheduled.boundingRect();
+    const QRegion geometry = dirty ? QRegion(QRect(QPoint(0, 0), client()->client()->size())) : scheduled;
 
-    auto renderPart = [this](const QRect &geo, const QRect &partRect, const QPoint &offset, bool rotated = false) {
-        if (!geo.isValid()) {
+    auto renderPart = [this](const QRegion &region, const QRect &partRect, const QPoint &offset, bool rotated = false) {
+        if (region.isEmpty()) {
             return;
         }
+        const QRect geo = region.boundingRect();
         QImage image = renderToImage(geo);
         if (rotated) {
             // TODO: get this done directly when rendering to the image
             image = rotate(image, QRect(geo.topLeft() - partRect.topLeft(), geo.size()));
         }
-        m_texture->update(image, (geo.topLeft() - partRect.topLeft() + offset) * image.devicePixelRatio());
+        // only the scheduled parts of the bounding rect are uploaded
+        m_texture->update(image, imageRegion(region.translated(-geo.topLeft()), image.devicePixelRatio(), rotated),
+                          (geo.topLeft() - partRect.topLeft() + offset) * image.devicePixelRatio());
     };
-    renderPart(left.intersected(geometry), left, QPoint(0, top.height() + bottom.height() + 2), true);
-    renderPart(top.intersected(geometry), top, QPoint(0, 0));
-    renderPart(right.intersected(geometry), right, QPoint(0, top.height() + bottom.height() + left.width() + 3), true);
-    renderPart(bottom.intersected(geometry), bottom, QPoint(0, top.height() + 1));
+    renderPart(geometry & left, left, QPoint(0, top.height() + bottom.height() + 2), true);
+    renderPart(geometry & top, top, QPoint(0, 0));
+    renderPart(geometry & right, right, QPoint(0, top.height() + bottom.height() + left.width() + 3), true);
+    renderPart(geometry & bottom, bottom, QPoint(0, top.height() + 1));
 }
 
 static int align(int value, int align)
@@ -88,6 +88,7 @@ protected:
     SceneOpenGL(OpenGLBackend *backend, QObject *parent = nullptr);
     void paintBackground(QRegion region) override;
     void extendPaintRegion(QRegion &region, bool opaqueFullscreen) override;
+    void aboutToStartPainting(const QRegion &damage) override;
     QMatrix4x4 transformation(int mask, const ScreenPaintData &data) const;
     void paintDesktop(int desktop, int mask, const QRegion &region, ScreenPaintData &data) override;
     void paintEffectQuickView(EffectQuickView *w) override;
@@ -106,6 +107,8 @@ private:
     OpenGLBackend *m_backend;
     SyncManager *m_syncManager;
     SyncObject *m_currentFence;
+    // the screen which is painted with per screen rendering, -1 otherwise
+    int m_currentScreen = -1;
 };
 
 class SceneOpenGL2 : public SceneOpenGL
@@ -135,9 +138,11 @@ protected:
 private:
     void performPaintWindow(EffectWindowImpl* w, int mask, QRegion region, WindowPaintData& data);
     QMatrix4x4 createProjectionMatrix() const;
+    void warmUpShaders();
 
 private:
     LanczosFilter *m_lanczosFilter;
+    int m_warmedUpShaders = 0;
     QScopedPointer<GLTexture> m_cursorTexture;
     QMatrix4x4 m_projectionMatrix;
     QMatrix4x4 m_screenProjectionMatrix;
@@ -229,6 +234,7 @@ public:
     bool isValid() const override;
 protected:
     WindowPixmap *createChild(const QPointer<KWayland::Server::SubSurfaceInterface> &subSurface) override;
+    bool isBufferReady(KWayland::Server::BufferInterface *buffer) override;
 private:
     explicit OpenGLWindowPixmap(const QPointer<KWayland::Server::SubSurfaceInterface> &subSurface, WindowPixmap *parent, SceneOpenGL *scene);
     QScopedPointer<SceneOpenGLTexture> m_texture;
@@ -262,6 +268,10 @@ private:
     GLTexture *m_textTexture;
     GLTexture *m_oldTextTexture;
     QPixmap *m_textPixmap; // need to keep the pixmap around to workaround some driver problems
+    // the text changed while the texture could be kept
+    bool m_textDirty;
+    // the area the text in m_textTexture covers
+    QRect m_textRect;
     GLTexture *m_iconTexture;
     GLTexture *m_oldIconTexture;
     GLTexture *m_selectionTexture;
@@ -212,6 +212,11 @@ QImage *SceneQPainter::qpainterRenderBuffer() const
     return m_backend->buffer();
 }
 
+QImage *SceneQPainter::qpainterRenderBufferForScreen(int screenId) const
+{
+    return m_backend->bufferForScreen(screenId);
+}
+
 //****************************************
 // SceneQPainter::Window
 //****************************************
@@ -834,16 +839,12 @@ void SceneQPainterDecorationRenderer::render()
         if (rect.isEmpty()) {
             return;
         }
+        // painted ahead of the frame already, replaces the existing part
+        const QImage image = renderToImage(rect);
         QPainter painter(&m_images[index]);
-        painter.setRenderHint(QPainter::Antialiasing);
         painter.setWindow(QRect(partRect.topLeft(), partRect.size() * m_images[index].devicePixelRatio()));
-        painter.setClipRect(rect);
-        painter.save();
-        // clear existing part
         painter.setCompositionMode(QPainter::CompositionMode_Source);
-        painter.fillRect(rect, Qt::transparent);
-        painter.restore();
-        client()->decoration()->paint(&painter, rect);
+        painter.drawImage(rect.topLeft(), image);
     };
 
     renderPart(left.intersected(geometry), left, int(DecorationPart::Left));
@@ -51,6 +51,7 @@ public:
 
     QPainter *scenePainter() const override;
     QImage *qpainterRenderBuffer() const override;
+    QImage *qpainterRenderBufferForScreen(int screenId) const override;
 
     QPainterBackend *backend() const {
         return m_backend.data();
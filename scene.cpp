@@ -70,6 +70,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <QQuickWindow>
 #include <QVector2D>
+#include <QtConcurrentMap>
 
 #include "x11client.h"
 #include "deleted.h"
@@ -78,6 +79,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "screens.h"
 #include "shadow.h"
 #include "wayland_server.h"
+#include "xdgshellclient.h"
 
 #include "thumbnailitem.h"
 
@@ -92,10 +94,14 @@ namespace KWin
 // Scene
 //****************************************
 
+// below this many windows without cached quads the workers aren't worth waking up
+static const int s_minParallelQuadWindows = 4;
+
 Scene::Scene(QObject *parent)
     : QObject(parent)
 {
     last_time.invalidate(); // Initialize the timer
+    m_parallelQuads = qEnvironmentVariableIntValue("KWIN_PARALLEL_QUADS") == 1;
 }
 
 Scene::~Scene()
@@ -125,6 +131,17 @@ void Scene::paintScreen(int* mask, const QRegion &damage, const QRegion &repaint
     *mask = pdata.mask;
     region = pdata.paint;
 
+    // The window repaints are taken once per frame rather than reset by the pass of the
+    // first output, so that all outputs painted in this frame get to see them. This has
+    // to happen before the windows' pre-paint, many effects schedule a repaint for the
+    // next frame within Effects::prePaintWindow.
+    if (!m_repaintsTaken) {
+        for (Window *w : qAsConst(stacking_order)) {
+            w->takeRepaints();
+        }
+        m_repaintsTaken = true;
+    }
+
     if (*mask & (PAINT_SCREEN_TRANSFORMED | PAINT_SCREEN_WITH_TRANSFORMED_WINDOWS)) {
         // Region painting is not possible with transformations,
         // because screen damage doesn't match transformed positions.
@@ -140,7 +157,12 @@ void Scene::paintScreen(int* mask, const QRegion &damage, const QRegion &repaint
 
     painted_region = region;
     repaint_region = repaint;
+    m_paintingStarted = false;
 
+    const bool transformed = *mask & (PAINT_SCREEN_TRANSFORMED | PAINT_SCREEN_WITH_TRANSFORMED_WINDOWS);
+    if (transformed || (*mask & PAINT_SCREEN_BACKGROUND_FIRST)) {
+        startPainting(displayRegion);
+    }
     if (*mask & PAINT_SCREEN_BACKGROUND_FIRST) {
         paintBackground(region);
     }
@@ -148,6 +170,13 @@ void Scene::paintScreen(int* mask, const QRegion &damage, const QRegion &repaint
     ScreenPaintData data(projection, outputGeometry);
     effects->paintScreen(*mask, region, data);
 
+    if (transformed) {
+        // An effect may have painted only parts of the scene, e.g. into a cached offscreen
+        // texture, but the transformed screen as a whole has still been repainted.
+        painted_region = displayRegion;
+        damaged_region = displayRegion;
+    }
+
     foreach (Window *w, stacking_order) {
         effects->postPaintWindow(effectWindow(w));
     }
@@ -203,19 +232,17 @@ void Scene::finalPaintScreen(int mask, QRegion region, ScreenPaintData& data)
 // It simply paints bottom-to-top.
 void Scene::paintGenericScreen(int orig_mask, ScreenPaintData)
 {
+    const QSize &screenSize = screens()->size();
+    startPainting(QRegion(0, 0, screenSize.width(), screenSize.height()));
     if (!(orig_mask & PAINT_SCREEN_BACKGROUND_FIRST)) {
         paintBackground(infiniteRegion());
     }
     QVector<Phase2Data> phase2;
     phase2.reserve(stacking_order.size());
+    buildQuadsInParallel(stacking_order);
     foreach (Window * w, stacking_order) { // bottom to top
         Toplevel* topw = w->window();
 
-        // Reset the repaint_region.
-        // This has to be done here because many effects schedule a repaint for
-        // the next frame within Effects::prePaintWindow.
-        topw->resetRepaints();
-
         WindowPrePaintData data;
         data.mask = orig_mask | (w->isOpaque() ? PAINT_WINDOW_OPAQUE : PAINT_WINDOW_TRANSLUCENT);
         w->resetPaintingEnabled();
@@ -233,13 +260,13 @@ void Scene::paintGenericScreen(int orig_mask, ScreenPaintData)
             continue;
         }
         phase2.append({w, infiniteRegion(), data.clip, data.mask, data.quads});
+        markWindowVisible(topw);
     }
 
     foreach (const Phase2Data & d, phase2) {
         paintWindow(d.window, d.mask, d.region, d.quads);
     }
 
-    const QSize &screenSize = screens()->size();
     damaged_region = QRegion(0, 0, screenSize.width(), screenSize.height());
 }
 
@@ -253,50 +280,60 @@ void Scene::paintSimpleScreen(int orig_mask, QRegion region)
     QVector<Phase2Data> phase2data;
     phase2data.reserve(stacking_order.size());
 
+    // This is the occlusion pre-pass. Walk the stacking order top to bottom and
+    // accumulate the regions which will be covered by opaque windows. Windows
+    // which are completely hidden behind them are not passed through the effect
+    // chain and don't get any quads built.
+    QVector<bool> culled(stacking_order.count(), false);
+    QVector<QPair<Window*, QRegion>> occluders;
+    QRegion occlusion;
+    for (int i = stacking_order.count() - 1; i >= 0; --i) {
+        Window *w = stacking_order[i];
+        w->resetPaintingEnabled();
+        if (!occlusion.isEmpty()) {
+            const QRegion needed = QRegion(w->paintBounds()) | w->repaints();
+            if ((needed - occlusion).isEmpty()) {
+                culled[i] = true;
+                continue;
+            }
+        }
+        if (!w->isPaintingEnabled()) {
+            continue;
+        }
+        const QRegion clip = w->opaqueShape();
+        if (!clip.isEmpty()) {
+            occlusion |= clip;
+            occluders.append(qMakePair(w, clip));
+        }
+    }
+
+    QVector<Window*> unculled;
+    unculled.reserve(stacking_order.count());
+    for (int i = 0; i < stacking_order.count(); ++i) {
+        if (!culled[i]) {
+            unculled.append(stacking_order[i]);
+        }
+    }
+    buildQuadsInParallel(unculled);
+
     QRegion dirtyArea = region;
     bool opaqueFullscreen(false);
-    for (int i = 0;  // do prePaintWindow bottom to top
-            i < stacking_order.count();
-            ++i) {
-        Window* w = stacking_order[ i ];
+    auto prePaint = [this, orig_mask, &region, &dirtyArea, &opaqueFullscreen](Window *w, Phase2Data *phase2) {
         Toplevel* topw = w->window();
         WindowPrePaintData data;
         data.mask = orig_mask | (w->isOpaque() ? PAINT_WINDOW_OPAQUE : PAINT_WINDOW_TRANSLUCENT);
         w->resetPaintingEnabled();
         data.paint = region;
-        data.paint |= topw->repaints();
-
-        // Reset the repaint_region.
-        // This has to be done here because many effects schedule a repaint for
-        // the next frame within Effects::prePaintWindow.
-        topw->resetRepaints();
+        data.paint |= w->repaints();
 
         // Clip out the decoration for opaque windows; the decoration is drawn in the second pass
         opaqueFullscreen = false; // TODO: do we care about unmanged windows here (maybe input windows?)
         if (w->isOpaque()) {
-            AbstractClient *c = dynamic_cast<AbstractClient*>(topw);
-            if (c) {
+            if (AbstractClient *c = dynamic_cast<AbstractClient*>(topw)) {
                 opaqueFullscreen = c->isFullScreen();
             }
-            X11Client *cc = dynamic_cast<X11Client *>(c);
-            // the window is fully opaque
-            if (cc && cc->decorationHasAlpha()) {
-                // decoration uses alpha channel, so we may not exclude it in clipping
-                data.clip = w->clientShape().translated(w->x(), w->y());
-            } else {
-                // decoration is fully opaque
-                if (c && c->isShade()) {
-                    data.clip = QRegion();
-                } else {
-                    data.clip = w->shape().translated(w->x(), w->y());
-                }
-            }
-        } else if (topw->hasAlpha() && topw->opacity() == 1.0) {
-            // the window is partially opaque
-            data.clip = (w->clientShape() & topw->opaqueRegion().translated(topw->clientPos())).translated(w->x(), w->y());
-        } else {
-            data.clip = QRegion();
         }
+        data.clip = w->opaqueShape();
         data.quads = w->buildQuads();
         // preparation step
         effects->prePaintWindow(effectWindow(w), data, time_diff);
@@ -306,11 +343,59 @@ void Scene::paintSimpleScreen(int orig_mask, QRegion region)
         }
 #endif
         if (!w->isPaintingEnabled()) {
-            continue;
+            return false;
         }
         dirtyArea |= data.paint;
-        // Schedule the window for painting
-        phase2data.append({w, data.paint, data.clip, data.mask, data.quads});
+        *phase2 = {w, data.paint, data.clip, data.mask, data.quads};
+        return true;
+    };
+
+    for (int i = 0;  // do prePaintWindow bottom to top
+            i < stacking_order.count();
+            ++i) {
+        if (culled[i]) {
+            continue;
+        }
+        Phase2Data phase2;
+        if (prePaint(stacking_order[i], &phase2)) {
+            // Schedule the window for painting
+            phase2data.append(phase2);
+        }
+    }
+
+    // The pre-pass could only guess what the effects do to the occluding windows.
+    // If one of them ended up not being painted, or not as opaque as expected,
+    // the culled windows have to go through the regular path after all.
+    const bool occlusionValid = std::all_of(occluders.constBegin(), occluders.constEnd(),
+        [&phase2data](const QPair<Window*, QRegion> &occluder) {
+            auto it = std::find_if(phase2data.constBegin(), phase2data.constEnd(),
+                [&occluder](const Phase2Data &data) {
+                    return data.window == occluder.first;
+                }
+            );
+            return it != phase2data.constEnd() && (occluder.second - it->clip).isEmpty();
+        }
+    );
+    if (!occlusionValid && culled.contains(true)) {
+        const bool topmostOpaqueFullscreen = opaqueFullscreen;
+        QVector<Phase2Data> merged;
+        merged.reserve(stacking_order.size());
+        for (int i = 0, j = 0; i < stacking_order.count(); ++i) {
+            if (j < phase2data.count() && phase2data[j].window == stacking_order[i]) {
+                merged.append(phase2data[j++]);
+            } else if (culled[i]) {
+                Phase2Data phase2;
+                if (prePaint(stacking_order[i], &phase2)) {
+                    merged.append(phase2);
+                }
+            }
+        }
+        phase2data = merged;
+        opaqueFullscreen = topmostOpaqueFullscreen;
+    }
+
+    for (const Phase2Data &data : qAsConst(phase2data)) {
+        markWindowVisible(data.window->window());
     }
 
     // Save the part of the repaint region that's exclusively rendered to
@@ -344,8 +429,9 @@ void Scene::paintSimpleScreen(int orig_mask, QRegion region)
         data->region -= allclips;
 
         // Here we rely on WindowPrePaintData::setTranslucent() to remove
-        // the clip if needed.
-        if (!data->clip.isEmpty() && !(data->mask & PAINT_WINDOW_TRANSLUCENT)) {
+        // the clip if needed. Windows with an alpha channel are painted
+        // translucent, but keep the clip of their opaque region.
+        if (!data->clip.isEmpty()) {
             // clip away the opaque regions for all windows below this one
             allclips |= data->clip;
             // extend the translucent damage for windows below this by remaining (translucent) regions
@@ -356,6 +442,8 @@ void Scene::paintSimpleScreen(int orig_mask, QRegion region)
         }
     }
 
+    startPainting(dirtyArea);
+
     QRegion paintedArea;
     // Fill any areas of the root window not covered by opaque windows
     if (!(orig_mask & PAINT_SCREEN_BACKGROUND_FIRST)) {
@@ -390,6 +478,33 @@ void Scene::paintSimpleScreen(int orig_mask, QRegion region)
     }
 }
 
+void Scene::buildQuadsInParallel(const QVector<Window*> &windows)
+{
+    if (!m_parallelQuads) {
+        return;
+    }
+    QVector<Window*> dirty;
+    for (Window *w : windows) {
+        if (!w->hasCachedQuads()) {
+            dirty.append(w);
+        }
+    }
+    if (dirty.count() < s_minParallelQuadWindows) {
+        return;
+    }
+    // The effect chain can only run on the workers if all active effects are fine with
+    // that. Otherwise only the windows' own quads are built up front and the effects
+    // get to see them in the serial pre-paint pass.
+    const bool withEffects = static_cast<EffectsHandlerImpl*>(effects)->isBuildQuadsThreadSafe();
+    QtConcurrent::blockingMap(dirty, [withEffects](Window *w) {
+        if (withEffects) {
+            w->buildQuads();
+        } else {
+            w->prebuildQuads();
+        }
+    });
+}
+
 void Scene::addToplevel(Toplevel *c)
 {
     Q_ASSERT(!m_windows.contains(c));
@@ -420,6 +535,7 @@ void Scene::removeToplevel(Toplevel *toplevel)
 {
     Q_ASSERT(m_windows.contains(toplevel));
     delete m_windows.take(toplevel);
+    m_visibleWindows.remove(toplevel);
     toplevel->effectWindow()->setSceneWindow(nullptr);
 }
 
@@ -432,6 +548,7 @@ void Scene::windowClosed(Toplevel *toplevel, Deleted *deleted)
 
     Q_ASSERT(m_windows.contains(toplevel));
     Window *window = m_windows.take(toplevel);
+    m_visibleWindows.remove(toplevel);
     window->updateToplevel(deleted);
     if (window->shadow()) {
         window->shadow()->setToplevel(deleted);
@@ -454,6 +571,7 @@ void Scene::createStackingOrder(ToplevelList toplevels)
         Q_ASSERT(m_windows.contains(c));
         stacking_order.append(m_windows[ c ]);
     }
+    m_repaintsTaken = false;
 }
 
 void Scene::clearStackingOrder()
@@ -618,15 +736,36 @@ void Scene::finalDrawWindow(EffectWindowImpl* w, int mask, QRegion region, Windo
     if (waylandServer() && waylandServer()->isScreenLocked() && !w->window()->isLockScreen() && !w->window()->isInputMethod()) {
         return;
     }
+    markWindowVisible(w->window());
     w->sceneWindow()->performPaint(mask, region, data);
 }
 
+void Scene::resetVisibleWindows()
+{
+    m_visibleWindows.clear();
+}
+
 void Scene::extendPaintRegion(QRegion &region, bool opaqueFullscreen)
 {
     Q_UNUSED(region);
     Q_UNUSED(opaqueFullscreen);
 }
 
+void Scene::aboutToStartPainting(const QRegion &damage)
+{
+    Q_UNUSED(damage)
+}
+
+void Scene::startPainting(const QRegion &damage)
+{
+    // effects may run the painting more than once, only the first pass can be announced
+    if (m_paintingStarted) {
+        return;
+    }
+    m_paintingStarted = true;
+    aboutToStartPainting(damage);
+}
+
 bool Scene::blocksForRetrace() const
 {
     return false;
@@ -678,6 +817,12 @@ QImage *Scene::qpainterRenderBuffer() const
     return nullptr;
 }
 
+QImage *Scene::qpainterRenderBufferForScreen(int screenId) const
+{
+    Q_UNUSED(screenId)
+    return nullptr;
+}
+
 QVector<QByteArray> Scene::openGLPlatformInterfaceExtensions() const
 {
     return QVector<QByteArray>{};
@@ -705,6 +850,12 @@ Scene::Window::~Window()
     delete m_shadow;
 }
 
+void Scene::Window::takeRepaints()
+{
+    m_repaints = toplevel->repaints();
+    toplevel->resetRepaints();
+}
+
 void Scene::Window::referencePreviousPixmap()
 {
     if (!m_previousPixmap.isNull() && m_previousPixmap->isDiscarded()) {
@@ -782,6 +933,73 @@ QRegion Scene::Window::clientShape() const
     return r.isEmpty() ? QRegion() : r;
 }
 
+// Collects the opaque regions and the bounding rect of the mapped sub-surface tree of
+// @p surface, which is located at @p offset in window coordinates.
+static void accumulateSubSurfaces(KWayland::Server::SurfaceInterface *surface, const QPoint &offset, QRegion *opaque, QRect *bounds)
+{
+    const auto subSurfaces = surface->childSubSurfaces();
+    for (const auto &subSurface : subSurfaces) {
+        if (subSurface.isNull() || subSurface->surface().isNull() || !subSurface->surface()->isMapped()) {
+            continue;
+        }
+        KWayland::Server::SurfaceInterface *child = subSurface->surface().data();
+        const QPoint position = offset + subSurface->position();
+        const QRect geometry(position, child->size());
+        if (opaque) {
+            *opaque |= child->opaque().translated(position) & geometry;
+        }
+        if (bounds) {
+            *bounds |= geometry;
+        }
+        accumulateSubSurfaces(child, position, opaque, bounds);
+    }
+}
+
+QRegion Scene::Window::opaqueShape() const
+{
+    if (toplevel->opacity() != 1.0) {
+        return QRegion();
+    }
+    AbstractClient *c = dynamic_cast<AbstractClient*>(toplevel);
+    if (c && c->isShade()) {
+        return QRegion();
+    }
+    // the wl_surface opaque region is only meaningful for native Wayland windows,
+    // Xwayland windows announce it through _NET_WM_OPAQUE_REGION
+    KWayland::Server::SurfaceInterface *surface = qobject_cast<XdgShellClient*>(toplevel) ? toplevel->surface() : nullptr;
+
+    QRegion opaque;
+    if (!toplevel->hasAlpha()) {
+        X11Client *cc = dynamic_cast<X11Client *>(c);
+        if (cc && cc->decorationHasAlpha()) {
+            // decoration uses alpha channel, so we may not exclude it in clipping
+            opaque = clientShape();
+        } else {
+            // decoration is fully opaque
+            opaque = shape();
+        }
+    } else {
+        // the window is partially opaque
+        const QRegion opaqueContents = surface ? surface->opaque() : toplevel->opaqueRegion();
+        opaque = clientShape() & opaqueContents.translated(toplevel->clientPos());
+    }
+    if (surface) {
+        accumulateSubSurfaces(surface, toplevel->clientPos(), &opaque, nullptr);
+    }
+    return opaque.translated(x(), y());
+}
+
+QRect Scene::Window::paintBounds() const
+{
+    QRect bounds = toplevel->visibleRect();
+    if (KWayland::Server::SurfaceInterface *surface = toplevel->surface()) {
+        QRect subSurfaces;
+        accumulateSubSurfaces(surface, toplevel->clientPos(), nullptr, &subSurfaces);
+        bounds |= subSurfaces.translated(x(), y());
+    }
+    return bounds;
+}
+
 bool Scene::Window::isVisible() const
 {
     if (toplevel->isDeleted())
@@ -844,6 +1062,25 @@ WindowQuadList Scene::Window::buildQuads(bool force) const
     if (cached_quad_list != nullptr && !force)
         return *cached_quad_list;
     WindowQuadList ret;
+    if (prebuilt_quad_list != nullptr && !force) {
+        ret = *prebuilt_quad_list;
+    } else {
+        ret = makeWindowQuads();
+    }
+    prebuilt_quad_list.reset();
+    effects->buildQuads(toplevel->effectWindow(), ret);
+    cached_quad_list.reset(new WindowQuadList(ret));
+    return ret;
+}
+
+void Scene::Window::prebuildQuads() const
+{
+    prebuilt_quad_list.reset(new WindowQuadList(makeWindowQuads()));
+}
+
+WindowQuadList Scene::Window::makeWindowQuads() const
+{
+    WindowQuadList ret;
 
     const qreal scale = toplevel->bufferScale();
 
@@ -877,8 +1114,6 @@ WindowQuadList Scene::Window::buildQuads(bool force) const
     if (m_shadow && toplevel->wantsShadowToBeRendered()) {
         ret << m_shadow->shadowQuads();
     }
-    effects->buildQuads(toplevel->effectWindow(), ret);
-    cached_quad_list.reset(new WindowQuadList(ret));
     return ret;
 }
 
@@ -943,6 +1178,7 @@ WindowQuadList Scene::Window::makeDecorationQuads(const QRect *rects, const QReg
 void Scene::Window::invalidateQuadsCache()
 {
     cached_quad_list.reset();
+    prebuilt_quad_list.reset();
 }
 
 WindowQuadList Scene::Window::makeQuads(WindowQuadType type, const QRegion& reg, const QPoint &textureOffset, qreal scale) const
@@ -1095,6 +1331,10 @@ void WindowPixmap::updateBuffer()
                 // no change
                 return;
             }
+            if (m_buffer && !isBufferReady(b)) {
+                // keep the previous buffer until the client has finished rendering
+                return;
+            }
             if (m_buffer) {
                 QObject::disconnect(m_buffer.data(), &BufferInterface::aboutToBeDestroyed, m_buffer.data(), &BufferInterface::unref);
                 m_buffer->unref();
@@ -1131,6 +1371,21 @@ KWayland::Server::SurfaceInterface *WindowPixmap::surface() const
     }
 }
 
+bool WindowPixmap::isBufferPending() const
+{
+    if (m_buffer.isNull()) {
+        return false;
+    }
+    KWayland::Server::SurfaceInterface *s = surface();
+    return s && s->buffer() && s->buffer() != m_buffer;
+}
+
+bool WindowPixmap::isBufferReady(KWayland::Server::BufferInterface *buffer)
+{
+    Q_UNUSED(buffer)
+    return true;
+}
+
 //****************************************
 // Scene::EffectFrame
 //****************************************
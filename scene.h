@@ -27,6 +27,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <QElapsedTimer>
 #include <QMatrix4x4>
+#include <QSet>
 
 class QOpenGLFramebufferObject;
 
@@ -188,6 +189,12 @@ public:
      * Default implementation returns @c nullptr.
      */
     virtual QImage *qpainterRenderBuffer() const;
+    /**
+     * The render buffer of the screen @p screenId used by a QPainter based compositor
+     * which renders each screen on its own.
+     * Default implementation returns @c nullptr.
+     */
+    virtual QImage *qpainterRenderBufferForScreen(int screenId) const;
 
     /**
      * The backend specific extensions (e.g. EGL/GLX extensions).
@@ -198,6 +205,19 @@ public:
      */
     virtual QVector<QByteArray> openGLPlatformInterfaceExtensions() const;
 
+    /**
+     * Forgets which windows were visible, to be called before each compositing pass.
+     */
+    void resetVisibleWindows();
+    /**
+     * Whether @p toplevel was visible since the last resetVisibleWindows(). A window counts
+     * as visible if it wasn't culled, hidden by an effect or not on the current desktop,
+     * or if an effect drew it somewhere else, e.g. as a thumbnail.
+     */
+    bool isWindowVisible(Toplevel *toplevel) const {
+        return m_visibleWindows.contains(toplevel);
+    }
+
 Q_SIGNALS:
     void frameRendered();
     void resetCompositing();
@@ -235,10 +255,20 @@ protected:
     // let the scene decide whether it's better to paint more of the screen, eg. in order to allow a buffer swap
     // the default is NOOP
     virtual void extendPaintRegion(QRegion &region, bool opaqueFullscreen);
+    // called once per paintScreen() right before anything gets painted, damage is the area
+    // that is going to be painted. The default is NOOP
+    virtual void aboutToStartPainting(const QRegion &damage);
     virtual void paintDesktop(int desktop, int mask, const QRegion &region, ScreenPaintData &data);
 
     virtual void paintEffectQuickView(EffectQuickView *w) = 0;
 
+    void markWindowVisible(Toplevel *toplevel) {
+        m_visibleWindows.insert(toplevel);
+    }
+    // builds the quads of the given windows which don't have them cached on a worker pool
+    // so that the serial pre-paint pass finds them ready, only done if enabled
+    void buildQuadsInParallel(const QVector<Window*> &windows);
+
     // compute time since the last repaint
     void updateTimeDiff();
     // saved data for 2nd pass of optimized screen painting
@@ -264,10 +294,19 @@ protected:
     QElapsedTimer last_time;
 private:
     void paintWindowThumbnails(Scene::Window *w, QRegion region, qreal opacity, qreal brightness, qreal saturation);
+    void startPainting(const QRegion &damage);
     void paintDesktopThumbnails(Scene::Window *w);
     QHash< Toplevel*, Window* > m_windows;
+    // windows which made it into a painting pass since the last resetVisibleWindows()
+    QSet<Toplevel*> m_visibleWindows;
     // windows in their stacking order
     QVector< Window* > stacking_order;
+    // whether quads may be built on worker threads, see buildQuadsInParallel()
+    bool m_parallelQuads = false;
+    // whether the window repaints of the current frame have been taken already
+    bool m_repaintsTaken = false;
+    // whether aboutToStartPainting() has been called in the current paintScreen()
+    bool m_paintingStarted = false;
 };
 
 /**
@@ -334,10 +373,26 @@ public:
     // shape of the window
     const QRegion &shape() const;
     QRegion clientShape() const;
+    // the part of the window, including sub-surfaces, which is painted with opaque
+    // pixels when the window is not transformed (in screen coordinates)
+    QRegion opaqueShape() const;
+    // the area the window, its shadow and its sub-surfaces can paint to (in screen coordinates)
+    QRect paintBounds() const;
     void discardShape();
     void updateToplevel(Toplevel* c);
     // creates initial quad list for the window
     virtual WindowQuadList buildQuads(bool force = false) const;
+    // the repaints of the window which are due in the current frame (in screen coordinates)
+    const QRegion &repaints() const {
+        return m_repaints;
+    }
+    // moves the pending repaints of the toplevel into repaints()
+    void takeRepaints();
+    bool hasCachedQuads() const {
+        return cached_quad_list != nullptr;
+    }
+    // builds the window's own quads ahead of buildQuads(), without running the effect chain
+    void prebuildQuads() const;
     void updateShadow(Shadow* shadow);
     const Shadow* shadow() const;
     Shadow* shadow();
@@ -347,6 +402,8 @@ public:
 protected:
     WindowQuadList makeQuads(WindowQuadType type, const QRegion& reg, const QPoint &textureOffset = QPoint(0, 0), qreal textureScale = 1.0) const;
     WindowQuadList makeDecorationQuads(const QRect *rects, const QRegion &region, qreal textureScale = 1.0) const;
+    // the contents, decoration and shadow quads before effects had a go at them
+    WindowQuadList makeWindowQuads() const;
     /**
      * @brief Returns the WindowPixmap for this Window.
      *
@@ -379,9 +436,11 @@ private:
     QScopedPointer<WindowPixmap> m_previousPixmap;
     int m_referencePixmapCounter;
     int disable_painting;
+    QRegion m_repaints;
     mutable QRegion shape_region;
     mutable bool shape_valid;
     mutable QScopedPointer<WindowQuadList> cached_quad_list;
+    mutable QScopedPointer<WindowQuadList> prebuilt_quad_list;
     Q_DISABLE_COPY(Window)
 };
 
@@ -486,10 +545,25 @@ public:
      */
     KWayland::Server::SurfaceInterface *surface() const;
 
+    /**
+     * @returns @c true if the surface has a newer buffer which is not used yet, because the
+     * client is still rendering to it.
+     * @see isBufferReady
+     */
+    bool isBufferPending() const;
+
 protected:
     explicit WindowPixmap(Scene::Window *window);
     explicit WindowPixmap(const QPointer<KWayland::Server::SubSurfaceInterface> &subSurface, WindowPixmap *parent);
     virtual WindowPixmap *createChild(const QPointer<KWayland::Server::SubSurfaceInterface> &subSurface);
+    /**
+     * Whether the client has finished rendering to the newly attached @p buffer. If not,
+     * updateBuffer keeps the previous buffer and the implementation has to schedule a
+     * repaint of the window once the rendering is done.
+     *
+     * The default implementation returns @c true.
+     */
+    virtual bool isBufferReady(KWayland::Server::BufferInterface *buffer);
     /**
      * @return The Window this WindowPixmap belongs to
      */
@@ -67,6 +67,10 @@ public:
     int requestedEffectChainPosition() const override {
         return m_chainPosition;
     }
+    // scripts have no way to hook into buildQuads()
+    bool isBuildQuadsThreadSafe() const override {
+        return true;
+    }
     QString activeConfig() const;
     void setActiveConfig(const QString &name);
     static ScriptedEffect *create(const QString &effectName, const QString &pathToScript, int chainPosition);
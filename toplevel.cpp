@@ -52,7 +52,6 @@ Toplevel::Toplevel()
     , effect_window(nullptr)
     , m_clientMachine(new ClientMachine(this))
     , m_wmClientLeader(XCB_WINDOW_NONE)
-    , m_damageReplyPending(false)
     , m_screen(0)
     , m_skipCloseAnimation(false)
 {
@@ -295,6 +294,12 @@ void Toplevel::finishCompositing(ReleaseReason releaseReason)
             releaseReason != ReleaseReason::Destroyed) {
         xcb_damage_destroy(connection(), damage_handle);
     }
+    for (const xcb_xfixes_fetch_region_cookie_t &cookie : qAsConst(m_damageRegionCookies)) {
+        xcb_discard_reply(connection(), cookie.sequence);
+    }
+    m_damageRegionCookies.clear();
+    m_damageFetched = false;
+    m_damageDeferred = false;
 
     damage_handle = XCB_NONE;
     damage_region = QRegion();
@@ -313,6 +318,20 @@ void Toplevel::damageNotifyEvent()
 {
     m_isDamaged = true;
 
+    if (damage_handle != XCB_NONE) {
+        // Request the damage region right away, so that it's there when the next frame is
+        // composited. Subtracting the damage re-arms the notification, so the damage is
+        // subtracted only once per pass. Anything reported afterwards is fetched by the
+        // next pass.
+        if (m_damageFetched) {
+            m_damageDeferred = true;
+        } else {
+            readDamageRegionReplies();
+            fetchDamageRegion();
+            m_damageFetched = true;
+        }
+    }
+
     // Note: The rect is supposed to specify the damage extents,
     //       but we don't know it at this point. No one who connects
     //       to this signal uses the rect however.
@@ -330,8 +349,7 @@ bool Toplevel::compositing() const
 void X11Client::damageNotifyEvent()
 {
     if (syncRequest.isPending && isResize()) {
-        emit damaged(this, QRect());
-        m_isDamaged = true;
+        Toplevel::damageNotifyEvent();
         return;
     }
 
@@ -345,16 +363,30 @@ void X11Client::damageNotifyEvent()
     Toplevel::damageNotifyEvent();
 }
 
-bool Toplevel::resetAndFetchDamage()
+bool Toplevel::resetAndCollectDamage()
 {
     if (!m_isDamaged)
         return false;
 
-    if (damage_handle == XCB_NONE) {
-        m_isDamaged = false;
-        return true;
+    readDamageRegionReplies();
+    m_damageFetched = false;
+    if (m_damageDeferred && damage_handle != XCB_NONE) {
+        fetchDamageRegion();
+        m_damageFetched = true;
     }
+    m_damageDeferred = false;
+    m_isDamaged = !m_damageRegionCookies.isEmpty();
+
+    return true;
+}
+
+bool Toplevel::hasPendingDamageReplies() const
+{
+    return !m_damageRegionCookies.isEmpty();
+}
 
+void Toplevel::fetchDamageRegion()
+{
     xcb_connection_t *conn = connection();
 
     // Create a new region and copy the damage region to it,
@@ -364,51 +396,48 @@ bool Toplevel::resetAndFetchDamage()
     xcb_damage_subtract(conn, damage_handle, 0, region);
 
     // Send a fetch-region request and destroy the region
-    m_regionCookie = xcb_xfixes_fetch_region_unchecked(conn, region);
+    m_damageRegionCookies.append(xcb_xfixes_fetch_region_unchecked(conn, region));
     xcb_xfixes_destroy_region(conn, region);
-
-    m_isDamaged = false;
-    m_damageReplyPending = true;
-
-    return m_damageReplyPending;
 }
 
-void Toplevel::getDamageRegionReply()
+void Toplevel::readDamageRegionReplies()
 {
-    if (!m_damageReplyPending)
-        return;
-
-    m_damageReplyPending = false;
+    while (!m_damageRegionCookies.isEmpty()) {
+        // Get the fetch-region reply, if it has arrived
+        void *data = nullptr;
+        if (!xcb_poll_for_reply(connection(), m_damageRegionCookies.first().sequence, &data, nullptr)) {
+            // the replies arrive in order, so the later ones are still pending as well
+            return;
+        }
+        m_damageRegionCookies.removeFirst();
 
-    // Get the fetch-region reply
-    xcb_xfixes_fetch_region_reply_t *reply =
-            xcb_xfixes_fetch_region_reply(connection(), m_regionCookie, nullptr);
+        auto *reply = static_cast<xcb_xfixes_fetch_region_reply_t *>(data);
+        if (!reply)
+            continue;
 
-    if (!reply)
-        return;
+        // Convert the reply to a QRegion
+        int count = xcb_xfixes_fetch_region_rectangles_length(reply);
+        QRegion region;
 
-    // Convert the reply to a QRegion
-    int count = xcb_xfixes_fetch_region_rectangles_length(reply);
-    QRegion region;
+        if (count > 1) {
+            xcb_rectangle_t *rects = xcb_xfixes_fetch_region_rectangles(reply);
 
-    if (count > 1 && count < 16) {
-        xcb_rectangle_t *rects = xcb_xfixes_fetch_region_rectangles(reply);
+            QVector<QRect> qrects;
+            qrects.reserve(count);
 
-        QVector<QRect> qrects;
-        qrects.reserve(count);
+            for (int i = 0; i < count; i++)
+                qrects << QRect(rects[i].x, rects[i].y, rects[i].width, rects[i].height);
 
-        for (int i = 0; i < count; i++)
-            qrects << QRect(rects[i].x, rects[i].y, rects[i].width, rects[i].height);
+            region.setRects(qrects.constData(), count);
+        } else
+            region += QRect(reply->extents.x, reply->extents.y,
+                            reply->extents.width, reply->extents.height);
 
-        region.setRects(qrects.constData(), count);
-    } else
-        region += QRect(reply->extents.x, reply->extents.y,
-                        reply->extents.width, reply->extents.height);
+        damage_region += region;
+        repaints_region += region;
 
-    damage_region += region;
-    repaints_region += region;
-
-    free(reply);
+        free(reply);
+    }
 }
 
 void Toplevel::addDamageFull()
@@ -460,20 +460,21 @@ public:
     virtual Layer layer() const = 0;
 
     /**
-     * Resets the damage state and sends a request for the damage region.
-     * A call to this function must be followed by a call to getDamageRegionReply(),
-     * or the reply will be leaked.
+     * Resets the damage state and adds the damage regions which arrived since the last
+     * call to damage(). The damage region is requested as soon as the window gets damaged,
+     * at most once per call of this function, damage reported after that is requested
+     * here. Replies which have not arrived yet are not waited for, the window stays
+     * damaged until they are there.
      *
      * Returns true if the window was damaged, and false otherwise.
      */
-    bool resetAndFetchDamage();
+    bool resetAndCollectDamage();
 
     /**
-     * Gets the reply from a previous call to resetAndFetchDamage().
-     * Calling this function is a no-op if there is no pending reply.
-     * Call damage() to return the fetched region.
+     * Returns true if requests for the damage region of the window are still waiting for
+     * their reply.
      */
-    void getDamageRegionReply();
+    bool hasPendingDamageReplies() const;
 
     bool skipsCloseAnimation() const;
     void setSkipCloseAnimation(bool set);
@@ -634,6 +635,8 @@ protected:
     void discardWindowPixmap();
     void addDamageFull();
     virtual void addDamage(const QRegion &damage);
+    void fetchDamageRegion();
+    void readDamageRegionReplies();
     Xcb::Property fetchWmClientLeader() const;
     void readWmClientLeader(Xcb::Property &p);
     void getWmClientLeader();
@@ -688,9 +691,12 @@ private:
     QByteArray resource_class;
     ClientMachine *m_clientMachine;
     xcb_window_t m_wmClientLeader;
-    bool m_damageReplyPending;
     QRegion opaque_region;
-    xcb_xfixes_fetch_region_cookie_t m_regionCookie;
+    QVector<xcb_xfixes_fetch_region_cookie_t> m_damageRegionCookies;
+    // whether the damage was subtracted since the last pass, and whether damage reported
+    // afterwards is left for the next one
+    bool m_damageFetched = false;
+    bool m_damageDeferred = false;
     int m_screen;
     bool m_skipCloseAnimation;
     quint32 m_surfaceId = 0;
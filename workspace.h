@@ -29,6 +29,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "sm.h"
 #include "utils.h"
 // Qt
+#include <QHash>
 #include <QTimer>
 #include <QVector>
 // std
@@ -652,6 +653,53 @@ private:
     QVector<StrutRects> oldrestrictedmovearea;
     QVector< QVector<QRect> > screenarea; // Array of workareas per xinerama screen for all virtual desktops
     QVector< QRect > oldscreensizes; // array of previous sizes of xinerama screens
+
+    /**
+     * The areas a client with struts takes away from the desktops it is on. They are
+     * cached so that updateClientArea() only recomputes the desktops affected by a change.
+     */
+    struct StrutContribution {
+        // the state the areas were computed from
+        QRect frameGeometry;
+        int screen = 0;
+        int desktop = 0;
+        bool onAllDesktops = false;
+        StrutRects strut;
+        QRect workArea;
+        QVector<QRect> screenAreas;
+        // whether a screen area may be removed completely
+        bool keepEmptyScreenAreas = false;
+        StrutRects moveArea;
+    };
+    QHash<const AbstractClient *, StrutContribution> m_strutContributions;
+    // screen layout the strut contributions were computed for
+    QRect m_strutDesktopArea;
+    QVector<QRect> m_strutScreens;
+
+    /**
+     * The windows a moved window can snap to, taken when the move starts. The edges are
+     * sorted, so that adjustClientPosition() only looks at the windows close to the
+     * moved one instead of scanning all clients on every step.
+     */
+    struct SnapTargets {
+        const AbstractClient *client = nullptr;
+        int desktop = 0;
+        int clientCount = 0;
+        // geometries in the order of m_allClients
+        QVector<QRect> windows;
+        // pairs of edge coordinate and index into windows, sorted by the coordinate
+        QVector<QPair<int, int>> left;
+        QVector<QPair<int, int>> right;
+        QVector<QPair<int, int>> top;
+        QVector<QPair<int, int>> bottom;
+        QVector<QRect> movementAreas;
+        // to the target windows while moving, to notice when they move
+        QVector<QMetaObject::Connection> connections;
+    };
+    void updateSnapTargets(AbstractClient *c);
+    void resetSnapTargets();
+    QVector<int> snapCandidates(int cx, int cy, int rx, int ry, int snap) const;
+    SnapTargets m_snapTargets;
     QSize olddisplaysize; // previous sizes od displayWidth()/displayHeight()
 
     int set_active_client_recursion;
@@ -359,7 +359,6 @@ protected:
     void setGeometryRestore(const QRect &geo) override;
     void doMove(int x, int y) override;
     bool doStartMoveResize() override;
-    void doPerformMoveResize() override;
     bool isWaitingForMoveResizeSync() const override;
     void doResizeSync() override;
     QSize resizeIncrements() const override;
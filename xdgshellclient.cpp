@@ -51,6 +51,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <KWayland/Server/xdgdecoration_interface.h>
 
 #include <QFileInfo>
+#include <QTimer>
 
 #include <sys/types.h>
 #include <unistd.h>
@@ -1051,6 +1052,11 @@ void XdgShellClient::requestGeometry(const QRect &rect)
 
 void XdgShellClient::updatePendingGeometry()
 {
+    const bool resizeSynced = m_resizeSyncPending && m_lastAckedConfigureRequest >= m_resizeSyncSerial;
+    if (resizeSynced) {
+        m_resizeSyncPending = false;
+        m_resizeSyncTimeout->stop();
+    }
     QPoint position = pos();
     MaximizeMode maximizeMode = m_maximizeMode;
     for (auto it = m_pendingConfigureRequests.begin(); it != m_pendingConfigureRequests.end(); it++) {
@@ -1072,6 +1078,11 @@ void XdgShellClient::updatePendingGeometry()
     }
     doSetGeometry(QRect(position, m_clientSize + QSize(borderLeft() + borderRight(), borderTop() + borderBottom())));
     updateMaximizeMode(maximizeMode);
+    if (resizeSynced && isResize()) {
+        // the client might have kept its size, in which case doSetGeometry() didn't
+        // perform the move resize
+        resumeMoveResizeSampling();
+    }
 }
 
 void XdgShellClient::handleConfigureAcknowledged(quint32 serial)
@@ -1714,9 +1725,41 @@ QPoint XdgShellClient::popupOffset(const QRect &anchorRect, const Qt::Edges anch
     return anchorPoint + popupPosAdjust;
 }
 
+bool XdgShellClient::isWaitingForMoveResizeSync() const
+{
+    return m_resizeSyncPending && isResize();
+}
+
 void XdgShellClient::doResizeSync()
 {
     requestGeometry(moveResizeGeometry());
+    // Keep a single configure in flight, pointer motion is coalesced until the client
+    // committed a buffer for it. There is no serial to wait for with wl_shell.
+    if (m_xdgShellSurface && m_requestGeometryBlockCounter == 0 && !m_pendingConfigureRequests.isEmpty()) {
+        m_resizeSyncSerial = m_pendingConfigureRequests.last().serialId;
+        m_resizeSyncPending = true;
+        if (!m_resizeSyncTimeout) {
+            m_resizeSyncTimeout = new QTimer(this);
+            m_resizeSyncTimeout->setSingleShot(true);
+            connect(m_resizeSyncTimeout, &QTimer::timeout, this,
+                [this] {
+                    // don't let a client which doesn't keep up stall the resize
+                    m_resizeSyncPending = false;
+                    resumeMoveResizeSampling();
+                }
+            );
+        }
+        m_resizeSyncTimeout->start(250);
+    }
+}
+
+void XdgShellClient::leaveMoveResize()
+{
+    m_resizeSyncPending = false;
+    if (m_resizeSyncTimeout) {
+        m_resizeSyncTimeout->stop();
+    }
+    AbstractClient::leaveMoveResize();
 }
 
 QMatrix4x4 XdgShellClient::inputTransformation() const
@@ -135,7 +135,9 @@ protected:
     Layer layerForDock() const override;
     void changeMaximize(bool horizontal, bool vertical, bool adjust) override;
     void setGeometryRestore(const QRect &geo) override;
+    bool isWaitingForMoveResizeSync() const override;
     void doResizeSync() override;
+    void leaveMoveResize() override;
     bool acceptsFocus() const override;
     void doMinimize() override;
     void updateCaption() override;
@@ -207,6 +209,11 @@ private:
     };
     QVector<PendingConfigureRequest> m_pendingConfigureRequests;
     quint32 m_lastAckedConfigureRequest = 0;
+    // configure sent for an interactive resize which has not been committed yet
+    bool m_resizeSyncPending = false;
+    quint32 m_resizeSyncSerial = 0;
+    // failsafe for clients which don't commit the configure in time
+    QTimer *m_resizeSyncTimeout = nullptr;
 
     //mode in use by the current buffer
     MaximizeMode m_maximizeMode = MaximizeRestore;
@@ -40,6 +40,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <xcb/xfixes.h>
 
 #include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
 #include <unistd.h>
 
 #include <xwayland_logging.h>
@@ -51,6 +53,18 @@ namespace Xwl
 
 // in Bytes: equals 64KB
 static const uint32_t s_incrChunkSize = 63 * 1024;
+// in Bytes: upper limit for the chunks of incremental transfers to X clients
+static const uint32_t s_maxIncrChunkSize = 4 * 1024 * 1024;
+
+static int maxIncrChunkSize()
+{
+    // a chunk has to fit into a single ChangeProperty request, which has a 24 Byte header
+    const uint64_t maxRequestSize = uint64_t(xcb_get_maximum_request_length(kwinApp()->x11Connection())) * 4;
+    if (maxRequestSize <= s_incrChunkSize + 24) {
+        return s_incrChunkSize;
+    }
+    return std::min<uint64_t>(maxRequestSize - 24, s_maxIncrChunkSize);
+}
 
 Transfer::Transfer(xcb_atom_t selection, qint32 fd, xcb_timestamp_t timestamp, QObject *parent)
     : QObject(parent)
@@ -58,6 +72,12 @@ Transfer::Transfer(xcb_atom_t selection, qint32 fd, xcb_timestamp_t timestamp, Q
     , m_fd(fd)
     , m_timestamp(timestamp)
 {
+    // a client which doesn't keep up must not block us, full pipes are
+    // waited for with the socket notifier instead
+    const int flags = fcntl(m_fd, F_GETFL);
+    if (flags != -1) {
+        fcntl(m_fd, F_SETFL, flags | O_NONBLOCK);
+    }
 }
 
 void Transfer::createSocketNotifier(QSocketNotifier::Type type)
@@ -100,6 +120,8 @@ TransferWltoX::TransferWltoX(xcb_atom_t selection, xcb_selection_request_event_t
                              qint32 fd, QObject *parent)
     : Transfer(selection, fd, 0, parent)
     , m_request(request)
+    , m_chunkSize(s_incrChunkSize)
+    , m_maxChunkSize(maxIncrChunkSize())
 {
 }
 
@@ -120,7 +142,7 @@ void TransferWltoX::startTransferFromSource()
     );
 }
 
-int TransferWltoX::flushSourceData()
+void TransferWltoX::flushSourceData()
 {
     xcb_connection_t *xcbConn = kwinApp()->x11Connection();
 
@@ -130,21 +152,18 @@ int TransferWltoX::flushSourceData()
                         m_request->property,
                         m_request->target,
                         8,
-                        m_chunks.first().first.size(),
-                        m_chunks.first().first.data());
+                        m_bufferLength,
+                        m_buffer.constData());
+    // after the flush the buffer can be reused for the next chunk
     xcb_flush(xcbConn);
 
     m_propertyIsSet = true;
+    m_bufferLength = 0;
     resetTimeout();
-
-    const auto rm = m_chunks.takeFirst();
-    return rm.first.size();
 }
 
 void TransferWltoX::startIncr()
 {
-    Q_ASSERT(m_chunks.size() == 1);
-
     xcb_connection_t *xcbConn = kwinApp()->x11Connection();
 
     uint32_t mask[] = { XCB_EVENT_MASK_PROPERTY_CHANGE };
@@ -165,48 +184,43 @@ void TransferWltoX::startIncr()
     setIncr(true);
     // first data will be flushed after the property has been deleted
     // again by the requestor
-    m_flushPropertyOnDelete = true;
     m_propertyIsSet = true;
     Q_EMIT selectionNotify(m_request, true);
 }
 
 void TransferWltoX::readWlSource()
 {
-    if (m_chunks.size() == 0 ||
-            m_chunks.last().second == s_incrChunkSize) {
-        // append new chunk
-        auto next = QPair<QByteArray, int>();
-        next.first.resize(s_incrChunkSize);
-        next.second = 0;
-        m_chunks.append(next);
+    if (m_buffer.size() < m_chunkSize) {
+        m_buffer.resize(m_chunkSize);
     }
-
-    const auto oldLen = m_chunks.last().second;
-    const auto avail = s_incrChunkSize - m_chunks.last().second;
+    const int avail = m_chunkSize - m_bufferLength;
     Q_ASSERT(avail > 0);
 
-    ssize_t readLen = read(fd(), m_chunks.last().first.data() + oldLen, avail);
+    const ssize_t readLen = read(fd(), m_buffer.data() + m_bufferLength, avail);
     if (readLen == -1) {
+        if (errno == EAGAIN || errno == EINTR) {
+            return;
+        }
         qCWarning(KWIN_XWL) << "Error reading in Wl data.";
 
         // TODO: cleanup X side?
         endTransfer();
         return;
     }
-    m_chunks.last().second = oldLen + readLen;
+    m_bufferLength += readLen;
+    resetTimeout();
 
     if (readLen == 0) {
         // at the fd end - complete transfer now
-        m_chunks.last().first.resize(m_chunks.last().second);
+        m_sourceFinished = true;
+        clearSocketNotifier();
 
         if (incr()) {
             // incremental transfer is to be completed now
-            m_flushPropertyOnDelete = true;
             if (!m_propertyIsSet) {
                 // flush if target's property is not set at the moment
-                flushSourceData();
+                handlePropertyDelete();
             }
-            clearSocketNotifier();
         } else {
             // non incremental transfer is to be completed now,
             // data can be transferred to X client via a single property set
@@ -214,20 +228,29 @@ void TransferWltoX::readWlSource()
             Q_EMIT selectionNotify(m_request, true);
             endTransfer();
         }
-    } else if (m_chunks.last().second == s_incrChunkSize) {
-        // first chunk full, but not yet at fd end -> go incremental
-        if (incr()) {
-            m_flushPropertyOnDelete = true;
-            if (!m_propertyIsSet) {
-                // flush if target's property is not set at the moment
-                flushSourceData();
-            }
-        } else {
-            // starting incremental transfer
+        return;
+    }
+
+    if (!incr()) {
+        if (m_bufferLength == m_chunkSize) {
+            // first chunk full, but not yet at fd end -> go incremental
             startIncr();
+            socketNotifier()->setEnabled(false);
+        }
+        return;
+    }
+    if (!m_propertyIsSet) {
+        // the requestor waits for data, hand over what we have
+        flushSourceData();
+    } else if (m_bufferLength == m_chunkSize) {
+        // the requestor is slower than the source, collect larger chunks
+        // to save round trips and stop reading once the buffer is at its limit
+        if (m_chunkSize < m_maxChunkSize) {
+            m_chunkSize = std::min(m_chunkSize * 2, m_maxChunkSize);
+        } else {
+            socketNotifier()->setEnabled(false);
         }
     }
-    resetTimeout();
 }
 
 bool TransferWltoX::handlePropertyNotify(xcb_property_notify_event_t *event)
@@ -250,29 +273,31 @@ void TransferWltoX::handlePropertyDelete()
     }
     m_propertyIsSet = false;
 
-    if (m_flushPropertyOnDelete) {
-        if (!socketNotifier() && m_chunks.isEmpty()) {
-            // transfer complete
-            xcb_connection_t *xcbConn = kwinApp()->x11Connection();
-
-            uint32_t mask[] = {0};
-            xcb_change_window_attributes (xcbConn,
-                                          m_request->requestor,
-                                          XCB_CW_EVENT_MASK, mask);
-
-            xcb_change_property(xcbConn,
-                                XCB_PROP_MODE_REPLACE,
-                                m_request->requestor,
-                                m_request->property,
-                                m_request->target,
-                                8, 0, nullptr);
-            xcb_flush(xcbConn);
-            m_flushPropertyOnDelete = false;
-            endTransfer();
-        } else {
-            flushSourceData();
+    if (m_bufferLength > 0) {
+        flushSourceData();
+        if (socketNotifier()) {
+            // there is room in the buffer again
+            socketNotifier()->setEnabled(true);
         }
+    } else if (m_sourceFinished) {
+        // transfer complete
+        xcb_connection_t *xcbConn = kwinApp()->x11Connection();
+
+        uint32_t mask[] = {0};
+        xcb_change_window_attributes (xcbConn,
+                                      m_request->requestor,
+                                      XCB_CW_EVENT_MASK, mask);
+
+        xcb_change_property(xcbConn,
+                            XCB_PROP_MODE_REPLACE,
+                            m_request->requestor,
+                            m_request->property,
+                            m_request->target,
+                            8, 0, nullptr);
+        xcb_flush(xcbConn);
+        endTransfer();
     }
+    // otherwise the next data is handed over as soon as it has been read
 }
 
 TransferXtoWl::TransferXtoWl(xcb_atom_t selection, xcb_atom_t target, qint32 fd,
@@ -403,10 +428,18 @@ void TransferXtoWl::getIncrChunk()
         // receive mechanism has not yet been setup
         return;
     }
+    if (socketNotifier()) {
+        // the previous chunk is still being written, fetch this one afterwards
+        m_chunkPending = true;
+        return;
+    }
+    m_chunkPending = false;
     xcb_connection_t *xcbConn = kwinApp()->x11Connection();
 
+    // Deleting the property right away lets the source prepare the next chunk
+    // while this one is written to the Wayland client.
     auto cookie = xcb_get_property(xcbConn,
-                                   0,
+                                   1,
                                    m_window,
                                    atoms->wl_selection,
                                    XCB_GET_PROPERTY_TYPE_ANY,
@@ -557,9 +590,13 @@ void TransferXtoWl::dataSourceWrite()
 
     ssize_t len = write(fd(), property.constData(), property.size());
     if (len == -1) {
-        qCWarning(KWIN_XWL) << "X11 to Wayland write error on fd:" << fd();
-        endTransfer();
-        return;
+        if (errno != EAGAIN && errno != EINTR) {
+            qCWarning(KWIN_XWL) << "X11 to Wayland write error on fd:" << fd();
+            endTransfer();
+            return;
+        }
+        // the pipe is full, wait until the client has read from it
+        len = 0;
     }
 
     m_receiver->partRead(len);
@@ -567,11 +604,10 @@ void TransferXtoWl::dataSourceWrite()
         // property completely transferred
         if (incr()) {
             clearSocketNotifier();
-            xcb_connection_t *xcbConn = kwinApp()->x11Connection();
-            xcb_delete_property(xcbConn,
-                                m_window,
-                                atoms->wl_selection);
-            xcb_flush(xcbConn);
+            if (m_chunkPending) {
+                getIncrChunk();
+                return;
+            }
         } else {
             // transfer complete
             endTransfer();
@@ -132,18 +132,24 @@ Q_SIGNALS:
 private:
     void startIncr();
     void readWlSource();
-    int flushSourceData();
+    void flushSourceData();
     void handlePropertyDelete();
 
     xcb_selection_request_event_t *m_request = nullptr;
 
-    /* contains all received data portioned in chunks
-     * TODO: explain second QPair component
+    /* Data read from the Wayland source which has not been handed to the requestor yet.
+     * The buffer is reused for all chunks, only its first m_bufferLength bytes are valid.
      */
-    QVector<QPair<QByteArray, int> > m_chunks;
+    QByteArray m_buffer;
+    int m_bufferLength = 0;
+    /* The amount of data collected while the requestor is busy with the previous chunk.
+     * Grows when the source is faster than the requestor, up to m_maxChunkSize.
+     */
+    int m_chunkSize;
+    int m_maxChunkSize;
 
+    bool m_sourceFinished = false;
     bool m_propertyIsSet = false;
-    bool m_flushPropertyOnDelete = false;
 
     Q_DISABLE_COPY(TransferWltoX)
 };
@@ -220,6 +226,8 @@ private:
 
     xcb_window_t m_window;
     DataReceiver *m_receiver = nullptr;
+    // the source set the next chunk while the previous one was still being written
+    bool m_chunkPending = false;
 
     Q_DISABLE_COPY(TransferXtoWl)
 };